@@ -0,0 +1,267 @@
+// definitions for allocationprofile.h
+
+#include "allocationprofile.h"
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+bool allocationProfiling = false;
+thread_local Node* currentAllocationSite = nullptr;
+
+// sites keep at most this many characters of the source of their node
+static const size_t SITE_SOURCE_LENGTH = 60;
+
+// an object whose type isn't counted yet
+struct PendingAllocation {
+    Object* object;
+    size_t bytes;
+    AllocationSiteProfile* site;
+};
+
+// what the profiler keeps for each thread which allocates, only touched by that thread outside of
+// resolveAllocations and the functions which read the counts, which run while every other thread is idle
+struct ThreadProfile {
+    std::unordered_map<Node*, AllocationSiteProfile> sites;
+    std::vector<PendingAllocation> pending;
+    CountsByKind allocated;
+    Node* lastNode = nullptr; // site of the last allocation, most come in runs from one node
+    AllocationSiteProfile* lastSite = nullptr;
+};
+
+// the profiles of every thread
+struct Profiler {
+    std::mutex lock; // guards threads
+    std::vector<ThreadProfile*> threads;
+    ThreadProfile exited; // counts of threads which have exited
+};
+
+// the profiler, never destroyed so threads may exit during static destruction
+static Profiler& profiler(){
+    static Profiler* instance = new Profiler();
+    return *instance;
+}
+
+// helper which adds bytes of kind to counts
+static void count(CountsByKind& counts, size_t kind, size_t bytes){
+    counts[kind].objects++;
+    counts[kind].bytes += bytes;
+}
+
+// helper which adds every count of from to to
+static void add(CountsByKind& to, const CountsByKind& from){
+    for(size_t kind = 0; kind < ALLOCATION_KINDS; kind++){
+        to[kind].objects += from[kind].objects;
+        to[kind].bytes += from[kind].bytes;
+    }
+}
+
+// helper which counts the pending allocations of thread by their type
+// REQUIRES: profiler().lock is held
+static void resolve(ThreadProfile* thread){
+    for(PendingAllocation& allocation: thread->pending){
+        if(!objectAlive(allocation.object))
+            continue; // deleted before it was counted, its type is gone with it
+        size_t kind = (size_t)allocation.object->type();
+        count(thread->allocated, kind, allocation.bytes);
+        count(allocation.site->kinds, kind, allocation.bytes);
+    }
+    thread->pending.clear();
+}
+
+// helper which merges the sites of from into to, sites are told apart by their node
+static void mergeSites(std::unordered_map<Node*, AllocationSiteProfile>& to,
+    const std::unordered_map<Node*, AllocationSiteProfile>& from){
+    for(auto& entry: from){
+        auto found = to.find(entry.first);
+        if(found == to.end())
+            to.emplace(entry.first, entry.second);
+        else
+            add(found->second.kinds, entry.second.kinds);
+    }
+}
+
+// moves the counts of the thread's profile to the exited one when the thread exits
+struct ThreadProfileOwner {
+    ThreadProfile* thread = nullptr;
+
+    ~ThreadProfileOwner(){
+        if(thread == nullptr)
+            return;
+        Profiler& instance = profiler();
+        std::lock_guard<std::mutex> guard(instance.lock);
+        resolve(thread);
+        add(instance.exited.allocated, thread->allocated);
+        mergeSites(instance.exited.sites, thread->sites);
+        instance.threads.erase(std::find(instance.threads.begin(), instance.threads.end(), thread));
+        delete thread;
+        thread = nullptr;
+    }
+};
+
+static thread_local ThreadProfileOwner owner;
+
+// returns the calling thread's profile, registering the thread on first use
+static ThreadProfile* thisThreadProfile(){
+    if(owner.thread == nullptr){
+        ThreadProfile* thread = new ThreadProfile();
+        Profiler& instance = profiler();
+        std::lock_guard<std::mutex> guard(instance.lock);
+        instance.threads.push_back(thread);
+        owner.thread = thread;
+    }
+    return owner.thread;
+}
+
+// helper which returns the profile of the node the thread is evaluating
+static AllocationSiteProfile* currentSite(ThreadProfile* thread){
+    Node* node = currentAllocationSite;
+    if(node == thread->lastNode && thread->lastSite != nullptr)
+        return thread->lastSite;
+    auto found = thread->sites.find(node);
+    if(found == thread->sites.end()){
+        AllocationSiteProfile site;
+        if(node != nullptr){
+            site.offset = node->token.offset;
+            site.source = node->toString();
+            std::replace(site.source.begin(), site.source.end(), '\n', ' ');
+            if(site.source.size() > SITE_SOURCE_LENGTH)
+                site.source = site.source.substr(0, SITE_SOURCE_LENGTH - 3) + "...";
+        }
+        found = thread->sites.emplace(node, std::move(site)).first;
+    }
+    thread->lastNode = node;
+    thread->lastSite = &found->second;
+    return thread->lastSite;
+}
+
+// records an object allocateObject just allocated
+void recordObjectAllocation(Object* object, size_t bytes){
+    ThreadProfile* thread = thisThreadProfile();
+    thread->pending.push_back({object, bytes, currentSite(thread)});
+}
+
+// records an environment allocated by the calling thread
+void recordEnvironmentAllocation(){
+    ThreadProfile* thread = thisThreadProfile();
+    count(thread->allocated, ENVIRONMENT_KIND, ENVIRONMENT_BYTES);
+    count(currentSite(thread)->kinds, ENVIRONMENT_KIND, ENVIRONMENT_BYTES);
+}
+
+// counts the objects recorded since the last call by their type
+void resolveAllocations(){
+    Profiler& instance = profiler();
+    std::lock_guard<std::mutex> guard(instance.lock);
+    for(ThreadProfile* thread: instance.threads)
+        resolve(thread);
+}
+
+// returns the sum of the counts of every kind
+AllocationCounts AllocationSiteProfile::total() const{
+    AllocationCounts sum;
+    for(const AllocationCounts& kind: kinds){
+        sum.objects += kind.objects;
+        sum.bytes += kind.bytes;
+    }
+    return sum;
+}
+
+// returns the counts
+AllocationProfile allocationProfile(){
+    AllocationProfile profile;
+    profile.live = heapCensus(); // before taking the profiler's lock as collections take it under the heap's
+    resolveAllocations();
+
+    Profiler& instance = profiler();
+    std::lock_guard<std::mutex> guard(instance.lock);
+    std::unordered_map<Node*, AllocationSiteProfile> sites = instance.exited.sites;
+    add(profile.allocated, instance.exited.allocated);
+    for(ThreadProfile* thread: instance.threads){
+        add(profile.allocated, thread->allocated);
+        mergeSites(sites, thread->sites);
+    }
+    for(auto& entry: sites)
+        profile.sites.push_back(std::move(entry.second));
+    std::sort(profile.sites.begin(), profile.sites.end(), [](const AllocationSiteProfile& a, const AllocationSiteProfile& b){
+        return a.total().bytes > b.total().bytes;
+    });
+    return profile;
+}
+
+// forgets every count
+void resetAllocationProfile(){
+    Profiler& instance = profiler();
+    std::lock_guard<std::mutex> guard(instance.lock);
+    std::vector<ThreadProfile*> all(instance.threads);
+    all.push_back(&instance.exited);
+    for(ThreadProfile* thread: all){
+        thread->sites.clear();
+        thread->pending.clear();
+        thread->allocated = CountsByKind();
+        thread->lastNode = nullptr;
+        thread->lastSite = nullptr;
+    }
+}
+
+// returns the name of a kind of allocation
+std::string allocationKindName(size_t kind){
+    if(kind == ENVIRONMENT_KIND)
+        return "ENVIRONMENT";
+    return ObjectTypeToString[(ObjectType)kind];
+}
+
+// helper which pads text with spaces on the left up to width
+static std::string padLeft(const std::string& text, size_t width){
+    return text.size() >= width ? text : std::string(width - text.size(), ' ') + text;
+}
+
+// helper which pads text with spaces on the right up to width
+static std::string padRight(const std::string& text, size_t width){
+    return text.size() >= width ? text : text + std::string(width - text.size(), ' ');
+}
+
+// formats profile as a table of kinds followed by the top sites
+std::string formatAllocationReport(const AllocationProfile& profile, size_t top, Lexer* lexer){
+    std::string report = padRight("kind", 14) + padLeft("allocated", 12) + padLeft("bytes", 14) +
+        padLeft("live", 12) + padLeft("bytes", 14) + "\n";
+    AllocationCounts allocated, live;
+    for(size_t kind = 0; kind < ALLOCATION_KINDS; kind++){
+        if(profile.allocated[kind].objects == 0 && profile.live[kind].objects == 0)
+            continue;
+        report += padRight(allocationKindName(kind), 14) +
+            padLeft(std::to_string(profile.allocated[kind].objects), 12) +
+            padLeft(std::to_string(profile.allocated[kind].bytes), 14) +
+            padLeft(std::to_string(profile.live[kind].objects), 12) +
+            padLeft(std::to_string(profile.live[kind].bytes), 14) + "\n";
+        allocated.objects += profile.allocated[kind].objects;
+        allocated.bytes += profile.allocated[kind].bytes;
+        live.objects += profile.live[kind].objects;
+        live.bytes += profile.live[kind].bytes;
+    }
+    report += padRight("total", 14) + padLeft(std::to_string(allocated.objects), 12) +
+        padLeft(std::to_string(allocated.bytes), 14) + padLeft(std::to_string(live.objects), 12) +
+        padLeft(std::to_string(live.bytes), 14) + "\n";
+
+    size_t shown = std::min(top, profile.sites.size());
+    if(shown == 0)
+        return report;
+    report += "\ntop " + std::to_string(shown) + " allocation sites by bytes\n";
+    for(size_t i = 0; i < shown; i++){
+        const AllocationSiteProfile& site = profile.sites[i];
+        AllocationCounts total = site.total();
+        std::string location = "-";
+        if(site.offset != UNKNOWN_OFFSET && lexer != nullptr){
+            SourceLocation found = lexer->locate(site.offset);
+            location = std::to_string(found.line) + ":" + std::to_string(found.column);
+        }
+        std::string kinds;
+        for(size_t kind = 0; kind < ALLOCATION_KINDS; kind++){
+            if(site.kinds[kind].objects != 0)
+                kinds += (kinds.empty() ? "" : ", ") + allocationKindName(kind) + " " +
+                    std::to_string(site.kinds[kind].objects);
+        }
+        report += padLeft(std::to_string(total.bytes), 12) + padLeft(std::to_string(total.objects), 10) + "  " +
+            padRight(location, 9) + (site.source.empty() ? "(outside of any node)" : site.source) +
+            "  [" + kinds + "]\n";
+    }
+    return report;
+}
@@ -0,0 +1,84 @@
+// allocation profiler which counts what the evaluator allocates by kind and by the AST node allocating it
+
+#ifndef ALLOCATIONPROFILE_H
+#define ALLOCATIONPROFILE_H
+
+#include <string>
+#include <vector>
+#include "ast.h"
+#include "heap.h"
+#include "lexer.h"
+
+// whether allocations are counted, off by default as every allocation then costs a table lookup
+extern bool allocationProfiling;
+
+// node the calling thread is evaluating, allocations are attributed to it
+extern thread_local Node* currentAllocationSite;
+
+// makes node the allocation site of the calling thread while it is alive, if allocations are counted
+class AllocationSite {
+    public:
+        AllocationSite(Node* node){
+            if(allocationProfiling){
+                previous = currentAllocationSite;
+                currentAllocationSite = node;
+                active = true;
+            }
+        }
+
+        ~AllocationSite(){
+            if(active)
+                currentAllocationSite = previous;
+        }
+
+        AllocationSite(const AllocationSite&) = delete;
+        AllocationSite& operator=(const AllocationSite&) = delete;
+
+    private:
+        Node* previous = nullptr;
+        bool active = false;
+};
+
+// what one node allocated
+struct AllocationSiteProfile {
+    uint32_t offset = UNKNOWN_OFFSET; // of the node's token, unknown for allocations outside of any node
+    std::string source; // the node's source text, shortened
+    CountsByKind kinds;
+
+    // returns the counts of every kind added up
+    AllocationCounts total() const;
+};
+
+// everything counted since profiling started or was last reset
+struct AllocationProfile {
+    CountsByKind allocated;
+    CountsByKind live; // what the heap holds now, whether or not it was allocated while profiling
+    std::vector<AllocationSiteProfile> sites; // most bytes first
+};
+
+// records an object allocateObject just allocated, whose type is only known once it is constructed
+void recordObjectAllocation(Object* object, size_t bytes);
+
+// records an environment allocated by the calling thread
+void recordEnvironmentAllocation();
+
+// counts the objects recorded since the last call by their type, called by collections before objects
+// move or are destroyed
+// REQUIRES: no other thread is evaluating
+void resolveAllocations();
+
+// returns the counts
+// REQUIRES: no other thread is evaluating
+AllocationProfile allocationProfile();
+
+// forgets every count
+// REQUIRES: no other thread is evaluating
+void resetAllocationProfile();
+
+// returns the name of a kind of allocation, like "ARRAY" or "ENVIRONMENT"
+std::string allocationKindName(size_t kind);
+
+// formats profile as a table of kinds followed by the top sites, located with lexer if it is given
+std::string formatAllocationReport(const AllocationProfile& profile, size_t top, Lexer* lexer = nullptr);
+
+#endif // ALLOCATIONPROFILE_H
@@ -7,6 +7,16 @@ std::string Node::tokenLiteral(){
     return token.literal;
 }
 
+// appends the direct child nodes of this node to out in source order, leaves add none
+void Node::children(std::vector<Node*>&){
+}
+
+// appends expressionValue if the statement has one
+void Statement::children(std::vector<Node*>& out){
+    if(expressionValue)
+        out.push_back(expressionValue);
+}
+
 // default constructor for Program
 Program::Program(){
     statements = std::vector<Statement*>();
@@ -278,4 +288,164 @@ std::string HashLiteral::toString(){
     }
     output += "}";
     return output;
-}
\ No newline at end of file
+}
+
+// appends each of the statements
+void Program::children(std::vector<Node*>& out){
+    for(Node* child: statements){
+        if(child)
+            out.push_back(child);
+    }
+}
+
+// appends the name and then the value
+void LetStatement::children(std::vector<Node*>& out){
+    if(name)
+        out.push_back(name);
+    Statement::children(out);
+}
+
+// appends each of the elements
+void ArrayLiteral::children(std::vector<Node*>& out){
+    for(Node* child: elements){
+        if(child)
+            out.push_back(child);
+    }
+}
+
+// appends right
+void PrefixExpression::children(std::vector<Node*>& out){
+    if(right)
+        out.push_back(right);
+}
+
+// appends left and then right
+void InfixExpression::children(std::vector<Node*>& out){
+    if(left)
+        out.push_back(left);
+    if(right)
+        out.push_back(right);
+}
+
+// appends each of the statements
+void BlockStatement::children(std::vector<Node*>& out){
+    for(Node* child: statements){
+        if(child)
+            out.push_back(child);
+    }
+}
+
+// appends the condition, consequence and alternative if there is one
+void IfExpression::children(std::vector<Node*>& out){
+    if(condition)
+        out.push_back(condition);
+    if(consequence)
+        out.push_back(consequence);
+    if(alternative)
+        out.push_back(alternative);
+}
+
+// appends the parameters and then the body
+void FunctionLiteral::children(std::vector<Node*>& out){
+    for(Node* child: parameters){
+        if(child)
+            out.push_back(child);
+    }
+    if(body)
+        out.push_back(body);
+}
+
+// appends the function and then the arguments
+void CallExpression::children(std::vector<Node*>& out){
+    if(function)
+        out.push_back(function);
+    for(Node* child: arguments){
+        if(child)
+            out.push_back(child);
+    }
+}
+
+// appends left and then index
+void IndexExpression::children(std::vector<Node*>& out){
+    if(left)
+        out.push_back(left);
+    if(index)
+        out.push_back(index);
+}
+
+// appends each key followed by its value
+void HashLiteral::children(std::vector<Node*>& out){
+    for(auto& pair: pairs){
+        out.push_back(pair.first);
+        out.push_back(pair.second);
+    }
+}
+
+// prints the assignment ex. x = 5;
+std::string AssignStatement::toString(){
+    std::string output = name->toString() + " = ";
+    if(expressionValue != nullptr)
+        output += expressionValue->toString();
+    output += ";";
+    return output;
+}
+
+// appends the name and then the value
+void AssignStatement::children(std::vector<Node*>& out){
+    if(name)
+        out.push_back(name);
+    Statement::children(out);
+}
+
+// prints the loop ex. while(x < 5) x = x + 1;
+std::string WhileStatement::toString(){
+    std::string output = "while";
+    output += expressionValue->toString();
+    output += " ";
+    output += body->toString();
+    return output;
+}
+
+// appends the condition and then the body
+void WhileStatement::children(std::vector<Node*>& out){
+    Statement::children(out);
+    if(body)
+        out.push_back(body);
+}
+
+// prints the loop ex. for(x in [1, 2]) puts(x)
+std::string ForStatement::toString(){
+    std::string output = "for(";
+    output += iterator->toString() + " in " + expressionValue->toString();
+    output += ") ";
+    output += body->toString();
+    return output;
+}
+
+// appends the iterator, the iterable and then the body
+void ForStatement::children(std::vector<Node*>& out){
+    if(iterator)
+        out.push_back(iterator);
+    Statement::children(out);
+    if(body)
+        out.push_back(body);
+}
+
+// names a function literal after the let binding it is the value of, which profiles report it as
+void nameFunctionLiteral(LetStatement* stmt){
+    FunctionLiteral* funcLit = dynamic_cast<FunctionLiteral*>(stmt->expressionValue);
+    if(funcLit != nullptr && stmt->name != nullptr)
+        funcLit->name = stmt->name->value;
+}
+
+// returns the name profiles report the function created from literal as
+std::string functionName(FunctionLiteral* literal, Lexer* lexer){
+    if(literal == nullptr)
+        return "fn"; // a function which wasn't created from a literal
+    if(!literal->name.empty())
+        return literal->name;
+    if(lexer == nullptr || literal->token.offset == UNKNOWN_OFFSET)
+        return "fn@" + std::to_string(literal->token.offset);
+    SourceLocation location = lexer->locate(literal->token.offset);
+    return "fn@" + std::to_string(location.line) + ":" + std::to_string(location.column);
+}
@@ -3,6 +3,8 @@
 #ifndef AST_H
 #define AST_H
 
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include "lexer.h"
@@ -18,6 +20,9 @@ class Node {
         // returns the token literal
         std::string tokenLiteral();
 
+        // EFFECTS:  appends the direct child nodes of this node to out in source order, leaves add none
+        virtual void children(std::vector<Node*>& out);
+
         //vars
         // all nodes have a token value which is the immediate token it represents, some nodes may 
         // have pointers to other nodes which will have their own token values
@@ -39,6 +44,10 @@ class Statement : public Node {
             if(expressionValue)
                 delete expressionValue;
         }
+
+        // appends expressionValue if the statement has one
+        void children(std::vector<Node*>& out) override;
+
         // vars
         //Token token; from node
         Expression* expressionValue = nullptr; // Almost all statements need expression values so we include this here
@@ -63,6 +72,9 @@ class Program : public Node {
         // EFFECTS: returns a string of all of the statements within the program, nicely formatted
         std::string toString() override;
 
+        // appends each of the statements
+        void children(std::vector<Node*>& out) override;
+
         //vars
         // Token token; from node, not used for program
         // vector of the statements within a program
@@ -105,6 +117,9 @@ class LetStatement : public Statement {
     // EFFECTS: Prints the LetStatement is a legible way
     std::string toString() override;
 
+    // appends the name and then the value
+    void children(std::vector<Node*>& out) override;
+
     // vars
     //Token token; from node always LET
     Identifier* name = nullptr;
@@ -195,6 +210,9 @@ class ArrayLiteral: public Expression{
         // Overriding toString from Node for printing
         std::string toString() override;
 
+        // appends each of the elements
+        void children(std::vector<Node*>& out) override;
+
         //vars
         // Token token; from node
         std::vector<Expression*> elements; // elements of the array
@@ -212,12 +230,32 @@ class PrefixExpression: public Expression{
     // toString override
     std::string toString() override;
 
+    // appends right
+    void children(std::vector<Node*>& out) override;
+
     //vars
     // Token token from node
     std::string op;
     Expression* right = nullptr;
 };
 
+// what an infix or index expression has specialized itself to after Eval first ran it, nodes start UNSEEN
+// and go back to GENERIC for good once their operands stop matching the specialization
+enum class Quickened : uint8_t {
+    UNSEEN,
+    GENERIC,
+    INTEGER_ADD,
+    INTEGER_SUBTRACT,
+    INTEGER_MULTIPLY,
+    INTEGER_DIVIDE,
+    INTEGER_LESS_THAN,
+    INTEGER_GREATER_THAN,
+    INTEGER_EQUAL,
+    INTEGER_NOT_EQUAL,
+    ARRAY_INDEX_BY_INTEGER,
+    HASH_INDEX_BY_STRING,
+};
+
 // Expression Node which holds an infix expression like 5+5, has the operator, and left and right expression pointers
 class InfixExpression: public Expression{
     public:
@@ -230,11 +268,15 @@ class InfixExpression: public Expression{
     // toString override
     std::string toString() override;
 
+    // appends left and then right
+    void children(std::vector<Node*>& out) override;
+
     //vars
     // Token token; from node
     std::string op;
     Expression* left = nullptr; // expression pointer to the left
     Expression* right = nullptr; // expression pointer to the right
+    std::atomic<Quickened> quickened{Quickened::UNSEEN}; // atomic as parallel builtins share function bodies
 };
 
 // Expression node which holds a boolean expression, like integerLiteral but for bools, just holds bool value
@@ -263,6 +305,9 @@ class BlockStatement: public Statement{
     // turns Block statement into a string
     std::string toString();
 
+    // appends each of the statements
+    void children(std::vector<Node*>& out) override;
+
     //vars
     std::vector<Statement*> statements;
 };
@@ -279,6 +324,9 @@ class IfExpression: public Expression{
     // prints out if as a string
     std::string toString() override;
 
+    // appends the condition, consequence and alternative if there is one
+    void children(std::vector<Node*>& out) override;
+
     //vars
     Expression* condition = nullptr;
     BlockStatement* consequence = nullptr;
@@ -302,10 +350,14 @@ class FunctionLiteral: public Expression{
     // returns a string of the function literal properly formated 
     std::string toString();
 
+    // appends the parameters and then the body
+    void children(std::vector<Node*>& out) override;
+
     //vars
     // Token token; from node
     std::vector<Identifier*> parameters;
     BlockStatement* body = nullptr;
+    std::string name; // of the let binding the literal is the value of, empty for anonymous functions
 };
 
 // Expression Node which holds the calling of a function occurs when we see '(' and preceded by a 
@@ -329,6 +381,9 @@ class CallExpression: public Expression {
     // to string for printing 
     std::string toString();
 
+    // appends the function and then the arguments
+    void children(std::vector<Node*>& out) override;
+
     //vars 
     // token; from node, is '(' 
     Expression* function = nullptr; // expression * to preceding function
@@ -354,13 +409,94 @@ class IndexExpression: public Expression{
     // to string for printing 
     std::string toString();
 
+    // appends left and then index
+    void children(std::vector<Node*>& out) override;
+
     //vars 
     // token; from node, is '(' 
     Expression* left = nullptr; // expression* left of [
     Expression* index = nullptr; // expression * right of [
+    std::atomic<Quickened> quickened{Quickened::UNSEEN}; // atomic as parallel builtins share function bodies
 
 };
 
+// Statement node which assigns a new value to a binding which already exists ex. x = x + 1;
+// has the identifier* name being assigned and the expression* value in expressionValue
+class AssignStatement : public Statement {
+    public:
+    // constructor with the name being assigned
+    AssignStatement(Token token, Identifier* name){
+        this->token = token;
+        this->name = name;
+    }
+
+    // destructor
+    ~AssignStatement(){
+        if(name)
+            delete name;
+    } // value is deleted by the Statement destructor
+
+    // prints the assignment ex. x = 5;
+    std::string toString() override;
+
+    // appends the name and then the value
+    void children(std::vector<Node*>& out) override;
+
+    // vars
+    // Token token; from node, the identifier being assigned
+    Identifier* name = nullptr;
+};
+
+// Statement node for a while loop, expressionValue holds the condition and the body runs while it is truthy
+class WhileStatement : public Statement {
+    public:
+    // constructor
+    WhileStatement(Token token){this->token = token;};
+
+    // destructor
+    ~WhileStatement(){
+        if(body)
+            delete body;
+    } // condition is deleted by the Statement destructor
+
+    // prints the loop ex. while(x < 5) x = x + 1;
+    std::string toString() override;
+
+    // appends the condition and then the body
+    void children(std::vector<Node*>& out) override;
+
+    // vars
+    // Token token; from node, always WHILE
+    BlockStatement* body = nullptr;
+};
+
+// Statement node for a for in loop, expressionValue holds the array being iterated and the body
+// runs once for each element with iterator bound to it
+class ForStatement : public Statement {
+    public:
+    // constructor
+    ForStatement(Token token){this->token = token;};
+
+    // destructor
+    ~ForStatement(){
+        if(iterator)
+            delete iterator;
+        if(body)
+            delete body;
+    } // iterable is deleted by the Statement destructor
+
+    // prints the loop ex. for(x in [1, 2]) puts(x)
+    std::string toString() override;
+
+    // appends the iterator, the iterable and then the body
+    void children(std::vector<Node*>& out) override;
+
+    // vars
+    // Token token; from node, always FOR
+    Identifier* iterator = nullptr;
+    BlockStatement* body = nullptr;
+};
+
 class HashLiteral: public Expression{
      public:
     // constructor for call Expression
@@ -375,9 +511,19 @@ class HashLiteral: public Expression{
     // to string for printing 
     std::string toString();
 
+    // appends each key followed by its value
+    void children(std::vector<Node*>& out) override;
+
     //vars 
     // token; from node, is '(' 
     std::unordered_map<Expression*, Expression*> pairs;
 };
 
+// names the function literal stmt binds, if it binds one, after the binding so profiles can report it
+void nameFunctionLiteral(LetStatement* stmt);
+
+// returns the name profiles report the function created from literal as, its let binding's or for anonymous
+// functions where it starts, like "fn@3:12" located with lexer if it is given
+std::string functionName(FunctionLiteral* literal, Lexer* lexer = nullptr);
+
 #endif // AST_H
\ No newline at end of file
@@ -0,0 +1,290 @@
+// benchmark driver for the interpreter, run with `make bench` or the cmake bench target, with --counters
+// it also reports hardware performance counters for each measurement where the kernel allows reading them
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <string>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "../flatast.h"
+#include "../lexer.h"
+#include "../parser.h"
+#include "../scan.h"
+
+// minimum time each measurement is repeated for
+static const double MIN_SECONDS = 0.5;
+
+// generates size bytes of monkey source mixing long and short identifiers, numbers, strings and indentation
+static std::string generateSource(size_t size){
+    std::mt19937 random(42);
+    std::string source;
+    source.reserve(size + 256);
+    while(source.size() < size){
+        size_t nameLength = 1 + random() % 24;
+        std::string name = "v";
+        for(size_t i = 1; i < nameLength; i++)
+            name += (char)('a' + random() % 26);
+        source += std::string(4 * (random() % 4), ' ');
+        source += "let " + name + " = fn(x, y) { x * " + std::to_string(random() % 100000) + " + y; };\n";
+        source += std::string(4 * (random() % 4), ' ');
+        source += "puts(\"" + std::string(random() % 64, 's') + "\", " + name + "(1, 2));\n";
+    }
+    return source;
+}
+
+// hardware events PerfCounters counts
+enum Counter { CYCLES, INSTRUCTIONS, BRANCH_MISSES, LLC_MISSES, COUNTERS };
+
+static const char* COUNTER_NAMES[COUNTERS] = {"cycles", "instructions", "branch misses", "LLC misses"};
+
+// counts of each event, or -1 for events which couldn't be counted
+typedef std::array<double, COUNTERS> CounterValues;
+
+// hardware performance counters of the calling thread read through perf_event_open, each event is opened
+// on its own so the ones the CPU or kernel do support are still counted when others aren't
+class PerfCounters {
+    public:
+        // opens the counters, those which can't be opened are left out and the first reason is kept
+        PerfCounters(){
+            fds.fill(-1);
+#ifdef __linux__
+            const uint64_t configs[COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+            for(size_t i = 0; i < COUNTERS; i++){
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = configs[i];
+                attr.disabled = 1;
+                attr.exclude_kernel = 1; // allowed without privileges, the interpreter's time is in user space
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+                if(fds[i] < 0 && error.empty())
+                    error = std::string("perf_event_open failed for ") + COUNTER_NAMES[i] + ": " + std::strerror(errno);
+            }
+#else
+            error = "hardware counters are only read on Linux";
+#endif
+        }
+
+        ~PerfCounters(){
+#ifdef __linux__
+            for(int fd: fds){
+                if(fd >= 0)
+                    close(fd);
+            }
+#endif
+        }
+
+        PerfCounters(const PerfCounters&) = delete;
+        PerfCounters& operator=(const PerfCounters&) = delete;
+
+        // returns if any counter could be opened
+        bool available() const{
+            for(int fd: fds){
+                if(fd >= 0)
+                    return true;
+            }
+            return false;
+        }
+
+        // resets the counters and starts counting
+        void start(){
+#ifdef __linux__
+            for(int fd: fds){
+                if(fd >= 0){
+                    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+                }
+            }
+#endif
+        }
+
+        // stops counting and returns the counts since start, scaled up when the kernel had to share the
+        // hardware counters between events and only counted some of the time
+        CounterValues stop(){
+            CounterValues values;
+            values.fill(-1);
+#ifdef __linux__
+            for(size_t i = 0; i < COUNTERS; i++){
+                if(fds[i] < 0)
+                    continue;
+                ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+                uint64_t read[3]; // value, time enabled, time running
+                if(::read(fds[i], read, sizeof(read)) == (ssize_t)sizeof(read) && read[2] != 0)
+                    values[i] = (double)read[0] * ((double)read[1] / (double)read[2]);
+            }
+#endif
+            return values;
+        }
+
+        std::string error; // why the first counter which couldn't be opened wasn't
+
+    private:
+        std::array<int, COUNTERS> fds;
+};
+
+// counters measure reads, null unless --counters was given
+static PerfCounters* counters = nullptr;
+
+// units per second a measurement processed and the counts of each event per unit, -1 if not counted
+struct Measurement {
+    double rate = 0;
+    CounterValues perUnit;
+};
+
+// repeats run until MIN_SECONDS pass and returns the units per second it processed
+template <typename Run>
+static Measurement measure(size_t units, Run run){
+    size_t repetitions = 0;
+    if(counters != nullptr)
+        counters->start();
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do{
+        run();
+        repetitions++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while(elapsed < MIN_SECONDS);
+    Measurement result;
+    result.perUnit.fill(-1);
+    if(counters != nullptr)
+        result.perUnit = counters->stop();
+    result.rate = (double)(units * repetitions) / elapsed;
+    for(double& value: result.perUnit){
+        if(value >= 0)
+            value /= (double)(units * repetitions);
+    }
+    return result;
+}
+
+// formats the counters of measurement as ratios per unit, empty if nothing was counted
+static std::string formatCounters(const Measurement& measurement, const std::string& unit){
+    const CounterValues& values = measurement.perUnit;
+    std::ostringstream out;
+    out << std::setprecision(3);
+    if(values[CYCLES] > 0 && values[INSTRUCTIONS] >= 0)
+        out << "  IPC " << values[INSTRUCTIONS] / values[CYCLES];
+    if(values[CYCLES] >= 0)
+        out << "  cycles/" << unit << " " << values[CYCLES];
+    if(values[INSTRUCTIONS] >= 0)
+        out << "  instructions/" << unit << " " << values[INSTRUCTIONS];
+    if(values[BRANCH_MISSES] >= 0)
+        out << "  branch misses/" << unit << " " << values[BRANCH_MISSES];
+    if(values[LLC_MISSES] >= 0)
+        out << "  LLC misses/" << unit << " " << values[LLC_MISSES];
+    return out.str();
+}
+
+// keeps the compiler from removing work whose result is otherwise unused
+static volatile size_t sink;
+
+// scans the source using only the run scanners, stepping over one byte whenever no run starts
+static size_t scanOnly(const std::string& padded){
+    const char* p = padded.data();
+    size_t runs = 0;
+    while(*p != '\0'){
+        const char* end = p;
+        if(inClass(*p, CLASS_WHITESPACE))
+            end = scanRuns.whitespace(p);
+        else if(inClass(*p, CLASS_IDENTIFIER))
+            end = scanRuns.identifier(p);
+        else if(inClass(*p, CLASS_DIGIT))
+            end = scanRuns.digits(p);
+        else if(*p == '"')
+            end = scanRuns.stringEnd(p + 1) + 1;
+        p = end == p ? p + 1 : end;
+        runs++;
+    }
+    return runs;
+}
+
+// lexes the source into tokens until the end of the input
+static size_t lexOnly(std::shared_ptr<LexerSource> source){
+    Lexer lexer(source);
+    size_t tokens = 0;
+    while(lexer.nextToken().type != TokenType::ENDOFFILE)
+        tokens++;
+    return tokens;
+}
+
+// sums the token offsets of every node by following the pointers between nodes
+static size_t walkPointers(Node* node){
+    std::vector<Node*> children;
+    node->children(children);
+    size_t sum = node->token.offset;
+    for(Node* child: children)
+        sum += walkPointers(child);
+    return sum;
+}
+
+// sums the token offsets of every node by following child indexes
+static size_t walkFlat(const FlatAst& flat, uint32_t node){
+    size_t sum = flat.offset(node);
+    for(uint32_t child: flat.children(node)){
+        if(child != NO_NODE)
+            sum += walkFlat(flat, child);
+    }
+    return sum;
+}
+
+int main(int argc, char* argv[]){
+    PerfCounters* opened = nullptr;
+    for(int i = 1; i < argc; i++){
+        if(std::string(argv[i]) == "--counters")
+            opened = new PerfCounters();
+        else{
+            std::cerr << "usage: " << argv[0] << " [--counters]\n";
+            return 2;
+        }
+    }
+    if(opened != nullptr && !opened->error.empty())
+        std::cout << "counters: " << opened->error << (opened->available() ? ", reporting the others\n" : ", timing only\n");
+    if(opened != nullptr && opened->available())
+        counters = opened;
+
+    std::string source = generateSource(16 << 20);
+    std::string padded = source + std::string(LexerSource::SOURCE_PADDING, '\0');
+    std::shared_ptr<LexerSource> lexerSource = std::make_shared<StringSource>(source);
+    std::cout << "lexer input: " << source.size() << " bytes\n";
+
+    ScanImplementation best = bestScanImplementation();
+    for(ScanImplementation implementation: {ScanImplementation::SCALAR, ScanImplementation::SSE2, ScanImplementation::AVX2}){
+        if(!useScanImplementation(implementation))
+            continue;
+        Measurement scan = measure(source.size(), [&]{ sink = scanOnly(padded); });
+        Measurement lex = measure(source.size(), [&]{ sink = lexOnly(lexerSource); });
+        std::cout << scanImplementationName(implementation)
+                  << "\tscan " << scan.rate / 1e9 << " GB/s"
+                  << "\tnextToken " << lex.rate / 1e6 << " MB/s\n";
+        if(counters != nullptr)
+            std::cout << "\tscan" << formatCounters(scan, "byte") << "\n\tnextToken" << formatCounters(lex, "byte") << "\n";
+    }
+    useScanImplementation(best);
+
+    Lexer lexer(lexerSource);
+    Parser parser(&lexer);
+    Program* program = parser.parseProgram();
+    FlatAst flat(program);
+    std::cout << "ast: " << flat.size() << " nodes\n";
+    Measurement pointerWalk = measure(flat.size(), [&]{ sink = walkPointers(program); });
+    Measurement flatWalk = measure(flat.size(), [&]{ sink = walkFlat(flat, flat.root()); });
+    std::cout << "pointer walk " << pointerWalk.rate / 1e6 << " Mnodes/s\tflat walk " << flatWalk.rate / 1e6 << " Mnodes/s\n";
+    if(counters != nullptr)
+        std::cout << "\tpointer walk" << formatCounters(pointerWalk, "node") << "\n\tflat walk" << formatCounters(flatWalk, "node") << "\n";
+    delete opened;
+    return 0;
+}
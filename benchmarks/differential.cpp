@@ -0,0 +1,51 @@
+// differential testing driver, run with `make differential` or the cmake differential target. Runs random
+// programs through every engine, stops at the first one they disagree on and otherwise reports how long each
+// engine took relative to the tree walker
+
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../differential.h"
+
+// programs run when no count is given
+static const uint64_t DEFAULT_PROGRAMS = 10000;
+
+int main(int argc, char* argv[]){
+    uint64_t programs = DEFAULT_PROGRAMS, firstSeed = 0;
+    if(argc > 3 || (argc > 1 && std::atoll(argv[1]) <= 0)){
+        std::cerr << "usage: " << argv[0] << " [programs [first seed]]\n";
+        return 2;
+    }
+    if(argc > 1)
+        programs = (uint64_t)std::atoll(argv[1]);
+    if(argc > 2)
+        firstSeed = (uint64_t)std::atoll(argv[2]);
+
+    std::vector<Engine> engines = differentialEngines();
+    std::vector<double> parseSeconds(engines.size()), evalSeconds(engines.size());
+    for(uint64_t seed = firstSeed; seed < firstSeed + programs; seed++){
+        std::string source = generateProgram(seed);
+        DifferentialResult result = runDifferential(source);
+        if(!result.agree){
+            std::cout << "seed " << seed << ": engines disagree\n" << formatDisagreement(source, result);
+            return 1;
+        }
+        for(size_t i = 0; i < engines.size(); i++){
+            parseSeconds[i] += result.runs[i].parseSeconds;
+            evalSeconds[i] += result.runs[i].evalSeconds;
+        }
+    }
+
+    std::cout << programs << " programs from seed " << firstSeed << ", every engine agrees\n"
+              << std::left << std::setw(20) << "engine" << std::setw(14) << "parse ms" << std::setw(14) << "eval ms"
+              << "eval relative\n" << std::fixed;
+    for(size_t i = 0; i < engines.size(); i++){
+        std::cout << std::setw(20) << engines[i].name << std::setprecision(2)
+                  << std::setw(14) << parseSeconds[i] * 1e3 << std::setw(14) << evalSeconds[i] * 1e3
+                  << std::setprecision(3) << evalSeconds[i] / evalSeconds[0] << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,184 @@
+// benchmark regression gate, run with `make regression` or the cmake regression target. Times each Monkey
+// workload several times and compares the medians against a baseline recorded with --record, exiting with
+// 1 and a report of the workloads which got slower by more than the threshold or are missing from the baseline
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../environment.h"
+#include "../evaluator.h"
+#include "../heap.h"
+#include "../lexer.h"
+#include "../parser.h"
+#include "../regression.h"
+
+// where the baseline is read from and recorded to unless --baseline is given
+static const char* DEFAULT_BASELINE = "benchmarks/baseline.json";
+
+// how much slower a workload's median may be before it counts as a regression, as a fraction
+static const double DEFAULT_THRESHOLD = 0.10;
+
+// timed runs of each workload, after one untimed warm up run
+static const size_t DEFAULT_RUNS = 11;
+
+// a Monkey program whose evaluation is timed
+struct Workload {
+    const char* name;
+    const char* source;
+};
+
+// the workload suite, each exercising a different part of the evaluator for tens of milliseconds
+static const Workload WORKLOADS[] = {
+    {"recursion", "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; fib(22)"},
+    {"loops", "let i = 0; let sum = 0; while (i < 200000) { sum = sum + i * 2 - i / 3; i = i + 1 } sum"},
+    {"closures", "let adder = fn(x) { fn(y) { x + y } }; let i = 0; let sum = 0;"
+                 "while (i < 50000) { sum = adder(i)(sum) - i; i = i + 1 } sum"},
+    {"arrays", "let build = fn(n) { let a = []; let i = 0; while (i < n) { a = push(a, i); i = i + 1 } a };"
+               "let a = build(4000);"
+               "reduce(filter(map(a, fn(x) { x * 3 }), fn(x) { x / 2 * 2 == x }), 0, fn(s, x) { s + x })"},
+    {"sort", "let a = []; let i = 0; while (i < 3000) { a = push(a, (i * 7919) / 13 - i * 611); i = i + 1 }"
+             "len(sort(a, fn(x, y) { x > y })) + len(sort(a))"},
+    {"strings", "let s = \"\"; let i = 0; while (i < 8000) { s = s + \"ab\" + \"c\"; if (s == \"abc\") { i = i + 1 } i = i + 1 }"
+                "len(s)"},
+    {"hashes", "let h = {\"a\": 1, \"b\": 2, \"c\": 3}; let i = 0; let sum = 0;"
+               "while (i < 60000) { sum = sum + h[\"a\"] + h[\"c\"]; let g = {\"x\": i}; sum = sum + g[\"x\"] - i; i = i + 1 } sum"},
+};
+
+// evaluates program once in a fresh environment and heap
+// EFFECTS:  returns the milliseconds it took and sets error if it evaluated to an error
+static double timeRun(Program* program, std::string& error){
+    collectGarbage(true); // so no run pays for collecting the garbage of the ones before it
+    Environment env;
+    auto start = std::chrono::steady_clock::now();
+    Value result = Eval(program, &env);
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if(result.inspect().rfind("ERROR", 0) == 0)
+        error = result.inspect();
+    return milliseconds;
+}
+
+// runs every workload once untimed and then runs times timed, taking turns so a stretch of time the
+// machine is slower for is spread over every workload rather than failing one
+// EFFECTS:  returns the empty results and sets error if a workload doesn't parse or evaluates to an error
+static std::vector<Result> measure(size_t runs, std::string& error){
+    std::vector<std::unique_ptr<Program>> programs;
+    for(const Workload& workload: WORKLOADS){
+        Lexer lexer(workload.source);
+        Parser parser(&lexer);
+        programs.emplace_back(parser.parseProgram());
+        if(!parser.errors.empty()){
+            error = std::string(workload.name) + ": " + parser.errors[0];
+            return {};
+        }
+    }
+    std::vector<std::vector<double>> samples(programs.size());
+    for(size_t run = 0; run <= runs; run++){
+        for(size_t i = 0; i < programs.size(); i++){
+            double milliseconds = timeRun(programs[i].get(), error);
+            if(!error.empty()){
+                error = std::string(WORKLOADS[i].name) + ": " + error;
+                return {};
+            }
+            if(run > 0)
+                samples[i].push_back(milliseconds);
+        }
+    }
+    std::vector<Result> results;
+    for(size_t i = 0; i < programs.size(); i++)
+        results.push_back({WORKLOADS[i].name, summarize(samples[i])});
+    return results;
+}
+
+// prints a line of the report comparing current to baseline
+// EFFECTS:  returns whether current fails the gate, by regressing beyond threshold or not being in the baseline
+static bool compare(const Result& current, const Result* baseline, double threshold){
+    const Statistics& now = current.statistics;
+    std::cout << std::left << std::setw(12) << current.name << std::right << std::fixed << std::setprecision(2);
+    if(baseline == nullptr){
+        std::cout << std::setw(23) << "not in baseline" << std::setw(12) << now.median << " ±" << std::setw(6) << now.deviation << "  MISSING\n";
+        return true;
+    }
+    const Statistics& before = baseline->statistics;
+    double change = (now.median - before.median) / before.median;
+    bool regressed = isRegression(now, before, threshold);
+    std::cout << std::setw(15) << before.median << " ±" << std::setw(6) << before.deviation
+              << std::setw(12) << now.median << " ±" << std::setw(6) << now.deviation
+              << std::showpos << std::setw(10) << change * 100 << "%" << std::noshowpos
+              << (regressed ? "  REGRESSED" : change > threshold ? "  within noise" : "") << "\n";
+    return regressed;
+}
+
+int main(int argc, char* argv[]){
+    std::string baselinePath = DEFAULT_BASELINE;
+    double threshold = DEFAULT_THRESHOLD;
+    size_t runs = DEFAULT_RUNS;
+    bool record = false;
+    for(int i = 1; i < argc; i++){
+        std::string argument = argv[i];
+        if(argument == "--record")
+            record = true;
+        else if(argument == "--baseline" && i + 1 < argc)
+            baselinePath = argv[++i];
+        else if(argument == "--threshold" && i + 1 < argc && std::atof(argv[i + 1]) > 0)
+            threshold = std::atof(argv[++i]) / 100;
+        else if(argument == "--runs" && i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+            runs = (size_t)std::atoi(argv[++i]);
+        else{
+            std::cerr << "usage: " << argv[0] << " [--record] [--baseline path] [--threshold percent] [--runs n]\n";
+            return 2;
+        }
+    }
+
+    std::vector<Result> baseline;
+    if(!record && !readBaseline(baselinePath, baseline)){
+        std::cerr << "can't read any workloads from baseline " << baselinePath << ", record one with --record\n";
+        return 2;
+    }
+
+    std::string error;
+    std::vector<Result> results = measure(runs, error);
+    if(!error.empty()){
+        std::cerr << "workload " << error << "\n";
+        return 2;
+    }
+
+    if(record){
+        std::ofstream file(baselinePath);
+        file << baselineJson(results);
+        if(!file){
+            std::cerr << "can't write baseline " << baselinePath << "\n";
+            return 2;
+        }
+        std::cout << "recorded " << results.size() << " workloads, " << runs << " runs each, to " << baselinePath << "\n";
+        return 0;
+    }
+
+    std::cout << runs << " runs per workload, failing on regressions over " << threshold * 100 << "%\n"
+              << std::left << std::setw(12) << "workload" << std::right << std::setw(23) << "baseline ms"
+              << std::setw(20) << "current ms" << std::setw(11) << "change\n";
+    std::vector<std::string> failures;
+    for(const Result& result: results){
+        const Result* before = nullptr;
+        for(const Result& recorded: baseline){
+            if(recorded.name == result.name)
+                before = &recorded;
+        }
+        if(compare(result, before, threshold))
+            failures.push_back(result.name);
+    }
+    if(failures.empty()){
+        std::cout << "no regressions\n";
+        return 0;
+    }
+    std::cout << failures.size() << " workload" << (failures.size() == 1 ? "" : "s")
+              << " regressed or missing from the baseline, record a new one with --record if they were added:";
+    for(const std::string& name: failures)
+        std::cout << " " << name;
+    std::cout << "\n";
+    return 1;
+}
@@ -0,0 +1,576 @@
+// definitions for differential.h
+
+#include "differential.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include "evaluator.h"
+#include "flatast.h"
+#include "flateval.h"
+#include "heap.h"
+#include "incremental.h"
+#include "parallelparser.h"
+
+// largest magnitude an integer a generated program computes may reach, well inside an int so
+// no engine overflows
+static const int64_t MAX_BOUND = 1 << 20;
+
+// largest magnitude of an argument to a generated function, and of its parameter in its body
+static const int64_t PARAMETER_BOUND = 1000;
+
+// deepest a recursive generated function is called
+static const int64_t RECURSION_DEPTH = 12;
+
+// longest string and array a generated program builds
+static const int64_t MAX_LENGTH = 64;
+
+// the keys of every hash a generated program builds, so indexing one never misses
+static const char* HASH_KEYS[] = {"a", "b", "c"};
+
+// writes random programs, tracking a bound on the magnitude of every integer and the length of every
+// string and array so what it writes can't overflow or grow without limit
+class ProgramGenerator {
+    public:
+        ProgramGenerator(uint64_t seed): random(seed){}
+
+        // returns a program of top level statements ending with an array of every variable it defined
+        std::string program();
+
+    private:
+        enum Type { INT, BOOL, STRING, ARRAY, HASH, TYPES };
+
+        // an expression and bounds on its value, for integers its magnitude, for arrays and hashes
+        // the magnitude of their elements, and for strings and arrays their length
+        struct Expression {
+            std::string text;
+            int64_t bound = 0;
+            int64_t length = 0;
+        };
+
+        // a variable in scope, with the bounds of the expression it was bound to
+        struct Variable {
+            std::string name;
+            Type type;
+            int64_t bound;
+            int64_t length;
+        };
+
+        // a function of one integer returning an integer
+        struct Function {
+            std::string name;
+            int64_t bound; // of its result
+            bool recursive; // only called with arguments up to RECURSION_DEPTH
+        };
+
+        // helper which returns a random number in [0, n)
+        int64_t pick(int64_t n){ return (int64_t)(random() % (uint64_t)n); }
+
+        // helper which returns true percent percent of the time
+        bool chance(int64_t percent){ return pick(100) < percent; }
+
+        // helper which returns a name no other variable has, identifiers can't contain digits
+        std::string fresh(){
+            std::string name = "v";
+            for(size_t n = names++; ; n = n / 26 - 1){
+                name += (char)('a' + n % 26);
+                if(n < 26)
+                    break;
+            }
+            return name;
+        }
+
+        // helper which sets found to a random variable of type in scope whose bound is at most limit
+        // EFFECTS:  returns false if there is none
+        bool variable(Type type, int64_t limit, Variable& found){
+            std::vector<size_t> candidates;
+            for(size_t i = 0; i < scope.size(); i++){
+                if(scope[i].type == type && scope[i].bound <= limit)
+                    candidates.push_back(i);
+            }
+            if(candidates.empty())
+                return false;
+            found = scope[candidates[(size_t)pick((int64_t)candidates.size())]];
+            return true;
+        }
+
+        Expression expression(Type type, int depth, int64_t limit);
+        Expression integer(int depth, int64_t limit);
+        Expression boolean(int depth);
+        Expression string(int depth);
+        Expression array(int depth, int64_t limit);
+        Expression hash(int depth, int64_t limit);
+        Expression closure(const std::string& parameter, int64_t parameterBound, Type result, int64_t limit);
+        std::string function();
+        std::string loop();
+
+        std::mt19937_64 random;
+        size_t names = 0;
+        std::vector<Variable> scope;
+        std::vector<Function> functions;
+};
+
+// returns an expression of type whose bound is at most limit
+ProgramGenerator::Expression ProgramGenerator::expression(Type type, int depth, int64_t limit){
+    switch(type){
+        case INT: return integer(depth, limit);
+        case BOOL: return boolean(depth);
+        case STRING: return string(depth);
+        case ARRAY: return array(depth, limit);
+        default: return hash(depth, limit);
+    }
+}
+
+// returns an integer expression whose magnitude is at most limit
+ProgramGenerator::Expression ProgramGenerator::integer(int depth, int64_t limit){
+    Expression result;
+    int64_t literal = pick(std::min<int64_t>(limit, 99) + 1);
+    result.text = std::to_string(literal);
+    result.bound = literal;
+    if(depth <= 0 || chance(20))
+        return result;
+
+    switch(pick(10)){
+        case 0: {
+            Variable v;
+            if(variable(INT, limit, v)){
+                result.text = v.name;
+                result.bound = v.bound;
+            }
+            break;
+        }
+        case 1: {
+            Expression left = integer(depth - 1, limit / 2), right = integer(depth - 1, limit / 2);
+            result.text = "(" + left.text + (chance(50) ? " + " : " - ") + right.text + ")";
+            result.bound = left.bound + right.bound;
+            break;
+        }
+        case 2: {
+            int64_t factor = 1 + pick(9);
+            Expression left = integer(depth - 1, limit / factor);
+            bool divide = chance(30);
+            result.text = "(" + left.text + (divide ? " / " : " * ") + std::to_string(factor) + ")";
+            result.bound = divide ? left.bound : left.bound * factor;
+            break;
+        }
+        case 3: {
+            Expression operand = integer(depth - 1, limit);
+            result.text = "(-" + operand.text + ")";
+            result.bound = operand.bound;
+            break;
+        }
+        case 4: {
+            Expression operand = chance(50) ? string(depth - 1) : array(depth - 1, MAX_BOUND);
+            if(operand.length <= limit){
+                result.text = "len(" + operand.text + ")";
+                result.bound = operand.length;
+            }
+            break;
+        }
+        case 5: {
+            Variable v;
+            if(variable(ARRAY, limit, v)){
+                // indexing past the end gives null, which would turn the rest of the program into errors
+                std::string index = std::to_string(pick(4));
+                Expression otherwise = integer(depth - 1, limit);
+                result.text = "if (len(" + v.name + ") > " + index + ") { " + v.name + "[" + index + "] } else { " +
+                    otherwise.text + " }";
+                result.bound = std::max(v.bound, otherwise.bound);
+            }
+            break;
+        }
+        case 6: {
+            Variable v;
+            if(variable(HASH, limit, v)){
+                result.text = v.name + "[\"" + HASH_KEYS[pick(3)] + "\"]";
+                result.bound = v.bound;
+            }
+            break;
+        }
+        case 7: {
+            std::vector<Function> callable;
+            for(const Function& f: functions){
+                if(f.bound <= limit)
+                    callable.push_back(f);
+            }
+            if(callable.empty())
+                break;
+            Function f = callable[(size_t)pick((int64_t)callable.size())];
+            Expression argument;
+            if(f.recursive)
+                argument.text = std::to_string(pick(RECURSION_DEPTH + 1));
+            else
+                argument = integer(depth - 1, PARAMETER_BOUND);
+            result.text = f.name + "(" + argument.text + ")";
+            result.bound = f.bound;
+            break;
+        }
+        case 8: {
+            Expression condition = boolean(depth - 1);
+            Expression consequence = integer(depth - 1, limit), alternative = integer(depth - 1, limit);
+            result.text = "if (" + condition.text + ") { " + consequence.text + " } else { " + alternative.text + " }";
+            result.bound = std::max(consequence.bound, alternative.bound);
+            break;
+        }
+        default: {
+            Variable v;
+            if(!variable(ARRAY, MAX_BOUND, v) || v.bound * v.length > limit)
+                break;
+            std::string accumulator = fresh(), element = fresh();
+            result.text = "reduce(" + v.name + ", 0, fn(" + accumulator + ", " + element + ") { " + accumulator +
+                " + " + element + " })";
+            result.bound = v.bound * v.length;
+            break;
+        }
+    }
+    return result;
+}
+
+// returns a boolean expression
+ProgramGenerator::Expression ProgramGenerator::boolean(int depth){
+    Expression result;
+    result.text = chance(50) ? "true" : "false";
+    if(depth <= 0 || chance(20))
+        return result;
+    static const char* comparisons[] = {" < ", " > ", " == ", " != "};
+    switch(pick(4)){
+        case 0:
+        case 1: {
+            Expression left = integer(depth - 1, MAX_BOUND), right = integer(depth - 1, MAX_BOUND);
+            result.text = "(" + left.text + comparisons[pick(4)] + right.text + ")";
+            break;
+        }
+        case 2: {
+            Expression left = string(depth - 1), right = string(depth - 1);
+            result.text = "(" + left.text + (chance(50) ? " == " : " != ") + right.text + ")";
+            break;
+        }
+        default: {
+            Expression operand = boolean(depth - 1);
+            result.text = "(!" + operand.text + ")";
+            break;
+        }
+    }
+    return result;
+}
+
+// returns a string expression
+ProgramGenerator::Expression ProgramGenerator::string(int depth){
+    Expression result;
+    int64_t length = pick(6);
+    std::string contents;
+    for(int64_t i = 0; i < length; i++)
+        contents += (char)('a' + pick(3)); // few letters so comparisons are sometimes equal
+    result.text = "\"" + contents + "\"";
+    result.length = length;
+    if(depth <= 0 || chance(25))
+        return result;
+    switch(pick(3)){
+        case 0: {
+            Variable v;
+            if(variable(STRING, 0, v)){
+                result.text = v.name;
+                result.length = v.length;
+            }
+            break;
+        }
+        case 1: {
+            Expression left = string(depth - 1), right = string(depth - 1);
+            if(left.length + right.length <= MAX_LENGTH){
+                result.text = "(" + left.text + " + " + right.text + ")";
+                result.length = left.length + right.length;
+            }
+            break;
+        }
+        default: {
+            Expression condition = boolean(depth - 1);
+            Expression consequence = string(depth - 1), alternative = string(depth - 1);
+            result.text = "if (" + condition.text + ") { " + consequence.text + " } else { " + alternative.text + " }";
+            result.length = std::max(consequence.length, alternative.length);
+            break;
+        }
+    }
+    return result;
+}
+
+// returns an array of integers whose elements' magnitudes are at most limit
+ProgramGenerator::Expression ProgramGenerator::array(int depth, int64_t limit){
+    Expression result;
+    if(depth > 0 && !chance(25)){
+        switch(pick(5)){
+            case 0: {
+                Variable v;
+                if(variable(ARRAY, limit, v)){
+                    result.text = v.name;
+                    result.bound = v.bound;
+                    result.length = v.length;
+                    return result;
+                }
+                break;
+            }
+            case 1: {
+                Expression operand = array(depth - 1, limit), element = integer(depth - 1, limit);
+                if(operand.length < MAX_LENGTH){
+                    result.text = "push(" + operand.text + ", " + element.text + ")";
+                    result.bound = std::max(operand.bound, element.bound);
+                    result.length = operand.length + 1;
+                    return result;
+                }
+                break;
+            }
+            case 2: {
+                Expression operand = array(depth - 1, MAX_BOUND);
+                Expression callback = closure(fresh(), operand.bound, INT, limit);
+                result.text = std::string(chance(20) ? "pmap(" : "map(") + operand.text + ", " + callback.text + ")";
+                result.bound = callback.bound;
+                result.length = operand.length;
+                return result;
+            }
+            case 3: {
+                Expression operand = array(depth - 1, limit);
+                Expression callback = closure(fresh(), operand.bound, BOOL, 0);
+                result.text = std::string(chance(20) ? "pfilter(" : "filter(") + operand.text + ", " + callback.text + ")";
+                result.bound = operand.bound;
+                result.length = operand.length;
+                return result;
+            }
+            default: {
+                Expression operand = array(depth - 1, limit);
+                std::string comparator;
+                if(chance(50)){
+                    std::string a = fresh(), b = fresh();
+                    comparator = ", fn(" + a + ", " + b + ") { " + a + " > " + b + " }";
+                }
+                result.text = "sort(" + operand.text + comparator + ")";
+                result.bound = operand.bound;
+                result.length = operand.length;
+                return result;
+            }
+        }
+    }
+    int64_t length = pick(5);
+    result.text = "[";
+    for(int64_t i = 0; i < length; i++){
+        Expression element = integer(depth - 1, limit);
+        result.text += (i == 0 ? "" : ", ") + element.text;
+        result.bound = std::max(result.bound, element.bound);
+    }
+    result.text += "]";
+    result.length = length;
+    return result;
+}
+
+// returns a hash from each of HASH_KEYS to an integer whose magnitude is at most limit
+ProgramGenerator::Expression ProgramGenerator::hash(int depth, int64_t limit){
+    Expression result;
+    Variable v;
+    if(chance(30) && variable(HASH, limit, v)){
+        result.text = v.name;
+        result.bound = v.bound;
+        return result;
+    }
+    result.text = "{";
+    for(size_t i = 0; i < 3; i++){
+        Expression value = integer(depth - 1, limit);
+        result.text += std::string(i == 0 ? "" : ", ") + "\"" + HASH_KEYS[i] + "\": " + value.text;
+        result.bound = std::max(result.bound, value.bound);
+    }
+    result.text += "}";
+    return result;
+}
+
+// returns a function literal of one integer parameter returning type, whose body may bind a local
+ProgramGenerator::Expression ProgramGenerator::closure(const std::string& parameter, int64_t parameterBound, Type result,
+    int64_t limit){
+    size_t scopeSize = scope.size();
+    scope.push_back({parameter, INT, parameterBound, 0});
+    std::string body;
+    if(chance(30)){
+        Expression local = integer(2, MAX_BOUND);
+        Variable bound = {fresh(), INT, local.bound, 0};
+        body = "let " + bound.name + " = " + local.text + "; ";
+        scope.push_back(bound);
+    }
+    Expression value = expression(result, 2, limit);
+    scope.resize(scopeSize);
+    value.text = "fn(" + parameter + ") { " + body + value.text + " }";
+    return value;
+}
+
+// returns a top level statement binding a new function, recursive or not
+std::string ProgramGenerator::function(){
+    std::string name = fresh(), parameter = fresh();
+    if(chance(35)){
+        // counts down from an argument of at most RECURSION_DEPTH
+        size_t scopeSize = scope.size();
+        scope.push_back({parameter, INT, RECURSION_DEPTH, 0});
+        Expression base = integer(2, MAX_BOUND / (4 * RECURSION_DEPTH));
+        Expression step = integer(2, MAX_BOUND / (4 * RECURSION_DEPTH));
+        scope.resize(scopeSize);
+        functions.push_back({name, base.bound + RECURSION_DEPTH * step.bound, true});
+        return "let " + name + " = fn(" + parameter + ") { if (" + parameter + " < 1) { " + base.text + " } else { " +
+            step.text + " + " + name + "(" + parameter + " - 1) } };";
+    }
+    Expression literal = closure(parameter, PARAMETER_BOUND, INT, MAX_BOUND / 4);
+    functions.push_back({name, literal.bound, false});
+    return "let " + name + " = " + literal.text + ";";
+}
+
+// returns a top level loop which adds up a new accumulator, either counting or over an array
+std::string ProgramGenerator::loop(){
+    Variable accumulator = {fresh(), INT, 0, 0};
+    std::string counter = fresh();
+    Variable over;
+    bool overArray = chance(50) && variable(ARRAY, MAX_BOUND, over);
+    int64_t iterations = overArray ? over.length : 1 + pick(20);
+    size_t scopeSize = scope.size();
+    scope.push_back({counter, INT, overArray ? over.bound : iterations, 0});
+    Expression step = integer(2, MAX_BOUND / (iterations + 1));
+    scope.resize(scopeSize);
+    accumulator.bound = step.bound * iterations;
+    std::string update = accumulator.name + " = " + accumulator.name + " + " + step.text;
+    scope.push_back(accumulator);
+    if(overArray)
+        return "let " + accumulator.name + " = 0;\nfor (" + counter + " in " + over.name + ") { " + update + " }\n";
+    return "let " + accumulator.name + " = 0;\nlet " + counter + " = 0;\nwhile (" + counter + " < " +
+        std::to_string(iterations) + ") { " + update + "; " + counter + " = " + counter + " + 1 }\n";
+}
+
+// returns a program of top level statements ending with an array of every variable it defined
+std::string ProgramGenerator::program(){
+    std::string text;
+    int64_t statements = 4 + pick(12);
+    for(int64_t i = 0; i < statements; i++){
+        int64_t kind = pick(10);
+        if(kind < 2){
+            text += function() + "\n";
+            continue;
+        }
+        if(kind == 2){
+            text += loop();
+            continue;
+        }
+        Type type = (Type)pick(TYPES);
+        Expression value = expression(type, 3, MAX_BOUND);
+        Variable v = {fresh(), type, value.bound, value.length};
+        text += "let " + v.name + " = " + value.text + ";\n";
+        scope.push_back(v);
+    }
+    text += "[";
+    for(size_t i = 0; i < scope.size(); i++){
+        text += (i == 0 ? "" : ", ");
+        if(scope[i].type != HASH){
+            text += scope[i].name;
+            continue;
+        }
+        // the order a hash is inspected in depends on the order its literal's pairs were evaluated in,
+        // which the language leaves unspecified, so hashes are shown by their values
+        text += "[";
+        for(size_t k = 0; k < 3; k++)
+            text += std::string(k == 0 ? "" : ", ") + scope[i].name + "[\"" + HASH_KEYS[k] + "\"]";
+        text += "]";
+    }
+    return text + "]\n";
+}
+
+// generates a random program from seed
+std::string generateProgram(uint64_t seed){
+    return ProgramGenerator(seed).program();
+}
+
+// returns the engines, the reference first
+std::vector<Engine> differentialEngines(){
+    return {
+        {"tree walker", ParsePath::SERIAL, false, true},
+        {"quickened", ParsePath::SERIAL, true, true},
+        {"flat ast", ParsePath::FLAT, true, true},
+        {"flat eval", ParsePath::FLAT_EVAL, true, true},
+        {"parallel parse", ParsePath::PARALLEL, true, true},
+        {"incremental parse", ParsePath::INCREMENTAL, true, true},
+        {"no collection", ParsePath::SERIAL, true, false},
+    };
+}
+
+// statement the incremental engine parses in front of the program and then edits away
+static const std::string INCREMENTAL_PREFIX = "let removed = 0;\n";
+
+// bytes of the chunks the parallel engine splits programs into, small so generated programs are split
+static const size_t DIFFERENTIAL_CHUNK = 64;
+
+// helper which returns the seconds since start
+static double secondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// runs source with engine
+EngineRun runEngine(const Engine& engine, const std::string& source){
+    EngineRun run;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> errors;
+    std::unique_ptr<Program> owned;
+    std::unique_ptr<IncrementalParser> incremental; // owns its program
+    std::unique_ptr<FlatAst> flat; // evaluated instead of program if set
+    Program* program = nullptr;
+    if(engine.parse == ParsePath::SERIAL || engine.parse == ParsePath::FLAT || engine.parse == ParsePath::FLAT_EVAL){
+        Lexer lexer(source);
+        Parser parser(&lexer);
+        owned.reset(parser.parseProgram());
+        errors = parser.errors;
+        if(engine.parse == ParsePath::FLAT)
+            owned.reset(FlatAst(owned.get()).toProgram());
+        else if(engine.parse == ParsePath::FLAT_EVAL)
+            flat = std::make_unique<FlatAst>(owned.get());
+        program = owned.get();
+    }
+    else if(engine.parse == ParsePath::PARALLEL){
+        static ThreadPool pool(3); // its own so chunks are parsed concurrently however many cores there are
+        owned.reset(parseProgramParallel(std::make_shared<StringSource>(source), errors, pool, DIFFERENTIAL_CHUNK));
+        program = owned.get();
+    }
+    else{
+        incremental = std::make_unique<IncrementalParser>(INCREMENTAL_PREFIX + source);
+        incremental->edit(0, INCREMENTAL_PREFIX.size(), "");
+        errors = incremental->getErrors();
+        program = incremental->getProgram();
+    }
+    run.parseSeconds = secondsSince(start);
+    if(!errors.empty()){
+        for(std::string& error: errors)
+            run.output += error + "\n";
+        return run;
+    }
+
+    bool quickening = quickeningEnabled, collection = collectionEnabled;
+    quickeningEnabled = engine.quickening;
+    collectionEnabled = engine.collection;
+    start = std::chrono::steady_clock::now();
+    {
+        Environment env;
+        run.output = (flat ? evalFlat(*flat, &env) : Eval(program, &env)).inspect();
+    }
+    run.evalSeconds = secondsSince(start);
+    quickeningEnabled = quickening;
+    collectionEnabled = collection;
+    return run;
+}
+
+// runs source with every engine and compares their outputs
+DifferentialResult runDifferential(const std::string& source){
+    DifferentialResult result;
+    for(const Engine& engine: differentialEngines()){
+        result.runs.push_back(runEngine(engine, source));
+        result.agree = result.agree && result.runs.back().output == result.runs.front().output;
+    }
+    return result;
+}
+
+// formats which engines disagreed with the reference on source and what each of them produced
+std::string formatDisagreement(const std::string& source, const DifferentialResult& result){
+    std::vector<Engine> engines = differentialEngines();
+    std::string report = "program:\n" + source + engines[0].name + ":\n" + result.runs[0].output + "\n";
+    for(size_t i = 1; i < result.runs.size(); i++){
+        if(result.runs[i].output != result.runs[0].output)
+            report += engines[i].name + " disagrees:\n" + result.runs[i].output + "\n";
+    }
+    return report;
+}
@@ -0,0 +1,62 @@
+// differential testing which runs programs through every way the interpreter can parse and evaluate them
+
+#ifndef DIFFERENTIAL_H
+#define DIFFERENTIAL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Every engine must turn a program into the same result, the tree walker with no specializations being
+// the reference. Programs come from a generator which only writes programs which terminate and keep
+// their integers far from overflowing, using integers, booleans, strings, arrays, hashes, closures,
+// the builtins which take callbacks and recursion, so any difference is a bug in an engine.
+
+// generates a random program from seed, the same seed always giving the same program
+std::string generateProgram(uint64_t seed);
+
+// how an engine parses a program
+enum class ParsePath {
+    SERIAL, // Parser::parseProgram
+    FLAT, // the serial parse rebuilt from its FlatAst
+    FLAT_EVAL, // the serial parse's FlatAst, evaluated by evalFlat without rebuilding it
+    PARALLEL, // parseProgramParallel in small chunks on a pool of its own
+    INCREMENTAL, // an IncrementalParser given the program after a statement in front of it is edited away
+};
+
+// one way of running a program
+struct Engine {
+    std::string name;
+    ParsePath parse;
+    bool quickening; // whether infix and index expressions specialize themselves
+    bool collection; // whether safe points collect garbage
+};
+
+// returns the engines, the reference first
+std::vector<Engine> differentialEngines();
+
+// what running a program with one engine produced
+struct EngineRun {
+    std::string output; // the parse errors one per line, or the inspected result
+    double parseSeconds = 0;
+    double evalSeconds = 0;
+};
+
+// runs source with engine
+// REQUIRES: no other thread is evaluating, as the engine's settings are global
+EngineRun runEngine(const Engine& engine, const std::string& source);
+
+// the runs of every engine on one program
+struct DifferentialResult {
+    std::vector<EngineRun> runs; // in the order of differentialEngines
+    bool agree = true; // whether every output is the reference's
+};
+
+// runs source with every engine and compares their outputs
+// REQUIRES: the same as runEngine
+DifferentialResult runDifferential(const std::string& source);
+
+// formats which engines disagreed with the reference on source and what each of them produced
+std::string formatDisagreement(const std::string& source, const DifferentialResult& result);
+
+#endif // DIFFERENTIAL_H
@@ -1,11 +1,11 @@
 #include "environment.h"
 
-// gets the value from map returns nullptr if it doesn't exist
-Object* Environment::get(std::string& name){
+// gets the value from map returns no value if it doesn't exist
+Value Environment::get(const std::string& name){
     auto index = store.find(name);
     if(index == store.end()){
         if(outer == nullptr)
-            return nullptr;
+            return Value();
         return outer->get(name);
     }
     else
@@ -13,7 +13,23 @@ Object* Environment::get(std::string& name){
 }
 
 // sets the value in the map and returns the value as well
-Object* Environment::set(std::string& name, Object* value){
+Value Environment::set(const std::string& name, Value value){
     store[name] = value;
+    writeBarrier(this, value);
     return value;
+}
+
+// replaces the value of name in the innermost environment it is bound in
+bool Environment::assign(const std::string& name, Value value){
+    Environment* scope = this;
+    while(scope != nullptr){
+        auto index = scope->store.find(name);
+        if(index != scope->store.end()){
+            index->second = value;
+            writeBarrier(scope, value);
+            return true;
+        }
+        scope = scope->outer;
+    }
+    return false;
 }
\ No newline at end of file
@@ -3,40 +3,60 @@
 #define ENVIRONMENT_H
 
 #include <unordered_map>
+#include "heap.h"
 #include "object.h"
 
 class Environment {
     public:
         //constructor for base level enviroment, is the outer most environment
+        // EFFECTS:  the environment is a root of the heap for as long as it lives
         Environment(){
             outer = nullptr;
-            store = std::unordered_map<std::string, Object*>();
+            store = std::unordered_map<std::string, Value>();
+            addRootEnvironment(this);
         }
 
-        // destructor
+        // destructor, enclosed environments are only destroyed by the collector
         ~Environment(){
-            if(outer)
-                delete outer;
+            if(!managed)
+                removeRootEnvironment(this);
         }
-        
+
         // constructor for inner enclosed enviroment which specifies an environment pointer
         // to the outer environment
+        // REQUIRES: the environment is allocated with new, it belongs to the heap which frees it once
+        //           it can't be reached
         Environment(Environment* outer){
             this->outer = outer;
-            store = std::unordered_map<std::string, Object*>();
+            store = std::unordered_map<std::string, Value>();
+            managed = true;
+            registerEnvironment(this);
         }
 
-        // gets the value from map returns nullptr if it doesn't exist
-        Object* get(std::string& name);
+        Environment(const Environment&) = delete;
+        Environment& operator=(const Environment&) = delete;
+
+        // gets the value from map returns no value if it doesn't exist
+        Value get(const std::string& name);
 
         // sets the value in the map and returns the value as well
-        Object* set(std::string& name, Object* value);
+        Value set(const std::string& name, Value value);
+
+        // replaces the value of name in the innermost environment it is bound in
+        // EFFECTS: returns false if name isn't bound anywhere
+        bool assign(const std::string& name, Value value);
 
 
-    //vars
+    //vars, for the collector
+        bool managed = false; // an enclosed environment owned by the heap
+        bool remembered = false; // in a remembered list as it may hold nursery values
+        bool marked = false; // reached by the current major collection
+
     private:
+        friend class Tracer;
+
         Environment* outer;
-        std::unordered_map<std::string, Object*> store;
+        std::unordered_map<std::string, Value> store;
 };
 
 
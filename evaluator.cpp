@@ -2,6 +2,14 @@
 #include "parser.h"
 #include "object.h"
 #include "evaluator.h"
+#include "flateval.h"
+#include "threadpool.h"
+#include "allocationprofile.h"
+#include "nodeprofile.h"
+#include "sampleprofiler.h"
+#include "tracing.h"
+#include <algorithm>
+#include <memory>
 #include <typeinfo>
 #include <iostream>
 
@@ -11,10 +19,24 @@ std::unordered_map<std::string, Builtin*>builtins = {
     {"last", new Builtin(&last)},
     {"rest", new Builtin(&rest)},
     {"push", new Builtin(&push)},
-    {"puts", new Builtin(&puts)}
+    {"puts", new Builtin(&puts, false)},
+    {"map", new Builtin(&map)},
+    {"filter", new Builtin(&filter)},
+    {"reduce", new Builtin(&reduce)},
+    {"pmap", new Builtin(&pmap)},
+    {"pfilter", new Builtin(&pfilter)},
+    {"sort", new Builtin(&sort)},
 };
 
-Object* Eval(Node* node, Environment* env){
+// helper which checks if value is an object of class T, only for classes which are never unboxed
+template<class T>
+static bool holds(Value value){
+    return value.isObject() && typeid(*value.asObject()) == typeid(T);
+}
+
+Value Eval(Node* node, Environment* env){
+    AllocationSite site(node); // what the node allocates itself is counted against it, not its children
+    NodeTimer timer(node);
     const std::type_info& node_type = typeid(*node);
     // if-else switch statement
     
@@ -30,8 +52,7 @@ Object* Eval(Node* node, Environment* env){
     //expressions
     else if(node_type == typeid(IntegerLiteral)){
         IntegerLiteral* intLit = dynamic_cast<IntegerLiteral*>(node);
-        Integer* int_obj = new Integer(intLit->value);
-        return int_obj;
+        return Value::integer(intLit->value);
     }
     else if(node_type == typeid(Boolean)){
         Boolean* boolLiteral = dynamic_cast<Boolean*>(node);
@@ -39,22 +60,33 @@ Object* Eval(Node* node, Environment* env){
     }
     else if(node_type == typeid(PrefixExpression)){
         PrefixExpression* prefixExp = dynamic_cast<PrefixExpression*>(node);
-        Object* right = Eval(prefixExp->right, env);
+        Value right = Eval(prefixExp->right, env);
         if(isError(right))
             return right;
-        return evalPrefixExpression(prefixExp->op, right);
+        return locateError(evalPrefixExpression(prefixExp->op, right), prefixExp);
     }
     else if(node_type == typeid(InfixExpression)){
         InfixExpression* infixExp = dynamic_cast<InfixExpression*>(node);
-        Object* left = Eval(infixExp->left, env);
+        Value left = Eval(infixExp->left, env);
         if(isError(left))
             return left;
 
-        Object* right = Eval(infixExp->right, env);
+        RootScope roots(&left); // the right operand may collect
+        Value right = Eval(infixExp->right, env);
         if(isError(right))
             return right;
 
-        return evalInfixExpression(infixExp->op, left, right);
+        Quickened quickened = infixExp->quickened.load(std::memory_order_relaxed);
+        if(quickeningEnabled && quickened > Quickened::GENERIC){
+            Value result = evalQuickenedInfix(quickened, left, right);
+            if(!result.empty())
+                return result;
+            infixExp->quickened.store(Quickened::GENERIC, std::memory_order_relaxed); // deoptimize for good
+        }
+        else if(quickeningEnabled && quickened == Quickened::UNSEEN){
+            infixExp->quickened.store(quickenInfix(infixExp->op, left, right), std::memory_order_relaxed);
+        }
+        return locateError(evalInfixExpression(infixExp->op, left, right), infixExp);
     }
     else if(node_type == typeid(BlockStatement)){
         BlockStatement* block = dynamic_cast<BlockStatement*>(node);
@@ -66,7 +98,7 @@ Object* Eval(Node* node, Environment* env){
     }
     else if(node_type == typeid(ReturnStatement)){
         ReturnStatement* returnStmt = dynamic_cast<ReturnStatement*>(node);
-        Object* result = Eval(returnStmt->expressionValue, env);
+        Value result = Eval(returnStmt->expressionValue, env);
         if(isError(result))
             return result;
 
@@ -74,31 +106,48 @@ Object* Eval(Node* node, Environment* env){
     }
     else if(node_type == typeid(LetStatement)){
         LetStatement* letStmt = dynamic_cast<LetStatement*>(node);
-        Object* val = Eval(letStmt->expressionValue, env);
+        Value val = Eval(letStmt->expressionValue, env);
         if(isError(val))
             return val;
         env->set(letStmt->name->value, val);
 
     }
+    else if(node_type == typeid(AssignStatement)){
+        AssignStatement* assignStmt = dynamic_cast<AssignStatement*>(node);
+        Value val = Eval(assignStmt->expressionValue, env);
+        if(isError(val))
+            return val;
+        if(!env->assign(assignStmt->name->value, val))
+            return locateError(newError("identifier not found: " + assignStmt->name->value), assignStmt->name);
+    }
+    else if(node_type == typeid(WhileStatement)){
+        WhileStatement* whileStmt = dynamic_cast<WhileStatement*>(node);
+        return evalWhileStatement(whileStmt, env);
+    }
+    else if(node_type == typeid(ForStatement)){
+        ForStatement* forStmt = dynamic_cast<ForStatement*>(node);
+        return locateError(evalForStatement(forStmt, env), forStmt);
+    }
     else if(node_type == typeid(Identifier)){
         Identifier* ident = dynamic_cast<Identifier*>(node);
         return evalIdentifier(ident, env);
     }
     else if(node_type == typeid(FunctionLiteral)){
         FunctionLiteral* funcLit = dynamic_cast<FunctionLiteral*>(node);
-        return new Function(funcLit->parameters, funcLit->body, env);
+        return new Function(funcLit, env);
     }
     else if(node_type == typeid(CallExpression)){
         CallExpression* callExp = dynamic_cast<CallExpression*>(node);
-        Object* function = Eval(callExp->function, env);
+        Value function = Eval(callExp->function, env);
         if(isError(function))
             return function;
         
-        std::vector<Object*> args = evalExpressions(callExp->arguments, env);
+        RootScope roots(&function); // the arguments may collect
+        std::vector<Value> args = evalExpressions(callExp->arguments, env);
         if(args.size() == 1 && isError(args[0]))
             return args[0];
         
-        return applyFunction(function, args);
+        return locateError(applyFunction(function, args), callExp);
     }
     else if(node_type == typeid(StringLiteral)){
         StringLiteral* str = dynamic_cast<StringLiteral*>(node);
@@ -106,7 +155,7 @@ Object* Eval(Node* node, Environment* env){
     }
     else if(node_type == typeid(ArrayLiteral)){
         ArrayLiteral* ar = dynamic_cast<ArrayLiteral*>(node);
-        std::vector<Object*> elems = evalExpressions(ar->elements, env);
+        std::vector<Value> elems = evalExpressions(ar->elements, env);
         if(elems.size() == 1 && isError(elems[0])){
             return elems[0];
         }
@@ -114,32 +163,46 @@ Object* Eval(Node* node, Environment* env){
     }
     else if(node_type == typeid(IndexExpression)){
         IndexExpression* indexExp = dynamic_cast<IndexExpression*>(node);
-        Object* left = Eval(indexExp->left, env);
+        Value left = Eval(indexExp->left, env);
         if(isError(left))
             return left;
-        Object* index = Eval(indexExp->index, env);
+        RootScope roots(&left); // the index may collect
+        Value index = Eval(indexExp->index, env);
         if(isError(index))
             return index;
-        return evalIndexExpression(left, index);
+
+        Quickened quickened = indexExp->quickened.load(std::memory_order_relaxed);
+        if(quickeningEnabled && quickened > Quickened::GENERIC){
+            Value result = evalQuickenedIndex(quickened, left, index);
+            if(!result.empty())
+                return result;
+            indexExp->quickened.store(Quickened::GENERIC, std::memory_order_relaxed); // deoptimize for good
+        }
+        else if(quickeningEnabled && quickened == Quickened::UNSEEN){
+            indexExp->quickened.store(quickenIndex(left, index), std::memory_order_relaxed);
+        }
+        return locateError(evalIndexExpression(left, index), indexExp);
     }
     else if(node_type == typeid(HashLiteral)){
         HashLiteral* hashLit = dynamic_cast<HashLiteral*>(node);
-        return evalHashLiteral(hashLit, env);
+        return locateError(evalHashLiteral(hashLit, env), hashLit);
     }
-    return nullptr;
+    return Value();
 
 }
 
-Object* evalProgram(std::vector<Statement*>& stmts, Environment* env){
-    Object* result = nullptr;
+Value evalProgram(std::vector<Statement*>& stmts, Environment* env){
+    RootScope roots(env);
+    Value result;
     for(Statement* stmt: stmts){
+        safePoint(); // the previous statement's result is no longer needed
         result = Eval(stmt, env);
 
-        if(result != nullptr && typeid(*result) == typeid(ReturnValue)){
-            ReturnValue* returnVal = dynamic_cast<ReturnValue*>(result);
+        if(holds<ReturnValue>(result)){
+            ReturnValue* returnVal = static_cast<ReturnValue*>(result.asObject());
             return returnVal->value;
         }
-        if(result != nullptr && typeid(*result) == typeid(Error))
+        if(holds<Error>(result))
             return result;
     }
 
@@ -147,14 +210,12 @@ Object* evalProgram(std::vector<Statement*>& stmts, Environment* env){
 }
 
 //helper function which returns the const vars for bools
-BooleanObj* nativeBoolToBooleanObject(bool value){
-    if(value)
-        return &TRUE;
-    return &FALSE;
+Value nativeBoolToBooleanObject(bool value){
+    return Value::boolean(value);
 }
 
 // helper function to evaluate prefix expressions
-Object* evalPrefixExpression(std::string op, Object* operand){
+Value evalPrefixExpression(std::string op, Value operand){
     if(op == "!"){
         return evalBangOperator(operand);
     }
@@ -162,57 +223,44 @@ Object* evalPrefixExpression(std::string op, Object* operand){
         return evalMinusPrefixOperator(operand);
     }
     else{
-        return newError("unknown operator: " + op + " " + ObjectTypeToString[operand->type()]);
+        return newError("unknown operator: " + op + " " + ObjectTypeToString[operand.type()]);
     }
 }
 
 // helper function which applies the ! to the operand
-Object* evalBangOperator(Object* operand){
-    const std::type_info& operand_type = typeid(*operand);
-    if(operand_type == typeid(BooleanObj)){
-        BooleanObj* op = dynamic_cast<BooleanObj*>(operand);
-        if(op == &TRUE){
-            return &FALSE;
-        }
-        else{
-            return &TRUE;
-        }
+Value evalBangOperator(Value operand){
+    if(operand.isBoolean()){
+        return Value::boolean(!operand.asBoolean());
     }
-    else if(operand_type == typeid(NULLOBJ)){
-        return &TRUE;
+    else if(operand.isNull()){
+        return Value::boolean(true);
     }
     else
-        return &FALSE;
+        return Value::boolean(false);
     
 }
 
 // helper function which applies the - operand to negate a number 
-Object* evalMinusPrefixOperator(Object* operand){
-    if(typeid(*operand) == typeid(Integer)){
-        Integer* right_int = dynamic_cast<Integer*>(operand);
-        int val = right_int->value;
-        return new Integer(-val);
+Value evalMinusPrefixOperator(Value operand){
+    if(operand.isInteger()){
+        return Value::integer(-operand.asInteger());
     }
     else{
-        return newError("unknown operator: -"+ObjectTypeToString[operand->type()]);
+        return newError("unknown operator: -"+ObjectTypeToString[operand.type()]);
     }
 }
 
 // helper function to evaluate infix statements and return their value
-Object* evalInfixExpression(std::string op, Object* left, Object* right){
-    const std::type_info& left_type = typeid(*left);
-    const std::type_info& right_type = typeid(*right);
-    if(left_type == typeid(Integer) && right_type == typeid(Integer)){
-        Integer* left_int = dynamic_cast<Integer*>(left);
-        Integer* right_int = dynamic_cast<Integer*>(right);
-        return evalIntegerInfixExpression(op, left_int, right_int);
-    }
-    else if(left_type == typeid(String) && right_type == typeid(String)){
+Value evalInfixExpression(std::string op, Value left, Value right){
+    if(left.isInteger() && right.isInteger()){
+        return evalIntegerInfixExpression(op, left.asInteger(), right.asInteger());
+    }
+    else if(holds<String>(left) && holds<String>(right)){
         return evalStringInfixExpression(op, left, right);
     }
-    else if(left_type != right_type){
-        return newError("type mismatch: " + ObjectTypeToString[left->type()] +
-        " " + op + " " + ObjectTypeToString[right->type()]);
+    else if(left.type() != right.type()){
+        return newError("type mismatch: " + ObjectTypeToString[left.type()] +
+        " " + op + " " + ObjectTypeToString[right.type()]);
     }
     else if(op == "=="){
         return nativeBoolToBooleanObject(left == right);
@@ -221,23 +269,21 @@ Object* evalInfixExpression(std::string op, Object* left, Object* right){
         return nativeBoolToBooleanObject(left != right);
     }
     else
-        return newError("unknown operator: " + ObjectTypeToString[left->type()] +
-        " " + op + " " + ObjectTypeToString[right->type()]);
+        return newError("unknown operator: " + ObjectTypeToString[left.type()] +
+        " " + op + " " + ObjectTypeToString[right.type()]);
 
 }
 
 // helper function to evaluate infix statements of two integers
-Object* evalIntegerInfixExpression(std::string op, Integer* left_int, Integer* right_int){
-    int left_val = left_int->value;
-    int right_val = right_int->value;
+Value evalIntegerInfixExpression(std::string op, int left_val, int right_val){
     if(op == "+")
-        return new Integer(left_val+right_val);
+        return Value::integer(left_val+right_val);
     else if(op == "-")
-        return new Integer(left_val-right_val);
+        return Value::integer(left_val-right_val);
     else if(op == "*")
-        return new Integer(left_val*right_val);
+        return Value::integer(left_val*right_val);
     else if(op == "/")
-        return new Integer(left_val/right_val);
+        return Value::integer(left_val/right_val);
     else if(op == "<")
         return nativeBoolToBooleanObject(left_val<right_val);
     else if(op == ">")
@@ -247,13 +293,67 @@ Object* evalIntegerInfixExpression(std::string op, Integer* left_int, Integer* r
     else if(op == "!=")
         return nativeBoolToBooleanObject(left_val!=right_val);
     else
-        return newError("unknown operator: " + ObjectTypeToString[left_int->type()] + " "
-        + op + " " + ObjectTypeToString[right_int->type()]);
+        return newError("unknown operator: " + ObjectTypeToString[ObjectType::INTEGER_OBJ] + " "
+        + op + " " + ObjectTypeToString[ObjectType::INTEGER_OBJ]);
+}
+
+// whether infix and index expressions specialize themselves to the operand types they see
+bool quickeningEnabled = true;
+
+// picks the specialization of an infix expression for the operands it just ran with
+Quickened quickenInfix(const std::string& op, Value left, Value right){
+    if(!left.isInteger() || !right.isInteger())
+        return Quickened::GENERIC;
+    if(op == "+")
+        return Quickened::INTEGER_ADD;
+    else if(op == "-")
+        return Quickened::INTEGER_SUBTRACT;
+    else if(op == "*")
+        return Quickened::INTEGER_MULTIPLY;
+    else if(op == "/")
+        return Quickened::INTEGER_DIVIDE;
+    else if(op == "<")
+        return Quickened::INTEGER_LESS_THAN;
+    else if(op == ">")
+        return Quickened::INTEGER_GREATER_THAN;
+    else if(op == "==")
+        return Quickened::INTEGER_EQUAL;
+    else if(op == "!=")
+        return Quickened::INTEGER_NOT_EQUAL;
+    return Quickened::GENERIC;
+}
+
+// runs an infix expression specialized to integers, the guard is the only type check left
+Value evalQuickenedInfix(Quickened quickened, Value left, Value right){
+    if(!left.isInteger() || !right.isInteger())
+        return Value();
+    int left_val = left.asInteger();
+    int right_val = right.asInteger();
+    switch(quickened){
+        case Quickened::INTEGER_ADD:
+            return Value::integer(left_val+right_val);
+        case Quickened::INTEGER_SUBTRACT:
+            return Value::integer(left_val-right_val);
+        case Quickened::INTEGER_MULTIPLY:
+            return Value::integer(left_val*right_val);
+        case Quickened::INTEGER_DIVIDE:
+            return Value::integer(left_val/right_val);
+        case Quickened::INTEGER_LESS_THAN:
+            return nativeBoolToBooleanObject(left_val<right_val);
+        case Quickened::INTEGER_GREATER_THAN:
+            return nativeBoolToBooleanObject(left_val>right_val);
+        case Quickened::INTEGER_EQUAL:
+            return nativeBoolToBooleanObject(left_val==right_val);
+        case Quickened::INTEGER_NOT_EQUAL:
+            return nativeBoolToBooleanObject(left_val!=right_val);
+        default:
+            return Value();
+    }
 }
 
 // helper function to evaluate if expressions 
-Object* evalIfExpression(IfExpression* exp, Environment* env){
-    Object* condition = Eval(exp->condition, env);
+Value evalIfExpression(IfExpression* exp, Environment* env){
+    Value condition = Eval(exp->condition, env);
     if(isError(condition))
         return condition;
     if(isTruthy(condition)){
@@ -262,30 +362,68 @@ Object* evalIfExpression(IfExpression* exp, Environment* env){
     else if(exp->alternative != nullptr)
         return Eval(exp->alternative, env);
     else {
-        return &NULLOBJ;
+        return Value::null();
+
+    }
+}
+
+// helper function to evaluate a while loop, the body runs in one scope reused by every iteration
+Value evalWhileStatement(WhileStatement* stmt, Environment* env){
+    Environment* loopEnv = new Environment(env);
+    RootScope roots(loopEnv);
+    while(true){
+        safePoint();
+        Value condition = Eval(stmt->expressionValue, env);
+        if(isError(condition))
+            return condition;
+        if(!isTruthy(condition))
+            return Value();
 
+        Value result = evalBlockStatement(stmt->body->statements, loopEnv);
+        if(holds<ReturnValue>(result) || holds<Error>(result))
+            return result;
     }
 }
 
+// helper function to evaluate a for in loop, the body runs in one scope reused by every iteration
+Value evalForStatement(ForStatement* stmt, Environment* env){
+    Value iterable = Eval(stmt->expressionValue, env);
+    if(isError(iterable))
+        return iterable;
+    if(iterable.type() != ObjectType::ARRAY_OBJ)
+        return newError("for loop can only iterate over ARRAY, got " + ObjectTypeToString[iterable.type()]);
+
+    Environment* loopEnv = new Environment(env);
+    RootScope roots(loopEnv, &iterable);
+    for(size_t i = 0; i < static_cast<Array*>(iterable.asObject())->elements.size(); i++){
+        safePoint(); // may move the array, so it is found through iterable every iteration
+        loopEnv->set(stmt->iterator->value, static_cast<Array*>(iterable.asObject())->elements[i]);
+        Value result = evalBlockStatement(stmt->body->statements, loopEnv);
+        if(holds<ReturnValue>(result) || holds<Error>(result))
+            return result;
+    }
+    return Value();
+}
+
 // helper function to tell if a condition is truthy or not
-bool isTruthy(Object* obj){
-    if(obj == &NULLOBJ)
+bool isTruthy(Value obj){
+    if(obj == Value::null())
         return false;
-    else if(obj == &TRUE)
+    else if(obj == Value::boolean(true))
         return true;
-    else if(obj == &FALSE)
+    else if(obj == Value::boolean(false))
         return false;
     else
         return true;
 }
 
 // helper function to evaluate a block of statements taking care of returns
-Object* evalBlockStatement(std::vector<Statement*>& stmts, Environment* env){
-    Object* result = nullptr;
+Value evalBlockStatement(std::vector<Statement*>& stmts, Environment* env){
+    Value result;
     for(Statement* stmt: stmts){
         result = Eval(stmt, env);
 
-        if(result != nullptr && (typeid(*result) == typeid(ReturnValue) || typeid(*result) == typeid(Error))){
+        if(holds<ReturnValue>(result) || holds<Error>(result)){
             return result;
         }
     }
@@ -298,22 +436,29 @@ Error* newError(std::string message){
     return new Error(message);
 }
 
+// helper function which records where an error came from if it has no location yet
+Value locateError(Value result, Node* node){
+    if(isError(result)){
+        Error* error = static_cast<Error*>(result.asObject());
+        if(error->offset == UNKNOWN_OFFSET)
+            error->offset = node->token.offset;
+    }
+    return result;
+}
+
 // helper function to check if an object is an error
-bool isError(Object* obj){
-    if(obj != nullptr)
-        return obj->type() == ObjectType::ERROR_OBJ;
-        
-    return false;
+bool isError(Value obj){
+    return holds<Error>(obj);
 }
 
 // helper function which returns the value of an identifier through the enviroment
-Object* evalIdentifier(Identifier* ident, Environment* env){
-    Object* val = env->get(ident->value);
-    if(val == nullptr){ // not a variable in our environment
+Value evalIdentifier(Identifier* ident, Environment* env){
+    Value val = env->get(ident->value);
+    if(val.empty()){ // not a variable in our environment
         // first check if its a builtin func name
         auto funcIt = builtins.find(ident->value);
         if(funcIt == builtins.end()) //not a builtin function
-            return newError("identifier not found: " + ident->value);
+            return locateError(newError("identifier not found: " + ident->value), ident);
         else // is a builtin function
             return funcIt->second; // return the Builtin object which has a function pointer to proper func
     }
@@ -321,12 +466,13 @@ Object* evalIdentifier(Identifier* ident, Environment* env){
 }
 
 // helper function to evaluate the value of parameters before passing them to functions
-std::vector<Object*> evalExpressions(std::vector<Expression*>& params, Environment* env){
-    std::vector<Object*> result;
+std::vector<Value> evalExpressions(std::vector<Expression*>& params, Environment* env){
+    std::vector<Value> result;
+    RootScope roots(&result); // the parameters after the first may collect
     for(Expression* param: params){
-        Object* evaluated = Eval(param, env);
+        Value evaluated = Eval(param, env);
         if(isError(evaluated)){
-            std::vector<Object*> err = {evaluated};
+            std::vector<Value> err = {evaluated};
             return err;
         }
         result.push_back(evaluated);
@@ -335,15 +481,25 @@ std::vector<Object*> evalExpressions(std::vector<Expression*>& params, Environme
 }
 
 // helper function which evaluates the function body of a func given its parameters
-Object* applyFunction(Object* uncast_function, std::vector<Object*>& args){
-    if(typeid(*uncast_function) == typeid(Function)){
-        Function* func = dynamic_cast<Function*>(uncast_function);
+Value applyFunction(Value uncast_function, std::vector<Value>& args){
+    if(holds<Function>(uncast_function)){
+        Function* func = static_cast<Function*>(uncast_function.asObject());
+        if(func->flat != nullptr)
+            return applyFlatFunction(func, args);
+        ShadowFrame frame(func->literal);
+        NodeTimer timer(func->literal, true);
+        TraceSpan span(func->literal);
+        BlockStatement* body = func->body;
         Environment* extendedEnv = extendFunctionEnv(func, args);
-        Object* evaluated = Eval(func->body, extendedEnv);
+        RootScope roots(extendedEnv);
+        safePoint(); // the arguments are in extendedEnv and the caller needs nothing else, func may move
+        Value evaluated = Eval(body, extendedEnv);
         return unwrapReturnValue(evaluated);
     }
-    else if(typeid(*uncast_function) == typeid(Builtin)){
-        Builtin* func = dynamic_cast<Builtin*>(uncast_function);
+    else if(holds<Builtin>(uncast_function)){
+        Builtin* func = static_cast<Builtin*>(uncast_function.asObject());
+        NodeTimer timer(nullptr, true);
+        TraceSpan span(func);
         return func->fn(args);
     }
     
@@ -354,7 +510,7 @@ Object* applyFunction(Object* uncast_function, std::vector<Object*>& args){
 
 // takes in a function* and uses the enviroment to create a new extended enviroment with proper
 // params passed through and returns that
-Environment* extendFunctionEnv(Function* func, std::vector<Object*> args){
+Environment* extendFunctionEnv(Function* func, std::vector<Value> args){
     Environment* extendedEnv = new Environment(func->env);
     for(size_t i = 0; i < func->parameters.size(); i++){
         extendedEnv->set(func->parameters[i]->value, args[i]);
@@ -363,176 +519,566 @@ Environment* extendFunctionEnv(Function* func, std::vector<Object*> args){
 }
 
 // helper function which unwraps the return value for function evaluation
-Object* unwrapReturnValue(Object* evaluated){
-    if(typeid(*evaluated) == typeid(ReturnValue)){
-        ReturnValue* returnVal = dynamic_cast<ReturnValue*>(evaluated);
+Value unwrapReturnValue(Value evaluated){
+    if(holds<ReturnValue>(evaluated)){
+        ReturnValue* returnVal = static_cast<ReturnValue*>(evaluated.asObject());
         return returnVal->value;
     }
         return evaluated;
 }
 
 // helper function for doing string concatentation
-Object* evalStringInfixExpression(std::string op, Object* left, Object* right){
-    String* left_str = dynamic_cast<String*>(left);
-    String* right_str = dynamic_cast<String*>(right);
+Value evalStringInfixExpression(std::string op, Value left, Value right){
+    String* left_str = static_cast<String*>(left.asObject());
+    String* right_str = static_cast<String*>(right.asObject());
 
     if( op == "==")
-        return nativeBoolToBooleanObject(left_str->value == right_str->value);
+        return nativeBoolToBooleanObject(left_str->length == right_str->length &&
+                                         left_str->flatten() == right_str->flatten());
 
     if(op == "!="){
-        return nativeBoolToBooleanObject(left_str->value != right_str->value);
+        return nativeBoolToBooleanObject(left_str->length != right_str->length ||
+                                         left_str->flatten() != right_str->flatten());
     }
     if( op != "+")
         return newError("unknown operator: " + ObjectTypeToString[left_str->type()]+ " "
         + op + " " + ObjectTypeToString[right_str->type()]);
 
-    return new String(left_str->value + right_str->value);
+    return new String(left_str, right_str);
 }
 
 
 // length function for arrays and strings
-Object* objectLength(std::vector<Object*> input){
+Value objectLength(std::vector<Value> input){
     if(input.size() != 1)
         return newError("wrong number of arguments. expected=1, got=" + std::to_string(input.size()));
-    if(input[0]->type() == ObjectType::STRING_OBJ){
-        String* inStr = dynamic_cast<String*>(input[0]);
-        size_t length = inStr->value.size();
-        return new Integer((int) length); 
+    if(input[0].type() == ObjectType::STRING_OBJ){
+        String* inStr = static_cast<String*>(input[0].asObject());
+        size_t length = inStr->length;
+        return Value::integer((int) length); 
     }
-    else if(input[0]->type() == ObjectType::ARRAY_OBJ){
-        Array* ar = dynamic_cast<Array*>(input[0]);
+    else if(input[0].type() == ObjectType::ARRAY_OBJ){
+        Array* ar = static_cast<Array*>(input[0].asObject());
         size_t length = ar->elements.size();
-        return new Integer((int) length); 
+        return Value::integer((int) length); 
     }
-        return newError("argument to 'len' not supported, got " + ObjectTypeToString[input[0]->type()]);
+        return newError("argument to 'len' not supported, got " + ObjectTypeToString[input[0].type()]);
     
 }
 
 // builtin function FIRST for arrays gets the first element of the array
-Object* first(std::vector<Object*> inputs){
+Value first(std::vector<Value> inputs){
     if(inputs.size() != 1)
         return newError("wrong number of arguments. expected=1, got=" + std::to_string(inputs.size()));
-    else if(inputs[0]->type() == ObjectType::ARRAY_OBJ){
-        Array* ar = dynamic_cast<Array*>(inputs[0]);
+    else if(inputs[0].type() == ObjectType::ARRAY_OBJ){
+        Array* ar = static_cast<Array*>(inputs[0].asObject());
         if(ar->elements.size() < 1)
-            return &NULLOBJ;
+            return Value::null();
         return ar->elements[0]; 
     }
     else
-        return newError("argument to 'first' must be ARRAY, got " + ObjectTypeToString[inputs[0]->type()]);
+        return newError("argument to 'first' must be ARRAY, got " + ObjectTypeToString[inputs[0].type()]);
     
 }
 
 // builtin function LAST for arrays gets the last element of the array
-Object* last(std::vector<Object*> inputs){
+Value last(std::vector<Value> inputs){
     if(inputs.size() != 1)
         return newError("wrong number of arguments. expected=1, got=" + std::to_string(inputs.size()));
-    else if(inputs[0]->type() == ObjectType::ARRAY_OBJ){
-        Array* ar = dynamic_cast<Array*>(inputs[0]);
+    else if(inputs[0].type() == ObjectType::ARRAY_OBJ){
+        Array* ar = static_cast<Array*>(inputs[0].asObject());
         if(ar->elements.size() < 1)
-            return &NULLOBJ;
+            return Value::null();
         return ar->elements[ar->elements.size()-1]; 
     }
     else
-        return newError("argument to 'last' must be ARRAY, got " + ObjectTypeToString[inputs[0]->type()]);
+        return newError("argument to 'last' must be ARRAY, got " + ObjectTypeToString[inputs[0].type()]);
     
 }
 
 // builtin function REST for arrays gets a copy of the array with all but first element
-Object* rest(std::vector<Object*> inputs){
+Value rest(std::vector<Value> inputs){
     if(inputs.size() != 1)
         return newError("wrong number of arguments. expected=1, got=" + std::to_string(inputs.size()));
-    else if(inputs[0]->type() == ObjectType::ARRAY_OBJ){
-        Array* ar = dynamic_cast<Array*>(inputs[0]);
+    else if(inputs[0].type() == ObjectType::ARRAY_OBJ){
+        Array* ar = static_cast<Array*>(inputs[0].asObject());
         if(ar->elements.size() < 1)
-            return &NULLOBJ;
-        std::vector<Object*> tail;
+            return Value::null();
+        std::vector<Value> tail;
         tail.resize(ar->elements.size()-1);
         std::copy( ++(ar->elements.begin()), ar->elements.end(), tail.begin());
         return new Array(tail); 
     }
     else
-        return newError("argument to 'rest' must be ARRAY, got " + ObjectTypeToString[inputs[0]->type()]);
+        return newError("argument to 'rest' must be ARRAY, got " + ObjectTypeToString[inputs[0].type()]);
     
 }
 
 // builtin function PUSH for arrays gets a copy of the array and adds desired element to the end
-Object* push(std::vector<Object*> inputs){
+Value push(std::vector<Value> inputs){
     if(inputs.size() != 2){
         return newError("wrong number of arguments. expected=2, got=" + std::to_string(inputs.size()));
     }
-    if(inputs[0]->type() != ObjectType::ARRAY_OBJ){
-        return newError("argument to 'push' must be ARRAY, got " + ObjectTypeToString[inputs[0]->type()]);
+    if(inputs[0].type() != ObjectType::ARRAY_OBJ){
+        return newError("argument to 'push' must be ARRAY, got " + ObjectTypeToString[inputs[0].type()]);
     }
-    Array* ar = dynamic_cast<Array*>(inputs[0]);
-    std::vector<Object*> newAr(ar->elements.begin(), ar->elements.end());
+    Array* ar = static_cast<Array*>(inputs[0].asObject());
+    std::vector<Value> newAr(ar->elements.begin(), ar->elements.end());
     newAr.push_back(inputs[1]);
     return new Array(newAr);
 }
 
 // helper function which access the proper element on an array using indexing
-Object* evalIndexExpression(Object* left, Object* index){
-    if(left->type() == ObjectType::ARRAY_OBJ && index->type() == ObjectType::INTEGER_OBJ){
-        Array* ar = dynamic_cast<Array*>(left);
-        Integer* idx = dynamic_cast<Integer*>(index);
-        return evalArrayIndexExpression(ar, idx);
-    }
-    else if(left->type() == ObjectType::HASH_OBJ){
-        Hash* hash = dynamic_cast<Hash*>(left);
+Value evalIndexExpression(Value left, Value index){
+    if(left.type() == ObjectType::ARRAY_OBJ && index.type() == ObjectType::INTEGER_OBJ){
+        Array* ar = static_cast<Array*>(left.asObject());
+        return evalArrayIndexExpression(ar, index.asInteger());
+    }
+    else if(left.type() == ObjectType::HASH_OBJ){
+        Hash* hash = static_cast<Hash*>(left.asObject());
         return EvalHashIndexExpression(hash, index);
     }
     else{
-        return newError("index operator not supported: " + ObjectTypeToString[left->type()]);
+        return newError("index operator not supported: " + ObjectTypeToString[left.type()]);
     }
 }
 
+// picks the specialization of an index expression for the operands it just ran with
+Quickened quickenIndex(Value left, Value index){
+    if(holds<Array>(left) && index.isInteger())
+        return Quickened::ARRAY_INDEX_BY_INTEGER;
+    if(holds<Hash>(left) && holds<String>(index))
+        return Quickened::HASH_INDEX_BY_STRING;
+    return Quickened::GENERIC;
+}
+
+// runs an index expression specialized to an array and integer or a hash and string
+Value evalQuickenedIndex(Quickened quickened, Value left, Value index){
+    if(quickened == Quickened::ARRAY_INDEX_BY_INTEGER && holds<Array>(left) && index.isInteger())
+        return evalArrayIndexExpression(static_cast<Array*>(left.asObject()), index.asInteger());
+    if(quickened == Quickened::HASH_INDEX_BY_STRING && holds<Hash>(left) && holds<String>(index)){
+        Hash* hash = static_cast<Hash*>(left.asObject());
+        auto it = hash->pairs.find(static_cast<String*>(index.asObject())->hashKey());
+        if(it == hash->pairs.end())
+            return Value::null();
+        return it->second.value;
+    }
+    return Value();
+}
+
 // helper which accesses the value of the array 
-Object* evalArrayIndexExpression(Array* ar, Integer* index){
+Value evalArrayIndexExpression(Array* ar, int index){
     size_t maxIdx = ar->elements.size() - 1;
-    if(index->value < 0 || index->value > (int)maxIdx)
-        return &NULLOBJ;
-    return ar->elements[(size_t)index->value];
+    if(index < 0 || index > (int)maxIdx)
+        return Value::null();
+    return ar->elements[(size_t)index];
 }
 
 // evaluation function which evaluates a hash literal
-Object* evalHashLiteral(HashLiteral* hashLit, Environment* env){
-    Hash* newHash = new Hash();
+Value evalHashLiteral(HashLiteral* hashLit, Environment* env){
+    Value hash = new Hash();
+    RootScope roots(&hash); // the pairs may collect, so the hash is found through hash after each
 
     for(auto it : hashLit->pairs){
-        Object* key = Eval(it.first, env);
+        Value key = Eval(it.first, env);
         if(isError(key))
             return key;
-        if(!hashable(key))
-            return newError("unusable as hash key. type=" + ObjectTypeToString[key->type()]);
+        if(!key.hashable())
+            return newError("unusable as hash key. type=" + ObjectTypeToString[key.type()]);
 
-        Object* value = Eval(it.second, env);
+        RootScope keyRoots(&key);
+        Value value = Eval(it.second, env);
         if(isError(value))
             return value;
 
-        HashableObject* hashKey = dynamic_cast<HashableObject*>(key);
-        HashKey hashed = hashKey->hashKey();
-        newHash->pairs[hashed] = HashPair{key, value};
+        Hash* newHash = static_cast<Hash*>(hash.asObject());
+        newHash->pairs[key.hashKey()] = HashPair{key, value};
+        writeBarrier(newHash, key);
+        writeBarrier(newHash, value);
     }
-    return newHash;
+    return hash;
 }
 
 // function to evaluate indexing into a hash object
- Object* EvalHashIndexExpression(Hash* hash, Object* index){
-    if(!hashable(index)){
-        return newError("unusable as hash key: " + ObjectTypeToString[index->type()]);
+ Value EvalHashIndexExpression(Hash* hash, Value index){
+    if(!index.hashable()){
+        return newError("unusable as hash key: " + ObjectTypeToString[index.type()]);
     }
-    HashableObject* idx = dynamic_cast<HashableObject*>(index);
-    auto it = hash->pairs.find(idx->hashKey());
+    auto it = hash->pairs.find(index.hashKey());
     if(it == hash->pairs.end()){
-        return &NULLOBJ;
+        return Value::null();
     }
     return it->second.value;
  }
 
  // builtin function puts for printing to the screen
-Object* puts(std::vector<Object*> inputs){
-    for(Object* obj: inputs){
-        std::cout<<obj->inspect()<<"\n";
+Value puts(std::vector<Value> inputs){
+    OutputSink& out = standardOutput();
+    for(Value obj: inputs){
+        obj.inspect(out);
+        out.put('\n');
     }
-    return &NULLOBJ;
+    return Value::null();
+}
+
+// what isPureFunction knows about the names bound inside the function it is checking
+struct PurityCheck {
+    Environment* env; // environment the function closes over, names not bound inside resolve here
+    std::unordered_set<std::string> functions; // names let bound directly to a function literal
+    std::unordered_set<std::string> unknown; // names whose value isn't known until the function runs
+    std::vector<std::unordered_set<std::string>> scopes; // names declared so far in each enclosing scope
+    std::unordered_set<Function*>& visited;
+};
+
+// collects the names bound inside a function, the ones let bound directly to a function literal go in
+// functions and every other let, parameter, loop variable or assignment goes in unknown
+static void collectLocals(Node* node, PurityCheck& check){
+    const std::type_info& node_type = typeid(*node);
+    if(node_type == typeid(LetStatement)){
+        LetStatement* letStmt = dynamic_cast<LetStatement*>(node);
+        if(letStmt->expressionValue && typeid(*letStmt->expressionValue) == typeid(FunctionLiteral))
+            check.functions.insert(letStmt->name->value);
+        else
+            check.unknown.insert(letStmt->name->value);
+    }
+    else if(node_type == typeid(AssignStatement))
+        check.unknown.insert(dynamic_cast<AssignStatement*>(node)->name->value);
+    else if(node_type == typeid(ForStatement))
+        check.unknown.insert(dynamic_cast<ForStatement*>(node)->iterator->value);
+    else if(node_type == typeid(FunctionLiteral)){
+        for(Identifier* param: dynamic_cast<FunctionLiteral*>(node)->parameters)
+            check.unknown.insert(param->value);
+    }
+    std::vector<Node*> children;
+    node->children(children);
+    for(Node* child: children)
+        collectLocals(child, check);
+}
+
+// helper for isPureNode which checks a loop or function body inside a new scope holding declared
+static bool isPureScope(Node* body, std::unordered_set<std::string> declared, PurityCheck& check);
+
+// helper for isPureFunction which checks every node below node, names are resolved against the
+// closed over environment unless they are bound inside the function
+static bool isPureNode(Node* node, PurityCheck& check){
+    const std::type_info& node_type = typeid(*node);
+    if(node_type == typeid(Identifier)){
+        Identifier* ident = dynamic_cast<Identifier*>(node);
+        if(check.functions.count(ident->value) || check.unknown.count(ident->value))
+            return true;
+        Value val = check.env->get(ident->value);
+        if(val.empty()){
+            auto funcIt = builtins.find(ident->value);
+            if(funcIt == builtins.end())
+                return true; // evaluates to an error, which has no side effects
+            val = funcIt->second;
+        }
+        if(holds<Builtin>(val))
+            return static_cast<Builtin*>(val.asObject())->pure;
+        if(holds<Function>(val))
+            return isPureFunction(static_cast<Function*>(val.asObject()), check.visited);
+        return true;
+    }
+    else if(node_type == typeid(CallExpression)){
+        // only calls to functions we can see the body of can be checked
+        Expression* callee = dynamic_cast<CallExpression*>(node)->function;
+        if(typeid(*callee) == typeid(Identifier)){
+            if(check.unknown.count(dynamic_cast<Identifier*>(callee)->value))
+                return false;
+        }
+        else if(typeid(*callee) != typeid(FunctionLiteral))
+            return false;
+    }
+    else if(node_type == typeid(LetStatement)){
+        LetStatement* letStmt = dynamic_cast<LetStatement*>(node);
+        if(letStmt->expressionValue && !isPureNode(letStmt->expressionValue, check))
+            return false;
+        check.scopes.back().insert(letStmt->name->value);
+        return true;
+    }
+    else if(node_type == typeid(AssignStatement)){
+        // assigning is only pure if it lands on a binding this call created, which has to have
+        // been declared earlier in an enclosing scope, anything else may be shared between threads
+        AssignStatement* assignStmt = dynamic_cast<AssignStatement*>(node);
+        bool local = false;
+        for(std::unordered_set<std::string>& scope: check.scopes)
+            local = local || scope.count(assignStmt->name->value);
+        return local && (!assignStmt->expressionValue || isPureNode(assignStmt->expressionValue, check));
+    }
+    else if(node_type == typeid(FunctionLiteral)){
+        FunctionLiteral* funcLit = dynamic_cast<FunctionLiteral*>(node);
+        std::unordered_set<std::string> params;
+        for(Identifier* param: funcLit->parameters)
+            params.insert(param->value);
+        return isPureScope(funcLit->body, params, check);
+    }
+    else if(node_type == typeid(WhileStatement)){
+        WhileStatement* whileStmt = dynamic_cast<WhileStatement*>(node);
+        return isPureNode(whileStmt->expressionValue, check) && isPureScope(whileStmt->body, {}, check);
+    }
+    else if(node_type == typeid(ForStatement)){
+        ForStatement* forStmt = dynamic_cast<ForStatement*>(node);
+        return isPureNode(forStmt->expressionValue, check) &&
+               isPureScope(forStmt->body, {forStmt->iterator->value}, check);
+    }
+    std::vector<Node*> children;
+    node->children(children);
+    for(Node* child: children){
+        if(!isPureNode(child, check))
+            return false;
+    }
+    return true;
+}
+
+// helper for isPureNode which checks a loop or function body inside a new scope holding declared
+static bool isPureScope(Node* body, std::unordered_set<std::string> declared, PurityCheck& check){
+    check.scopes.push_back(declared);
+    bool pure = isPureNode(body, check);
+    check.scopes.pop_back();
+    return pure;
+}
+
+// checks a function only reads the state it can reach and calls nothing with side effects so
+// it can be applied from several threads at once
+bool isPureFunction(Function* func, std::unordered_set<Function*>& visited){
+    if(!visited.insert(func).second)
+        return true; // already being checked further up, recursion adds nothing new
+    std::vector<Identifier*>* parameters = &func->parameters;
+    Node* body = func->body;
+    std::unique_ptr<FunctionLiteral> rebuilt; // the check walks Nodes, so a flat function's literal is rebuilt
+    if(func->flat != nullptr){
+        rebuilt.reset(static_cast<FunctionLiteral*>(func->flat->toNode(func->flatNode)));
+        parameters = &rebuilt->parameters;
+        body = rebuilt->body;
+    }
+    PurityCheck check{func->env, {}, {}, {}, visited};
+    std::unordered_set<std::string> params;
+    for(Identifier* param: *parameters){
+        check.unknown.insert(param->value);
+        params.insert(param->value);
+    }
+    collectLocals(body, check);
+    return isPureScope(body, params, check);
+}
+
+// helper which checks the callback of a higher order builtin is a function taking arity arguments
+Error* checkCallback(std::string name, Value callback, size_t arity){
+    if(callback.type() == ObjectType::BUILTIN_OBJ)
+        return nullptr;
+    if(callback.type() != ObjectType::FUNCTION_OBJ)
+        return newError("callback to '" + name + "' must be FUNCTION, got " + ObjectTypeToString[callback.type()]);
+    Function* func = static_cast<Function*>(callback.asObject());
+    if(func->parameterCount() != arity)
+        return newError("wrong number of parameters for '" + name + "' callback. expected=" +
+                        std::to_string(arity) + ", got=" + std::to_string(func->parameterCount()));
+    return nullptr;
+}
+
+// helper which applies the callback in inputs[1] to each element in [begin, end) of the array in inputs[0]
+// REQUIRES: inputs and results be rooted, the array is found through inputs after every call as it may move
+static void applyEach(std::vector<Value>& inputs, std::vector<Value>& results, size_t begin, size_t end){
+    for(size_t i = begin; i < end; i++){
+        std::vector<Value> args = {static_cast<Array*>(inputs[0].asObject())->elements[i]};
+        Value result = applyFunction(inputs[1], args);
+        results[i] = result.empty() ? Value::null() : result;
+    }
+}
+
+// helper shared by the map and filter builtins which applies the callback to every element,
+// across the thread pool if parallel is set and the callback is pure
+// EFFECTS: returns an Error to report or no value once results holds the callback results in order
+static Value applyToElements(std::string name, std::vector<Value>& inputs, bool parallel, std::vector<Value>& results){
+    if(inputs.size() != 2)
+        return newError("wrong number of arguments. expected=2, got=" + std::to_string(inputs.size()));
+    if(inputs[0].type() != ObjectType::ARRAY_OBJ)
+        return newError("argument to '" + name + "' must be ARRAY, got " + ObjectTypeToString[inputs[0].type()]);
+    Value err = checkCallback(name, inputs[1], 1);
+    if(!err.empty())
+        return err;
+
+    RootScope inputRoots(&inputs); // the callbacks may collect
+    RootScope resultRoots(&results);
+    Value callback = inputs[1];
+    size_t count = static_cast<Array*>(inputs[0].asObject())->elements.size();
+    results.resize(count);
+
+    if(parallel && count >= PARALLEL_MIN_ELEMENTS){
+        bool pure;
+        if(callback.type() == ObjectType::BUILTIN_OBJ)
+            pure = static_cast<Builtin*>(callback.asObject())->pure;
+        else{
+            std::unordered_set<Function*> visited;
+            pure = isPureFunction(static_cast<Function*>(callback.asObject()), visited);
+        }
+        if(pure){
+            ThreadPool& pool = sharedThreadPool();
+            size_t grain = std::max<size_t>(16, count / (pool.concurrency() * 8)); // several chunks per thread to steal
+            pool.parallelFor(count, grain, [&](size_t begin, size_t end){
+                NoCollection noCollection; // collections need every other thread idle
+                applyEach(inputs, results, begin, end);
+            });
+        }
+        else
+            applyEach(inputs, results, 0, count);
+    }
+    else
+        applyEach(inputs, results, 0, count);
+
+    // the first error in element order is reported so the result doesn't depend on scheduling
+    for(Value result: results){
+        if(isError(result))
+            return result;
+    }
+    return Value();
+}
+
+// helper for the map builtins
+static Value mapElements(std::string name, std::vector<Value>& inputs, bool parallel){
+    std::vector<Value> results;
+    Value err = applyToElements(name, inputs, parallel, results);
+    if(!err.empty())
+        return err;
+    return new Array(results);
+}
+
+// helper for the filter builtins
+static Value filterElements(std::string name, std::vector<Value>& inputs, bool parallel){
+    std::vector<Value> results;
+    Value err = applyToElements(name, inputs, parallel, results);
+    if(!err.empty())
+        return err;
+    Array* ar = static_cast<Array*>(inputs[0].asObject());
+    std::vector<Value> kept;
+    for(size_t i = 0; i < results.size(); i++){
+        if(isTruthy(results[i]))
+            kept.push_back(ar->elements[i]);
+    }
+    return new Array(kept);
+}
+
+// builtin function MAP for arrays gets a new array of the callback applied to each element
+Value map(std::vector<Value> inputs){
+    return mapElements("map", inputs, false);
+}
+
+// builtin function FILTER for arrays gets a new array of the elements the callback is truthy for
+Value filter(std::vector<Value> inputs){
+    return filterElements("filter", inputs, false);
+}
+
+// builtin function PMAP, map which splits large arrays across the thread pool when the callback is pure
+Value pmap(std::vector<Value> inputs){
+    return mapElements("pmap", inputs, true);
+}
+
+// builtin function PFILTER, filter which splits large arrays across the thread pool when the callback is pure
+Value pfilter(std::vector<Value> inputs){
+    return filterElements("pfilter", inputs, true);
+}
+
+// builtin function REDUCE for arrays folds the callback over the elements starting from initial
+Value reduce(std::vector<Value> inputs){
+    if(inputs.size() != 3)
+        return newError("wrong number of arguments. expected=3, got=" + std::to_string(inputs.size()));
+    if(inputs[0].type() != ObjectType::ARRAY_OBJ)
+        return newError("argument to 'reduce' must be ARRAY, got " + ObjectTypeToString[inputs[0].type()]);
+    Value err = checkCallback("reduce", inputs[2], 2);
+    if(!err.empty())
+        return err;
+
+    Value accumulator = inputs[1];
+    RootScope inputRoots(&inputs); // the callbacks may collect, so the array is found through inputs each time
+    RootScope accumulatorRoots(&accumulator);
+    size_t count = static_cast<Array*>(inputs[0].asObject())->elements.size();
+    for(size_t i = 0; i < count; i++){
+        std::vector<Value> args = {accumulator, static_cast<Array*>(inputs[0].asObject())->elements[i]};
+        accumulator = applyFunction(inputs[2], args);
+        if(accumulator.empty())
+            accumulator = Value::null();
+        if(isError(accumulator))
+            return accumulator;
+    }
+    return accumulator;
+}
+
+// helper for sort which orders an array of all integers or all strings with std::sort
+static Value sortNative(Array* ar){
+    std::vector<Value>& elements = ar->elements;
+    ObjectType elementType = elements[0].type();
+    for(Value element: elements){
+        if(element.type() != elementType || (elementType != ObjectType::INTEGER_OBJ && elementType != ObjectType::STRING_OBJ))
+            return newError("argument to 'sort' must be all INTEGER or all STRING without a comparator, got " +
+                            ObjectTypeToString[element.type()]);
+    }
+
+    std::vector<Value> sorted;
+    sorted.reserve(elements.size());
+    if(elementType == ObjectType::INTEGER_OBJ){
+        // integers are held in the values themselves so comparisons don't chase pointers
+        sorted = elements;
+        std::sort(sorted.begin(), sorted.end(), [](Value a, Value b){
+            return a.asInteger() < b.asInteger();
+        });
+    }
+    else{
+        std::vector<String*> strings;
+        strings.reserve(elements.size());
+        for(Value element: elements){
+            String* str = static_cast<String*>(element.asObject());
+            str->flatten();
+            strings.push_back(str);
+        }
+        std::sort(strings.begin(), strings.end(), [](String* a, String* b){
+            return a->value < b->value;
+        });
+        sorted.assign(strings.begin(), strings.end());
+    }
+    return new Array(sorted);
+}
+
+// builtin function SORT for arrays gets a sorted copy of the array, either natively for arrays of all
+// integers or all strings, or ordered by a comparator returning whether its first argument goes first
+Value sort(std::vector<Value> inputs){
+    if(inputs.size() != 1 && inputs.size() != 2)
+        return newError("wrong number of arguments. expected=1 or 2, got=" + std::to_string(inputs.size()));
+    if(inputs[0].type() != ObjectType::ARRAY_OBJ)
+        return newError("argument to 'sort' must be ARRAY, got " + ObjectTypeToString[inputs[0].type()]);
+    Array* ar = static_cast<Array*>(inputs[0].asObject());
+    if(ar->elements.empty())
+        return new Array(ar->elements);
+    if(inputs.size() == 1)
+        return sortNative(ar);
+
+    Value err = checkCallback("sort", inputs[1], 2);
+    if(!err.empty())
+        return err;
+
+    // the comparator may collect, so positions into the rooted elements are sorted rather than the
+    // values themselves which stable_sort would hold where a collection can't update them
+    std::vector<Value> elements(ar->elements);
+    RootScope inputRoots(&inputs);
+    RootScope elementRoots(&elements);
+    std::vector<size_t> order(elements.size());
+    for(size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    // stable_sort tolerates comparators which aren't a strict weak ordering, once one errors the
+    // rest of the comparisons are skipped and the error is reported
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){
+        if(!err.empty())
+            return false;
+        std::vector<Value> args = {elements[a], elements[b]};
+        Value result = applyFunction(inputs[1], args);
+        if(isError(result)){
+            err = result;
+            return false;
+        }
+        return isTruthy(result);
+    });
+    if(!err.empty())
+        return err;
+    std::vector<Value> sorted;
+    sorted.reserve(order.size());
+    for(size_t i: order)
+        sorted.push_back(elements[i]);
+    return new Array(sorted);
 }
\ No newline at end of file
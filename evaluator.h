@@ -1,107 +1,160 @@
 #ifndef EVALUATOR_H
 #define EVALUATOR_H
 
+#include <unordered_set>
 #include "object.h"
 #include "parser.h"
 #include "environment.h"
 
-// global const vars for True and False
-static BooleanObj TRUE = BooleanObj(true);
-static BooleanObj FALSE = BooleanObj(false);
-static Null NULLOBJ = Null();
-
-
-
-// len function wrapper using Object* 
+// len function wrapper using Value
 // REQUIRES:    input[0] be the actual input to the length function
-Object* objectLength(std::vector<Object*> input);
+Value objectLength(std::vector<Value> input);
 
 // global map for builtin functions
 extern std::unordered_map<std::string, Builtin*> builtins;
 
 // main evaulator function to evaluate the nodes within the AST
-Object* Eval(Node* node, Environment* env);
+Value Eval(Node* node, Environment* env);
 
 // helper function to evaluate a all the statements within a program
-Object* evalProgram(std::vector<Statement*>& stmts, Environment* env);
+Value evalProgram(std::vector<Statement*>& stmts, Environment* env);
 
-//helper function which returns the const vars above
-BooleanObj* nativeBoolToBooleanObject(bool value);
+//helper function which returns the boolean value for a native bool
+Value nativeBoolToBooleanObject(bool value);
 
 // helper function to evaluate prefix expressions
-Object* evalPrefixExpression(std::string op, Object* operand);
+Value evalPrefixExpression(std::string op, Value operand);
 
 // helper function which applies the ! to the operand
-Object* evalBangOperator(Object* operand);
+Value evalBangOperator(Value operand);
 
 // helper function which applies the - operand to negate a number 
-Object* evalMinusPrefixOperator(Object* operand);
+Value evalMinusPrefixOperator(Value operand);
 
 // helper function to evaluate infix statements and return their value
-Object* evalInfixExpression(std::string op, Object* left, Object* right);
+Value evalInfixExpression(std::string op, Value left, Value right);
 
 // helper function to evaluate infix statements of two integers
-Object* evalIntegerInfixExpression(std::string op, Integer* left_int, Integer* right_int);
+Value evalIntegerInfixExpression(std::string op, int left_val, int right_val);
+
+// whether infix and index expressions specialize themselves to the operand types they see, on by default,
+// when off Eval takes the generic paths even for nodes which already specialized
+extern bool quickeningEnabled;
+
+// picks the specialization of an infix expression for the operands it just ran with
+Quickened quickenInfix(const std::string& op, Value left, Value right);
+
+// runs an infix expression specialized to integers without looking at its operator
+// EFFECTS: returns no value if the operands don't fit the specialization, so the node can deoptimize
+Value evalQuickenedInfix(Quickened quickened, Value left, Value right);
+
+// picks the specialization of an index expression for the operands it just ran with
+Quickened quickenIndex(Value left, Value index);
+
+// runs an index expression specialized to an array and integer or a hash and string
+// EFFECTS: returns no value if the operands don't fit the specialization, so the node can deoptimize
+Value evalQuickenedIndex(Quickened quickened, Value left, Value index);
 
 // helper function to evaluate if expressions 
-Object* evalIfExpression(IfExpression* exp, Environment* env);
+Value evalIfExpression(IfExpression* exp, Environment* env);
+
+// helper function to evaluate a while loop, the body runs in one scope reused by every iteration
+Value evalWhileStatement(WhileStatement* stmt, Environment* env);
+
+// helper function to evaluate a for in loop, the body runs in one scope reused by every iteration
+Value evalForStatement(ForStatement* stmt, Environment* env);
 
 // helper function to tell if a condition is truthy or not
-bool isTruthy(Object* obj);
+bool isTruthy(Value value);
 
 // helper function to evaluate a block of statements taking care of returns
-Object* evalBlockStatement(std::vector<Statement*>& stmts, Environment* env);
+Value evalBlockStatement(std::vector<Statement*>& stmts, Environment* env);
 
 // helper function for creating error objects
 Error* newError(std::string message);
 
 // helper function to check if an object is an error
-bool isError(Object* obj);
+bool isError(Value value);
+
+// helper function which records where an error came from if it has no location yet
+// MODIFIES: result if it is an Error without an offset
+// EFFECTS:  returns result, with the offset of node's token if it is an error
+Value locateError(Value result, Node* node);
 
 // helper function which returns the value of an identifier through the enviroment
-Object* evalIdentifier(Identifier* ident, Environment* env);
+Value evalIdentifier(Identifier* ident, Environment* env);
 
 // helper function to evaluate the value of parameters before passing them to functions
-std::vector<Object*> evalExpressions(std::vector<Expression*>& params, Environment* env);
+std::vector<Value> evalExpressions(std::vector<Expression*>& params, Environment* env);
 
 // helper function which evaluates the function body of a func given its parameters
-Object* applyFunction(Object* function, std::vector<Object*>& args);
+Value applyFunction(Value function, std::vector<Value>& args);
 
 // takes in a function* and uses the enviroment to create a new extended enviroment with proper
 // params passed through and returns that
-Environment* extendFunctionEnv(Function* func, std::vector<Object*> args);
+Environment* extendFunctionEnv(Function* func, std::vector<Value> args);
 
 // helper function which unwraps the return value for function evaluation
-Object* unwrapReturnValue(Object* evaluated);
+Value unwrapReturnValue(Value evaluated);
 
 // helper function for doing string concatentation
-Object* evalStringInfixExpression(std::string op, Object* left, Object* right);
+Value evalStringInfixExpression(std::string op, Value left, Value right);
 
 // helper function which checks if its properly an array and integer
-Object* evalIndexExpression(Object* left, Object* index);
+Value evalIndexExpression(Value left, Value index);
 
 // helper which accesses the value of the array 
-Object* evalArrayIndexExpression(Array* left, Integer* index);
+Value evalArrayIndexExpression(Array* left, int index);
 
 // builtin function FIRST for arrays gets the first element of the array
-Object* first(std::vector<Object*> inputs);
+Value first(std::vector<Value> inputs);
 
 // builtin function LAST for arrays gets the last element of the array
-Object* last(std::vector<Object*> inputs);
+Value last(std::vector<Value> inputs);
 
 // builtin function REST for arrays gets a copy of the array with all but first element
-Object* rest(std::vector<Object*> inputs);
+Value rest(std::vector<Value> inputs);
 
 // builtin function PUSH for arrays gets a copy of the array and adds desired element to the end
-Object* push(std::vector<Object*> inputs);
+Value push(std::vector<Value> inputs);
 
 // evaluation function which evaluates a hash literal
-Object* evalHashLiteral(HashLiteral* hashLit, Environment* env);
+Value evalHashLiteral(HashLiteral* hashLit, Environment* env);
 
 // function to evaluate indexing into a hash object
- Object* EvalHashIndexExpression(Hash* hash, Object* index);
+ Value EvalHashIndexExpression(Hash* hash, Value index);
 
  // builtin function puts for printing to the screen
-Object* puts(std::vector<Object*> inputs);
+Value puts(std::vector<Value> inputs);
+
+// arrays with fewer elements than this are mapped and filtered on the calling thread
+static const size_t PARALLEL_MIN_ELEMENTS = 256;
+
+// checks a function only reads the state it can reach and calls nothing with side effects so
+// it can be applied from several threads at once
+bool isPureFunction(Function* func, std::unordered_set<Function*>& visited);
+
+// helper which checks the callback of a higher order builtin is a function taking arity arguments
+// EFFECTS: returns an Error to report or nullptr if the callback can be applied
+Error* checkCallback(std::string name, Value callback, size_t arity);
+
+// builtin function MAP for arrays gets a new array of the callback applied to each element
+Value map(std::vector<Value> inputs);
+
+// builtin function FILTER for arrays gets a new array of the elements the callback is truthy for
+Value filter(std::vector<Value> inputs);
+
+// builtin function REDUCE for arrays folds the callback over the elements starting from initial
+Value reduce(std::vector<Value> inputs);
+
+// builtin function PMAP, map which splits large arrays across the thread pool when the callback is pure
+Value pmap(std::vector<Value> inputs);
+
+// builtin function PFILTER, filter which splits large arrays across the thread pool when the callback is pure
+Value pfilter(std::vector<Value> inputs);
+
+// builtin function SORT for arrays gets a sorted copy of the array, either natively for arrays of all
+// integers or all strings, or ordered by a comparator returning whether its first argument goes first
+Value sort(std::vector<Value> inputs);
 
 #endif
\ No newline at end of file
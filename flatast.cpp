@@ -0,0 +1,621 @@
+// definitions for flatast.h
+
+#include "flatast.h"
+#include <algorithm>
+#include <cstring>
+#include <typeinfo>
+
+// builds the flat encoding of program
+FlatAst::FlatAst(Program* program){
+    add(program);
+    stringIndexes = {}; // only needed while building
+    pending = {};
+    quickenings = std::vector<std::atomic<Quickened>>(kinds.size()); // value initialized, so UNSEEN
+}
+
+// returns the number of nodes
+size_t FlatAst::size() const{
+    return kinds.size();
+}
+
+// returns the index of the Program node
+uint32_t FlatAst::root() const{
+    return (uint32_t)(kinds.size() - 1);
+}
+
+// returns the kind of node
+NodeKind FlatAst::kind(uint32_t node) const{
+    return kinds[node];
+}
+
+// returns the specialization evalFlat picked for node
+std::atomic<Quickened>& FlatAst::quickened(uint32_t node) const{
+    return quickenings[node];
+}
+
+// returns the source offset of the token of node
+uint32_t FlatAst::offset(uint32_t node) const{
+    return offsets[node];
+}
+
+// returns the type of the token of node
+TokenType FlatAst::tokenType(uint32_t node) const{
+    return tokenTypes[node];
+}
+
+// returns the literal of the token of node
+const std::string& FlatAst::literal(uint32_t node) const{
+    return strings[literals[node]];
+}
+
+// returns the value of an integer literal, or 1 or 0 for a boolean
+int FlatAst::value(uint32_t node) const{
+    return values[node];
+}
+
+// returns the children of node
+FlatAst::ChildRange FlatAst::children(uint32_t node) const{
+    const uint32_t* first = childIndexes.data() + firstChild[node];
+    return ChildRange{first, first + childCounts[node]};
+}
+
+// helper which interns a token literal into strings
+uint32_t FlatAst::intern(const std::string& literal){
+    auto it = stringIndexes.find(literal);
+    if(it != stringIndexes.end())
+        return it->second;
+    uint32_t index = (uint32_t)strings.size();
+    strings.push_back(literal);
+    stringIndexes.emplace(literal, index);
+    return index;
+}
+
+// helper which appends a node of kind whose children are the indexes in pending after mark
+uint32_t FlatAst::append(NodeKind kind, const Token& token, int value, size_t mark){
+    kinds.push_back(kind);
+    tokenTypes.push_back(token.type);
+    offsets.push_back(token.offset);
+    literals.push_back(intern(token.literal));
+    values.push_back(value);
+    firstChild.push_back((uint32_t)childIndexes.size());
+    childCounts.push_back((uint32_t)(pending.size() - mark));
+    childIndexes.insert(childIndexes.end(), pending.begin() + (std::ptrdiff_t)mark, pending.end());
+    pending.resize(mark);
+    return (uint32_t)(kinds.size() - 1);
+}
+
+// helper which appends node after its children and returns its index
+uint32_t FlatAst::add(Node* node){
+    if(node == nullptr)
+        return NO_NODE;
+    const std::type_info& node_type = typeid(*node);
+    size_t mark = pending.size(); // the children of node are pushed after this
+    NodeKind kind;
+    int value = 0;
+
+    if(node_type == typeid(Program)){
+        kind = NodeKind::PROGRAM;
+        for(Statement* stmt: dynamic_cast<Program*>(node)->statements)
+            pending.push_back(add(stmt));
+    }
+    else if(node_type == typeid(LetStatement)){
+        LetStatement* letStmt = dynamic_cast<LetStatement*>(node);
+        kind = NodeKind::LET;
+        pending.push_back(add(letStmt->name));
+        pending.push_back(add(letStmt->expressionValue));
+    }
+    else if(node_type == typeid(ReturnStatement)){
+        kind = NodeKind::RETURN;
+        pending.push_back(add(dynamic_cast<Statement*>(node)->expressionValue));
+    }
+    else if(node_type == typeid(ExpressionStatement)){
+        kind = NodeKind::EXPRESSION_STATEMENT;
+        pending.push_back(add(dynamic_cast<Statement*>(node)->expressionValue));
+    }
+    else if(node_type == typeid(BlockStatement)){
+        kind = NodeKind::BLOCK;
+        for(Statement* stmt: dynamic_cast<BlockStatement*>(node)->statements)
+            pending.push_back(add(stmt));
+    }
+    else if(node_type == typeid(AssignStatement)){
+        AssignStatement* assignStmt = dynamic_cast<AssignStatement*>(node);
+        kind = NodeKind::ASSIGN;
+        pending.push_back(add(assignStmt->name));
+        pending.push_back(add(assignStmt->expressionValue));
+    }
+    else if(node_type == typeid(WhileStatement)){
+        WhileStatement* whileStmt = dynamic_cast<WhileStatement*>(node);
+        kind = NodeKind::WHILE;
+        pending.push_back(add(whileStmt->expressionValue));
+        pending.push_back(add(whileStmt->body));
+    }
+    else if(node_type == typeid(ForStatement)){
+        ForStatement* forStmt = dynamic_cast<ForStatement*>(node);
+        kind = NodeKind::FOR;
+        pending.push_back(add(forStmt->iterator));
+        pending.push_back(add(forStmt->expressionValue));
+        pending.push_back(add(forStmt->body));
+    }
+    else if(node_type == typeid(Identifier)){
+        kind = NodeKind::IDENTIFIER;
+    }
+    else if(node_type == typeid(IntegerLiteral)){
+        kind = NodeKind::INTEGER;
+        value = dynamic_cast<IntegerLiteral*>(node)->value;
+    }
+    else if(node_type == typeid(StringLiteral)){
+        kind = NodeKind::STRING;
+    }
+    else if(node_type == typeid(Boolean)){
+        kind = NodeKind::BOOLEAN;
+        value = dynamic_cast<Boolean*>(node)->value;
+    }
+    else if(node_type == typeid(PrefixExpression)){
+        kind = NodeKind::PREFIX;
+        pending.push_back(add(dynamic_cast<PrefixExpression*>(node)->right));
+    }
+    else if(node_type == typeid(InfixExpression)){
+        InfixExpression* infixExp = dynamic_cast<InfixExpression*>(node);
+        kind = NodeKind::INFIX;
+        pending.push_back(add(infixExp->left));
+        pending.push_back(add(infixExp->right));
+    }
+    else if(node_type == typeid(IfExpression)){
+        IfExpression* ifExp = dynamic_cast<IfExpression*>(node);
+        kind = NodeKind::IF;
+        pending.push_back(add(ifExp->condition));
+        pending.push_back(add(ifExp->consequence));
+        pending.push_back(add(ifExp->alternative));
+    }
+    else if(node_type == typeid(FunctionLiteral)){
+        FunctionLiteral* funcLit = dynamic_cast<FunctionLiteral*>(node);
+        kind = NodeKind::FUNCTION;
+        for(Identifier* param: funcLit->parameters)
+            pending.push_back(add(param));
+        pending.push_back(add(funcLit->body));
+    }
+    else if(node_type == typeid(CallExpression)){
+        CallExpression* callExp = dynamic_cast<CallExpression*>(node);
+        kind = NodeKind::CALL;
+        pending.push_back(add(callExp->function));
+        for(Expression* argument: callExp->arguments)
+            pending.push_back(add(argument));
+    }
+    else if(node_type == typeid(ArrayLiteral)){
+        kind = NodeKind::ARRAY;
+        for(Expression* element: dynamic_cast<ArrayLiteral*>(node)->elements)
+            pending.push_back(add(element));
+    }
+    else if(node_type == typeid(IndexExpression)){
+        IndexExpression* indexExp = dynamic_cast<IndexExpression*>(node);
+        kind = NodeKind::INDEX;
+        pending.push_back(add(indexExp->left));
+        pending.push_back(add(indexExp->index));
+    }
+    else if(node_type == typeid(HashLiteral)){
+        kind = NodeKind::HASH;
+        for(auto& pair: dynamic_cast<HashLiteral*>(node)->pairs){
+            pending.push_back(add(pair.first));
+            pending.push_back(add(pair.second));
+        }
+    }
+    else
+        return NO_NODE;
+
+    return append(kind, node->token, value, mark);
+}
+
+// returns the same string as toString() on the node it was built from
+std::string FlatAst::toString(uint32_t node) const{
+    if(node == NO_NODE)
+        return "";
+    ChildRange child = children(node);
+    std::string output;
+    switch(kinds[node]){
+        case NodeKind::PROGRAM:
+        case NodeKind::BLOCK:
+            for(uint32_t stmt: child)
+                output += toString(stmt);
+            return output;
+        case NodeKind::LET:
+            return literal(node) + " " + toString(child[0]) + " = " + toString(child[1]) + ";";
+        case NodeKind::RETURN:
+            return literal(node) + " " + toString(child[0]) + ";";
+        case NodeKind::EXPRESSION_STATEMENT:
+            return toString(child[0]);
+        case NodeKind::ASSIGN:
+            return toString(child[0]) + " = " + toString(child[1]) + ";";
+        case NodeKind::WHILE:
+            return "while" + toString(child[0]) + " " + toString(child[1]);
+        case NodeKind::FOR:
+            return "for(" + toString(child[0]) + " in " + toString(child[1]) + ") " + toString(child[2]);
+        case NodeKind::IDENTIFIER:
+        case NodeKind::INTEGER:
+        case NodeKind::STRING:
+        case NodeKind::BOOLEAN:
+            return literal(node);
+        case NodeKind::PREFIX:
+            return "(" + literal(node) + " " + toString(child[0]) + ")";
+        case NodeKind::INFIX:
+            return "(" + toString(child[0]) + " " + literal(node) + " " + toString(child[1]) + ")";
+        case NodeKind::IF:
+            output = "if" + toString(child[0]) + " " + toString(child[1]);
+            if(child[2] != NO_NODE)
+                output += " else " + toString(child[2]);
+            return output;
+        case NodeKind::FUNCTION:
+            output = literal(node) + "(";
+            for(size_t i = 0; i + 1 < child.size(); i++){
+                output += toString(child[i]);
+                if(i + 2 < child.size())
+                    output += ", ";
+            }
+            return output + ")" + toString(child[child.size() - 1]);
+        case NodeKind::CALL:
+            output = toString(child[0]) + "(";
+            for(size_t i = 1; i < child.size(); i++){
+                output += toString(child[i]);
+                if(i + 1 < child.size())
+                    output += ", ";
+            }
+            return output + ")";
+        case NodeKind::ARRAY:
+            output = "[";
+            for(size_t i = 0; i < child.size(); i++){
+                output += toString(child[i]);
+                if(i + 1 < child.size())
+                    output += ", ";
+            }
+            return output + "]";
+        case NodeKind::INDEX:
+            return "(" + toString(child[0]) + "[" + toString(child[1]) + "])";
+        case NodeKind::HASH:
+            output = "{";
+            for(size_t i = 0; i < child.size(); i += 2){
+                output += toString(child[i]) + ":" + toString(child[i + 1]);
+                if(i + 2 < child.size())
+                    output += ", ";
+            }
+            return output + "}";
+    }
+    return output;
+}
+
+// returns the same string as toString() on the program it was built from
+std::string FlatAst::toString() const{
+    if(kinds.empty())
+        return "";
+    return toString(root());
+}
+
+// returns the token of node
+Token FlatAst::token(uint32_t node) const{
+    return Token(tokenTypes[node], literal(node), offsets[node]);
+}
+
+// helpers which rebuild node and its children as pointer nodes, wellFormed checked every child is of a
+// kind its slot allows so the casts need no checks of their own
+Expression* FlatAst::toExpression(uint32_t node) const{
+    return static_cast<Expression*>(toNode(node));
+}
+
+Statement* FlatAst::toStatement(uint32_t node) const{
+    return static_cast<Statement*>(toNode(node));
+}
+
+Identifier* FlatAst::toIdentifier(uint32_t node) const{
+    return static_cast<Identifier*>(toNode(node));
+}
+
+BlockStatement* FlatAst::toBlock(uint32_t node) const{
+    return static_cast<BlockStatement*>(toNode(node));
+}
+
+// rebuilds node and everything below it as pointer nodes
+Node* FlatAst::toNode(uint32_t node) const{
+    if(node == NO_NODE)
+        return nullptr;
+    ChildRange child = children(node);
+    switch(kinds[node]){
+        case NodeKind::PROGRAM: {
+            Program* program = new Program();
+            program->token = token(node);
+            program->statements.reserve(child.size());
+            for(uint32_t stmt: child)
+                program->statements.push_back(toStatement(stmt));
+            return program;
+        }
+        case NodeKind::LET: {
+            LetStatement* letStmt = new LetStatement(token(node));
+            letStmt->name = toIdentifier(child[0]);
+            letStmt->expressionValue = toExpression(child[1]);
+            nameFunctionLiteral(letStmt);
+            return letStmt;
+        }
+        case NodeKind::RETURN: {
+            ReturnStatement* returnStmt = new ReturnStatement(token(node));
+            returnStmt->expressionValue = toExpression(child[0]);
+            return returnStmt;
+        }
+        case NodeKind::EXPRESSION_STATEMENT: {
+            ExpressionStatement* expStmt = new ExpressionStatement(token(node));
+            expStmt->expressionValue = toExpression(child[0]);
+            return expStmt;
+        }
+        case NodeKind::BLOCK: {
+            BlockStatement* block = new BlockStatement(token(node));
+            block->statements.reserve(child.size());
+            for(uint32_t stmt: child)
+                block->statements.push_back(toStatement(stmt));
+            return block;
+        }
+        case NodeKind::ASSIGN: {
+            AssignStatement* assignStmt = new AssignStatement(token(node), toIdentifier(child[0]));
+            assignStmt->expressionValue = toExpression(child[1]);
+            return assignStmt;
+        }
+        case NodeKind::WHILE: {
+            WhileStatement* whileStmt = new WhileStatement(token(node));
+            whileStmt->expressionValue = toExpression(child[0]);
+            whileStmt->body = toBlock(child[1]);
+            return whileStmt;
+        }
+        case NodeKind::FOR: {
+            ForStatement* forStmt = new ForStatement(token(node));
+            forStmt->iterator = toIdentifier(child[0]);
+            forStmt->expressionValue = toExpression(child[1]);
+            forStmt->body = toBlock(child[2]);
+            return forStmt;
+        }
+        case NodeKind::IDENTIFIER:
+            return new Identifier(token(node), literal(node));
+        case NodeKind::INTEGER: {
+            IntegerLiteral* intLit = new IntegerLiteral(token(node));
+            intLit->value = values[node];
+            return intLit;
+        }
+        case NodeKind::STRING:
+            return new StringLiteral(token(node), literal(node));
+        case NodeKind::BOOLEAN:
+            return new Boolean(token(node), values[node] != 0);
+        case NodeKind::PREFIX: {
+            PrefixExpression* prefixExp = new PrefixExpression(token(node), literal(node));
+            prefixExp->right = toExpression(child[0]);
+            return prefixExp;
+        }
+        case NodeKind::INFIX: {
+            InfixExpression* infixExp = new InfixExpression(token(node), literal(node), toExpression(child[0]));
+            infixExp->right = toExpression(child[1]);
+            return infixExp;
+        }
+        case NodeKind::IF: {
+            IfExpression* ifExp = new IfExpression(token(node));
+            ifExp->condition = toExpression(child[0]);
+            ifExp->consequence = toBlock(child[1]);
+            ifExp->alternative = toBlock(child[2]);
+            return ifExp;
+        }
+        case NodeKind::FUNCTION: {
+            FunctionLiteral* funcLit = new FunctionLiteral(token(node));
+            funcLit->parameters.reserve(child.size() - 1);
+            for(size_t i = 0; i + 1 < child.size(); i++)
+                funcLit->parameters.push_back(toIdentifier(child[i]));
+            funcLit->body = toBlock(child[child.size() - 1]);
+            return funcLit;
+        }
+        case NodeKind::CALL: {
+            CallExpression* callExp = new CallExpression(token(node), toExpression(child[0]));
+            callExp->arguments.reserve(child.size() - 1);
+            for(size_t i = 1; i < child.size(); i++)
+                callExp->arguments.push_back(toExpression(child[i]));
+            return callExp;
+        }
+        case NodeKind::ARRAY: {
+            ArrayLiteral* array = new ArrayLiteral(token(node));
+            array->elements.reserve(child.size());
+            for(uint32_t element: child)
+                array->elements.push_back(toExpression(element));
+            return array;
+        }
+        case NodeKind::INDEX: {
+            IndexExpression* indexExp = new IndexExpression(token(node), toExpression(child[0]));
+            indexExp->index = toExpression(child[1]);
+            return indexExp;
+        }
+        case NodeKind::HASH: {
+            HashLiteral* hashLit = new HashLiteral(token(node));
+            for(size_t i = 0; i < child.size(); i += 2)
+                hashLit->pairs[toExpression(child[i])] = toExpression(child[i + 1]);
+            return hashLit;
+        }
+    }
+    return nullptr;
+}
+
+// rebuilds the whole pointer based tree
+Program* FlatAst::toProgram() const{
+    if(kinds.empty())
+        return new Program();
+    return static_cast<Program*>(toNode(root()));
+}
+
+// helper which appends the raw bytes of values to out
+template <typename T>
+static void appendArray(std::string& out, const std::vector<T>& values){
+    out.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+// helper which copies count values out of data, advancing it
+// EFFECTS:  returns false if fewer than count values are left before end
+template <typename T>
+static bool readArray(const char*& data, const char* end, size_t count, std::vector<T>& values){
+    if((size_t)(end - data) / sizeof(T) < count)
+        return false;
+    values.resize(count);
+    std::memcpy(values.data(), data, count * sizeof(T));
+    data += count * sizeof(T);
+    return true;
+}
+
+// appends the arrays of the tree to out
+void FlatAst::serialize(std::string& out) const{
+    out.reserve(out.size() + kinds.size() * 18 + childIndexes.size() * 4 + strings.size() * 8);
+    std::vector<uint32_t> counts = {(uint32_t)kinds.size(), (uint32_t)childIndexes.size(), (uint32_t)strings.size()};
+    std::vector<uint32_t> lengths;
+    for(const std::string& str: strings)
+        lengths.push_back((uint32_t)str.size());
+    appendArray(out, counts);
+    appendArray(out, kinds);
+    appendArray(out, tokenTypes);
+    appendArray(out, offsets);
+    appendArray(out, literals);
+    appendArray(out, values);
+    appendArray(out, childCounts); // firstChild is their running total so isn't stored
+    appendArray(out, childIndexes);
+    appendArray(out, lengths);
+    for(const std::string& str: strings)
+        out += str;
+}
+
+// replaces the tree with one serialize wrote into data
+bool FlatAst::deserialize(const char* data, size_t length){
+    *this = FlatAst();
+    const char* end = data + length;
+    std::vector<uint32_t> counts;
+    std::vector<uint32_t> lengths;
+    bool read = readArray(data, end, 3, counts) &&
+                readArray(data, end, counts[0], kinds) &&
+                readArray(data, end, counts[0], tokenTypes) &&
+                readArray(data, end, counts[0], offsets) &&
+                readArray(data, end, counts[0], literals) &&
+                readArray(data, end, counts[0], values) &&
+                readArray(data, end, counts[0], childCounts) &&
+                readArray(data, end, counts[1], childIndexes) &&
+                readArray(data, end, counts[2], lengths);
+    if(read){
+        uint64_t total = 0;
+        firstChild.resize(kinds.size());
+        for(size_t node = 0; node < kinds.size(); node++){
+            firstChild[node] = (uint32_t)std::min<uint64_t>(total, UINT32_MAX);
+            total += childCounts[node];
+        }
+        read = total == childIndexes.size();
+    }
+    if(read){
+        for(uint32_t size: lengths){
+            if((size_t)(end - data) < size){
+                read = false;
+                break;
+            }
+            strings.emplace_back(data, size);
+            data += size;
+        }
+    }
+    if(!read || data != end || !wellFormed()){
+        *this = FlatAst();
+        return false;
+    }
+    quickenings = std::vector<std::atomic<Quickened>>(kinds.size());
+    return true;
+}
+
+// helper which returns the bit for kind in a set of kinds
+static constexpr uint32_t kindBit(NodeKind kind){
+    return 1u << (unsigned)kind;
+}
+
+// sets of the kinds which can fill each slot of a node
+static const uint32_t IDENTIFIER_KINDS = kindBit(NodeKind::IDENTIFIER);
+static const uint32_t BLOCK_KINDS = kindBit(NodeKind::BLOCK);
+static const uint32_t STATEMENT_KINDS = kindBit(NodeKind::LET) | kindBit(NodeKind::RETURN) |
+    kindBit(NodeKind::EXPRESSION_STATEMENT) | kindBit(NodeKind::BLOCK) | kindBit(NodeKind::ASSIGN) |
+    kindBit(NodeKind::WHILE) | kindBit(NodeKind::FOR);
+static const uint32_t EXPRESSION_KINDS = kindBit(NodeKind::IDENTIFIER) | kindBit(NodeKind::INTEGER) |
+    kindBit(NodeKind::STRING) | kindBit(NodeKind::BOOLEAN) | kindBit(NodeKind::PREFIX) | kindBit(NodeKind::INFIX) |
+    kindBit(NodeKind::IF) | kindBit(NodeKind::FUNCTION) | kindBit(NodeKind::CALL) | kindBit(NodeKind::ARRAY) |
+    kindBit(NodeKind::INDEX) | kindBit(NodeKind::HASH);
+
+// helper which checks every index is in bounds and every node has the children its kind needs
+bool FlatAst::wellFormed() const{
+    for(size_t node = 0; node < kinds.size(); node++){
+        if(kinds[node] > NodeKind::LAST || tokenTypes[node] > TokenType::LAST || literals[node] >= strings.size())
+            return false;
+        if(firstChild[node] > childIndexes.size() || childCounts[node] > childIndexes.size() - firstChild[node])
+            return false;
+        ChildRange child = children((uint32_t)node);
+        for(uint32_t index: child){
+            if(index != NO_NODE && index >= node) // children come before their parents
+                return false;
+        }
+
+        // checks child i is one of allowed, or missing if it is optional
+        auto slot = [&](size_t i, bool optional, uint32_t allowed){
+            if(child[i] == NO_NODE)
+                return optional;
+            return (kindBit(kinds[child[i]]) & allowed) != 0;
+        };
+        // checks children from first onwards are all one of allowed
+        auto slots = [&](size_t first, bool optional, uint32_t allowed){
+            for(size_t i = first; i < child.size(); i++){
+                if(!slot(i, optional, allowed))
+                    return false;
+            }
+            return true;
+        };
+
+        bool valid = false;
+        switch(kinds[node]){
+            case NodeKind::PROGRAM:
+            case NodeKind::BLOCK:
+                valid = slots(0, false, STATEMENT_KINDS);
+                break;
+            case NodeKind::LET:
+            case NodeKind::ASSIGN:
+                valid = child.size() == 2 && slot(0, false, IDENTIFIER_KINDS) && slot(1, true, EXPRESSION_KINDS);
+                break;
+            case NodeKind::RETURN:
+            case NodeKind::EXPRESSION_STATEMENT:
+            case NodeKind::PREFIX:
+                valid = child.size() == 1 && slot(0, true, EXPRESSION_KINDS);
+                break;
+            case NodeKind::WHILE:
+                valid = child.size() == 2 && slot(0, true, EXPRESSION_KINDS) && slot(1, true, BLOCK_KINDS);
+                break;
+            case NodeKind::FOR:
+                valid = child.size() == 3 && slot(0, true, IDENTIFIER_KINDS) && slot(1, true, EXPRESSION_KINDS) &&
+                        slot(2, true, BLOCK_KINDS);
+                break;
+            case NodeKind::IDENTIFIER:
+            case NodeKind::INTEGER:
+            case NodeKind::STRING:
+            case NodeKind::BOOLEAN:
+                valid = child.size() == 0;
+                break;
+            case NodeKind::INFIX:
+            case NodeKind::INDEX:
+                valid = child.size() == 2 && slots(0, true, EXPRESSION_KINDS);
+                break;
+            case NodeKind::IF:
+                valid = child.size() == 3 && slot(0, true, EXPRESSION_KINDS) && slot(1, true, BLOCK_KINDS) &&
+                        slot(2, true, BLOCK_KINDS);
+                break;
+            case NodeKind::FUNCTION: // parameters then the body
+                valid = child.size() >= 1 && slot(child.size() - 1, true, BLOCK_KINDS);
+                for(size_t i = 0; valid && i + 1 < child.size(); i++)
+                    valid = slot(i, false, IDENTIFIER_KINDS);
+                break;
+            case NodeKind::CALL:
+                valid = child.size() >= 1 && slots(0, true, EXPRESSION_KINDS);
+                break;
+            case NodeKind::ARRAY:
+                valid = slots(0, true, EXPRESSION_KINDS);
+                break;
+            case NodeKind::HASH:
+                valid = child.size() % 2 == 0 && slots(0, true, EXPRESSION_KINDS);
+                break;
+        }
+        if(!valid)
+            return false;
+    }
+    return kinds.empty() || kinds.back() == NodeKind::PROGRAM;
+}
@@ -0,0 +1,160 @@
+// flat encoding of the Abstract Syntax Tree, nodes live in parallel arrays addressed by index
+
+#ifndef FLATAST_H
+#define FLATAST_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast.h"
+
+// kind of each node, one for each of the node classes in ast.h
+enum class NodeKind : uint8_t {
+    PROGRAM,
+    LET, // children: name, value
+    RETURN, // children: value
+    EXPRESSION_STATEMENT, // children: expression
+    BLOCK, // children: statements
+    ASSIGN, // children: name, value
+    WHILE, // children: condition, body
+    FOR, // children: iterator, iterable, body
+    IDENTIFIER,
+    INTEGER,
+    STRING,
+    BOOLEAN,
+    PREFIX, // children: right
+    INFIX, // children: left, right
+    IF, // children: condition, consequence, alternative
+    FUNCTION, // children: parameters then body
+    CALL, // children: function then arguments
+    ARRAY, // children: elements
+    INDEX, // children: left, index
+    HASH, // children: each key followed by its value
+    LAST = HASH, // the highest kind, kept the last one listed so kinds read back from files can be range checked
+};
+
+// index of a child which is missing, like the alternative of an if without an else
+static const uint32_t NO_NODE = UINT32_MAX;
+
+// Abstract Syntax Tree stored as a structure of arrays, node i is described by kinds[i], offsets[i]
+// and so on, and its children are the node indexes childIndexes[firstChild[i]] onwards. Nodes are
+// stored children first so the root is the last node
+class FlatAst {
+    public:
+        // range of the children of a node which can be used in a range based for loop
+        struct ChildRange {
+            const uint32_t* first;
+            const uint32_t* last;
+
+            const uint32_t* begin() const { return first; }
+            const uint32_t* end() const { return last; }
+            size_t size() const { return (size_t)(last - first); }
+            uint32_t operator[](size_t i) const { return first[i]; }
+        };
+
+        // default constructor, an empty tree
+        FlatAst(){}
+
+        // builds the flat encoding of program
+        // EFFECTS:  creates a FlatAst with the same nodes as program, program is left unchanged
+        FlatAst(Program* program);
+
+        // returns the number of nodes
+        size_t size() const;
+
+        // returns the index of the Program node
+        // REQUIRES: the tree is not empty
+        uint32_t root() const;
+
+        // returns the kind of node
+        NodeKind kind(uint32_t node) const;
+
+        // returns the source offset of the token of node
+        uint32_t offset(uint32_t node) const;
+
+        // returns the type of the token of node
+        TokenType tokenType(uint32_t node) const;
+
+        // returns the literal of the token of node, which is also the name of identifiers, the contents of
+        // strings and the operator of prefix and infix expressions
+        const std::string& literal(uint32_t node) const;
+
+        // returns the value of an integer literal, or 1 or 0 for a boolean
+        int value(uint32_t node) const;
+
+        // returns the children of node, some of which may be NO_NODE
+        ChildRange children(uint32_t node) const;
+
+        // returns the same string as toString() on the node it was built from, or "" for NO_NODE
+        std::string toString(uint32_t node) const;
+
+        // returns the same string as toString() on the program it was built from
+        std::string toString() const;
+
+        // rebuilds the whole pointer based tree, allocating every node again, for code which walks Nodes like
+        // Eval and the profilers, evalFlat in flateval.h evaluates the flat tree without rebuilding it
+        // EFFECTS:  returns a new Program owned by the caller
+        Program* toProgram() const;
+
+        // rebuilds node and everything below it as pointer nodes, like the function literal the purity
+        // check of pmap and pfilter walks
+        // EFFECTS:  returns a new Node owned by the caller, or nullptr for NO_NODE
+        Node* toNode(uint32_t node) const;
+
+        // returns the specialization evalFlat picked for node, an infix or index expression, which is
+        // UNSEEN until it is first evaluated, the same as the quickened field of the Node it was built from
+        std::atomic<Quickened>& quickened(uint32_t node) const;
+
+        // version of the layout serialize writes, bumped whenever it or NodeKind changes
+        static const uint32_t FORMAT_VERSION = 1;
+
+        // appends the arrays of the tree to out in the host's byte order
+        void serialize(std::string& out) const;
+
+        // replaces the tree with one serialize wrote into data
+        // EFFECTS:  returns false and leaves the tree empty if data is truncated or does not describe a
+        //           well formed tree, so a corrupt file can't crash toProgram
+        bool deserialize(const char* data, size_t length);
+
+    private:
+        // helper which appends node after its children and returns its index
+        uint32_t add(Node* node);
+
+        // helper which appends a node of kind whose children are the indexes in pending after mark
+        uint32_t append(NodeKind kind, const Token& token, int value, size_t mark);
+
+        // helper which interns a token literal into strings
+        uint32_t intern(const std::string& literal);
+
+        // helpers which rebuild node and its children as pointer nodes
+        Expression* toExpression(uint32_t node) const;
+        Statement* toStatement(uint32_t node) const;
+        Identifier* toIdentifier(uint32_t node) const;
+        BlockStatement* toBlock(uint32_t node) const;
+
+        // returns the token of node
+        Token token(uint32_t node) const;
+
+        // helper which checks every index is in bounds and every node has the children its kind needs
+        bool wellFormed() const;
+
+        //vars, one entry per node
+        std::vector<NodeKind> kinds;
+        std::vector<TokenType> tokenTypes;
+        std::vector<uint32_t> offsets; // byte offset of the node's token in its source
+        std::vector<uint32_t> literals; // index into strings of the token literal
+        std::vector<int32_t> values; // integer literal value, or 1 and 0 for booleans
+        std::vector<uint32_t> firstChild; // start of the node's children in childIndexes
+        std::vector<uint32_t> childCounts;
+        mutable std::vector<std::atomic<Quickened>> quickenings; // atomic as parallel builtins share functions
+
+        //vars, shared between nodes
+        std::vector<uint32_t> childIndexes; // children of every node, each node's children are contiguous
+        std::vector<std::string> strings; // each distinct token literal once
+        std::unordered_map<std::string, uint32_t> stringIndexes; // index of each string, only used while building
+        std::vector<uint32_t> pending; // children of the nodes being added, only used while building
+};
+
+#endif // FLATAST_H
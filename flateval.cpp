@@ -0,0 +1,287 @@
+// definitions for flateval.h
+
+#include "flateval.h"
+#include <typeinfo>
+#include "evaluator.h"
+#include "heap.h"
+
+// helper which checks if value is an object of class T, only for classes which are never unboxed
+template<class T>
+static bool holds(Value value){
+    return value.isObject() && typeid(*value.asObject()) == typeid(T);
+}
+
+// helper which records where an error came from if it has no location yet, like locateError
+static Value locate(Value result, const FlatAst& flat, uint32_t node){
+    if(isError(result)){
+        Error* error = static_cast<Error*>(result.asObject());
+        if(error->offset == UNKNOWN_OFFSET)
+            error->offset = flat.offset(node);
+    }
+    return result;
+}
+
+// helper which evaluates the statements of a PROGRAM node, like evalProgram
+static Value evalFlatProgram(const FlatAst& flat, uint32_t node, Environment* env){
+    RootScope roots(env);
+    Value result;
+    for(uint32_t stmt: flat.children(node)){
+        safePoint(); // the previous statement's result is no longer needed
+        result = evalFlat(flat, stmt, env);
+
+        if(holds<ReturnValue>(result))
+            return static_cast<ReturnValue*>(result.asObject())->value;
+        if(holds<Error>(result))
+            return result;
+    }
+    return result;
+}
+
+// helper which evaluates the statements of a BLOCK node, like evalBlockStatement
+static Value evalFlatBlock(const FlatAst& flat, uint32_t node, Environment* env){
+    Value result;
+    for(uint32_t stmt: flat.children(node)){
+        result = evalFlat(flat, stmt, env);
+        if(holds<ReturnValue>(result) || holds<Error>(result))
+            return result;
+    }
+    return result;
+}
+
+// helper which evaluates the children of node from first on, like evalExpressions
+static std::vector<Value> evalFlatExpressions(const FlatAst& flat, uint32_t node, size_t first, Environment* env){
+    FlatAst::ChildRange child = flat.children(node);
+    std::vector<Value> result;
+    RootScope roots(&result); // the expressions after the first may collect
+    for(size_t i = first; i < child.size(); i++){
+        Value evaluated = evalFlat(flat, child[i], env);
+        if(isError(evaluated))
+            return {evaluated};
+        result.push_back(evaluated);
+    }
+    return result;
+}
+
+// helper which evaluates a WHILE node, like evalWhileStatement
+static Value evalFlatWhile(const FlatAst& flat, uint32_t node, Environment* env){
+    FlatAst::ChildRange child = flat.children(node);
+    Environment* loopEnv = new Environment(env);
+    RootScope roots(loopEnv);
+    while(true){
+        safePoint();
+        Value condition = evalFlat(flat, child[0], env);
+        if(isError(condition))
+            return condition;
+        if(!isTruthy(condition))
+            return Value();
+
+        Value result = evalFlatBlock(flat, child[1], loopEnv);
+        if(holds<ReturnValue>(result) || holds<Error>(result))
+            return result;
+    }
+}
+
+// helper which evaluates a FOR node, like evalForStatement
+static Value evalFlatFor(const FlatAst& flat, uint32_t node, Environment* env){
+    FlatAst::ChildRange child = flat.children(node);
+    Value iterable = evalFlat(flat, child[1], env);
+    if(isError(iterable))
+        return iterable;
+    if(iterable.type() != ObjectType::ARRAY_OBJ)
+        return newError("for loop can only iterate over ARRAY, got " + ObjectTypeToString[iterable.type()]);
+
+    Environment* loopEnv = new Environment(env);
+    RootScope roots(loopEnv, &iterable);
+    for(size_t i = 0; i < static_cast<Array*>(iterable.asObject())->elements.size(); i++){
+        safePoint(); // may move the array, so it is found through iterable every iteration
+        loopEnv->set(flat.literal(child[0]), static_cast<Array*>(iterable.asObject())->elements[i]);
+        Value result = evalFlatBlock(flat, child[2], loopEnv);
+        if(holds<ReturnValue>(result) || holds<Error>(result))
+            return result;
+    }
+    return Value();
+}
+
+// helper which evaluates a HASH node, like evalHashLiteral
+static Value evalFlatHash(const FlatAst& flat, uint32_t node, Environment* env){
+    FlatAst::ChildRange child = flat.children(node);
+    Value hash = new Hash();
+    RootScope roots(&hash); // the pairs may collect, so the hash is found through hash after each
+
+    for(size_t i = 0; i < child.size(); i += 2){
+        Value key = evalFlat(flat, child[i], env);
+        if(isError(key))
+            return key;
+        if(!key.hashable())
+            return newError("unusable as hash key. type=" + ObjectTypeToString[key.type()]);
+
+        RootScope keyRoots(&key);
+        Value value = evalFlat(flat, child[i + 1], env);
+        if(isError(value))
+            return value;
+
+        Hash* newHash = static_cast<Hash*>(hash.asObject());
+        newHash->pairs[key.hashKey()] = HashPair{key, value};
+        writeBarrier(newHash, key);
+        writeBarrier(newHash, value);
+    }
+    return hash;
+}
+
+// evaluates node of flat and everything below it in env
+Value evalFlat(const FlatAst& flat, uint32_t node, Environment* env){
+    FlatAst::ChildRange child = flat.children(node);
+    switch(flat.kind(node)){
+        //statements
+        case NodeKind::PROGRAM:
+            return evalFlatProgram(flat, node, env);
+        case NodeKind::LET: {
+            Value val = evalFlat(flat, child[1], env);
+            if(isError(val))
+                return val;
+            env->set(flat.literal(child[0]), val);
+            return Value();
+        }
+        case NodeKind::RETURN: {
+            Value result = evalFlat(flat, child[0], env);
+            if(isError(result))
+                return result;
+            return new ReturnValue(result);
+        }
+        case NodeKind::EXPRESSION_STATEMENT:
+            return evalFlat(flat, child[0], env);
+        case NodeKind::BLOCK:
+            return evalFlatBlock(flat, node, env);
+        case NodeKind::ASSIGN: {
+            Value val = evalFlat(flat, child[1], env);
+            if(isError(val))
+                return val;
+            if(!env->assign(flat.literal(child[0]), val))
+                return locate(newError("identifier not found: " + flat.literal(child[0])), flat, child[0]);
+            return Value();
+        }
+        case NodeKind::WHILE:
+            return evalFlatWhile(flat, node, env);
+        case NodeKind::FOR:
+            return locate(evalFlatFor(flat, node, env), flat, node);
+
+        //expressions
+        case NodeKind::IDENTIFIER: {
+            Value val = env->get(flat.literal(node));
+            if(!val.empty())
+                return val;
+            auto funcIt = builtins.find(flat.literal(node));
+            if(funcIt == builtins.end())
+                return locate(newError("identifier not found: " + flat.literal(node)), flat, node);
+            return funcIt->second;
+        }
+        case NodeKind::INTEGER:
+            return Value::integer(flat.value(node));
+        case NodeKind::STRING:
+            return new String(flat.literal(node));
+        case NodeKind::BOOLEAN:
+            return nativeBoolToBooleanObject(flat.value(node) != 0);
+        case NodeKind::PREFIX: {
+            Value right = evalFlat(flat, child[0], env);
+            if(isError(right))
+                return right;
+            return locate(evalPrefixExpression(flat.literal(node), right), flat, node);
+        }
+        case NodeKind::INFIX: {
+            Value left = evalFlat(flat, child[0], env);
+            if(isError(left))
+                return left;
+
+            RootScope roots(&left); // the right operand may collect
+            Value right = evalFlat(flat, child[1], env);
+            if(isError(right))
+                return right;
+
+            std::atomic<Quickened>& quickened = flat.quickened(node);
+            Quickened seen = quickened.load(std::memory_order_relaxed);
+            if(quickeningEnabled && seen > Quickened::GENERIC){
+                Value result = evalQuickenedInfix(seen, left, right);
+                if(!result.empty())
+                    return result;
+                quickened.store(Quickened::GENERIC, std::memory_order_relaxed); // deoptimize for good
+            }
+            else if(quickeningEnabled && seen == Quickened::UNSEEN){
+                quickened.store(quickenInfix(flat.literal(node), left, right), std::memory_order_relaxed);
+            }
+            return locate(evalInfixExpression(flat.literal(node), left, right), flat, node);
+        }
+        case NodeKind::IF: {
+            Value condition = evalFlat(flat, child[0], env);
+            if(isError(condition))
+                return condition;
+            if(isTruthy(condition))
+                return evalFlat(flat, child[1], env);
+            else if(child[2] != NO_NODE)
+                return evalFlat(flat, child[2], env);
+            return Value::null();
+        }
+        case NodeKind::FUNCTION:
+            return new Function(&flat, node, env);
+        case NodeKind::CALL: {
+            Value function = evalFlat(flat, child[0], env);
+            if(isError(function))
+                return function;
+
+            RootScope roots(&function); // the arguments may collect
+            std::vector<Value> args = evalFlatExpressions(flat, node, 1, env);
+            if(args.size() == 1 && isError(args[0]))
+                return args[0];
+            return locate(applyFunction(function, args), flat, node);
+        }
+        case NodeKind::ARRAY: {
+            std::vector<Value> elems = evalFlatExpressions(flat, node, 0, env);
+            if(elems.size() == 1 && isError(elems[0]))
+                return elems[0];
+            return new Array(elems);
+        }
+        case NodeKind::INDEX: {
+            Value left = evalFlat(flat, child[0], env);
+            if(isError(left))
+                return left;
+            RootScope roots(&left); // the index may collect
+            Value index = evalFlat(flat, child[1], env);
+            if(isError(index))
+                return index;
+
+            std::atomic<Quickened>& quickened = flat.quickened(node);
+            Quickened seen = quickened.load(std::memory_order_relaxed);
+            if(quickeningEnabled && seen > Quickened::GENERIC){
+                Value result = evalQuickenedIndex(seen, left, index);
+                if(!result.empty())
+                    return result;
+                quickened.store(Quickened::GENERIC, std::memory_order_relaxed); // deoptimize for good
+            }
+            else if(quickeningEnabled && seen == Quickened::UNSEEN){
+                quickened.store(quickenIndex(left, index), std::memory_order_relaxed);
+            }
+            return locate(evalIndexExpression(left, index), flat, node);
+        }
+        case NodeKind::HASH:
+            return locate(evalFlatHash(flat, node, env), flat, node);
+    }
+    return Value();
+}
+
+// evaluates the program flat holds in env
+Value evalFlat(const FlatAst& flat, Environment* env){
+    if(flat.size() == 0)
+        return Value();
+    return evalFlat(flat, flat.root(), env);
+}
+
+// applies a function evalFlat created to args, like applyFunction does with the body of a literal
+Value applyFlatFunction(Function* func, std::vector<Value>& args){
+    const FlatAst& flat = *func->flat;
+    FlatAst::ChildRange child = flat.children(func->flatNode);
+    Environment* extendedEnv = new Environment(func->env);
+    for(size_t i = 0; i + 1 < child.size() && i < args.size(); i++)
+        extendedEnv->set(flat.literal(child[i]), args[i]);
+    RootScope roots(extendedEnv);
+    safePoint(); // the arguments are in extendedEnv and the caller needs nothing else, func may move
+    return unwrapReturnValue(evalFlat(flat, child[child.size() - 1], extendedEnv));
+}
@@ -0,0 +1,30 @@
+// evaluator which walks a FlatAst by node index rather than rebuilding the pointer based tree
+
+#ifndef FLATEVAL_H
+#define FLATEVAL_H
+
+#include <vector>
+#include "environment.h"
+#include "flatast.h"
+#include "object.h"
+
+// evalFlat gives every node the result Eval gives the Node it was built from, sharing the evaluator's
+// operators, builtins, error messages and safe points. Functions it creates point into the FlatAst, so
+// calling them, from Monkey code or from builtins through applyFunction, also runs from the flat tree.
+// Infix and index expressions quicken like Eval's, keeping what they specialized to in the FlatAst, and
+// pmap and pfilter check the purity of its functions on the literal rebuilt from the flat tree. The
+// profilers key on Nodes so they don't see what it evaluates. The flat eval engine of differential.h
+// runs it against Eval so the two can't drift apart.
+
+// evaluates node of flat and everything below it in env
+// REQUIRES: flat outlives every function the evaluation creates, which point into it
+Value evalFlat(const FlatAst& flat, uint32_t node, Environment* env);
+
+// evaluates the program flat holds in env, an empty tree evaluates to no value
+// REQUIRES: the same as above
+Value evalFlat(const FlatAst& flat, Environment* env);
+
+// applies a function evalFlat created to args, called by applyFunction
+Value applyFlatFunction(Function* func, std::vector<Value>& args);
+
+#endif // FLATEVAL_H
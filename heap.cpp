@@ -0,0 +1,953 @@
+// definitions for heap.h
+
+#include "heap.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <unordered_set>
+#include <vector>
+#include "allocationprofile.h"
+#include "environment.h"
+#include "tracing.h"
+
+bool collectionEnabled = true;
+std::chrono::microseconds collectionPauseBudget(1000);
+
+typedef std::chrono::steady_clock Clock;
+
+// where the major collection is
+enum class Phase {
+    IDLE,
+    MARKING, // tracing from the roots in slices, the write barrier shades stored values
+    SWEEPING, // freeing what marking didn't reach in slices, new objects are allocated marked
+};
+
+// phase of the heap, kept out of it so the write barrier reads it without the function local static
+static Phase phase = Phase::IDLE;
+
+// what the header of an object says about it
+enum class ObjectState : uint8_t {
+    NURSERY, // live in the nursery as far as the allocator knows
+    FORWARDED, // moved to the old generation, forward points at the copy
+    FREED, // destroyed by delete, the memory is reclaimed by the next collection
+    FILLER, // unused end of a nursery chunk
+    OLD,
+    PERMANENT,
+};
+
+// header in front of every object allocateObject returns, 16 bytes so objects stay 16 byte aligned
+struct ObjectHeader {
+    uint32_t size; // bytes of the header and the object
+    ObjectState state;
+    bool marked; // reached by the current major collection
+    bool remembered; // an old object in a remembered list
+    Object* forward;
+};
+
+static_assert(sizeof(ObjectHeader) == 16, "objects must stay 16 byte aligned");
+
+// helper which returns the header of an object allocateObject returned
+static ObjectHeader* headerOf(Object* object){
+    return reinterpret_cast<ObjectHeader*>(object) - 1;
+}
+
+// what one RootScope names, any of which may be null
+struct RootEntry {
+    Environment* env;
+    Value* value;
+    std::vector<Value>* values;
+};
+
+// what the heap keeps for each thread which allocates, only touched by that thread outside of
+// collections, which run while every other thread is idle
+struct ThreadHeap {
+    char* cursor = nullptr; // free part of the thread's nursery chunk
+    char* limit = nullptr;
+    int noCollection = 0; // number of live NoCollections
+    std::vector<RootEntry> roots; // what the live RootScopes name, innermost last
+    std::vector<Object*> oldObjects;
+    std::vector<Environment*> environments; // enclosed environments created by the thread
+    std::vector<Object*> rememberedObjects; // old objects which may point into the nursery
+    std::vector<Environment*> rememberedEnvironments;
+    std::vector<Object*> grey; // old objects shaded or allocated by the thread while marking
+    std::vector<Environment*> greyEnvironments;
+    size_t sweptObjects = 0; // oldObjects before this were swept, and the ones kept moved before keptObjects
+    size_t keptObjects = 0;
+    size_t sweptEnvironments = 0;
+    size_t keptEnvironments = 0;
+    size_t oldBytes = 0; // allocated in the old generation since the last collection
+};
+
+// visits the values, objects and environments one object or environment points to
+class Tracer {
+    public:
+        virtual ~Tracer(){}
+
+        // visits an object and returns where it is now
+        virtual Object* object(Object* object) = 0;
+
+        // visits an environment
+        virtual void environment(Environment* env) = 0;
+
+        // visits a value, updating it if its object moved
+        void value(Value& value){
+            if(!value.isObject())
+                return;
+            Object* moved = object(value.asObject());
+            if(moved != value.asObject())
+                value = Value(moved);
+        }
+
+        // visits what object points to
+        void children(Object* object);
+
+        // visits what env holds, and the environment it is enclosed in if outer is set
+        void children(Environment* env, bool outer);
+
+        // visits what a RootScope names
+        void root(RootEntry& entry);
+};
+
+// helper which moves object into place, whose header is already written
+static Object* relocate(Object* object, void* place){
+    switch(object->type()){
+        case ObjectType::INTEGER_OBJ:
+            return new (place) Integer(std::move(*static_cast<Integer*>(object)));
+        case ObjectType::BOOLEAN_OBJ:
+            return new (place) BooleanObj(std::move(*static_cast<BooleanObj*>(object)));
+        case ObjectType::NULL_OBJ:
+            return new (place) Null(std::move(*static_cast<Null*>(object)));
+        case ObjectType::RETURN_VALUE_OBJ:
+            return new (place) ReturnValue(std::move(*static_cast<ReturnValue*>(object)));
+        case ObjectType::ERROR_OBJ:
+            return new (place) Error(std::move(*static_cast<Error*>(object)));
+        case ObjectType::FUNCTION_OBJ:
+            return new (place) Function(std::move(*static_cast<Function*>(object)));
+        case ObjectType::STRING_OBJ:
+            return new (place) String(std::move(*static_cast<String*>(object)));
+        case ObjectType::BUILTIN_OBJ:
+            return new (place) Builtin(std::move(*static_cast<Builtin*>(object)));
+        case ObjectType::ARRAY_OBJ:
+            return new (place) Array(std::move(*static_cast<Array*>(object)));
+        case ObjectType::HASH_OBJ:
+            return new (place) Hash(std::move(*static_cast<Hash*>(object)));
+    }
+    return nullptr;
+}
+
+// tracer for major collections, which marks every old object and environment it reaches
+class MajorTracer: public Tracer {
+    public:
+        Object* object(Object* object) override {
+            ObjectHeader* header = headerOf(object);
+            if(header->state == ObjectState::OLD && !header->marked){
+                header->marked = true;
+                objects.push_back(object);
+            }
+            return object;
+        }
+
+        void environment(Environment* env) override {
+            if(!env->marked){
+                env->marked = true;
+                environments.push_back(env);
+            }
+        }
+
+        // visits the children of everything marked so far, which may mark more, until nothing is left
+        // or deadline passes
+        // EFFECTS: returns if nothing is left
+        bool drain(Clock::time_point deadline){
+            for(size_t count = 1; !objects.empty() || !environments.empty(); count++){
+                if(count % 64 == 0 && Clock::now() >= deadline)
+                    return false;
+                if(!objects.empty()){
+                    Object* object = objects.back();
+                    objects.pop_back();
+                    if(headerOf(object)->state == ObjectState::OLD) // not deleted since it was marked
+                        children(object);
+                }
+                else{
+                    Environment* env = environments.back();
+                    environments.pop_back();
+                    children(env, true);
+                }
+            }
+            return true;
+        }
+
+        // forgets everything marked but not yet visited
+        void clear(){
+            objects.clear();
+            environments.clear();
+        }
+
+    private:
+        std::vector<Object*> objects;
+        std::vector<Environment*> environments;
+};
+
+// tracer for minor collections, which moves every nursery object it reaches to the old generation
+class MinorTracer: public Tracer {
+    public:
+        MinorTracer(ThreadHeap* self, HeapStats& stats, MajorTracer& marker):
+            self(self), stats(stats), marker(marker){}
+
+        Object* object(Object* object) override {
+            ObjectHeader* header = headerOf(object);
+            if(header->state == ObjectState::FORWARDED)
+                return header->forward;
+            if(header->state != ObjectState::NURSERY)
+                return object;
+            ObjectHeader* copy = static_cast<ObjectHeader*>(::operator new(header->size, std::align_val_t(16)));
+            *copy = ObjectHeader{header->size, ObjectState::OLD, false, false, nullptr};
+            Object* moved = relocate(object, copy + 1);
+            header->state = ObjectState::FORWARDED;
+            header->forward = moved;
+            self->oldObjects.push_back(moved);
+            self->oldBytes += header->size;
+            stats.promotedObjects++;
+            pending.push_back(moved);
+            // the major collection in progress hasn't seen the object, so it is treated as new
+            if(phase == Phase::MARKING)
+                marker.object(moved);
+            else if(phase == Phase::SWEEPING)
+                copy->marked = true;
+            return moved;
+        }
+
+        // old environments are never moved, their stores of nursery values were remembered
+        void environment(Environment*) override {}
+
+        // visits the children of every object moved so far, which may move more
+        void drain(){
+            while(!pending.empty()){
+                Object* object = pending.back();
+                pending.pop_back();
+                children(object);
+            }
+        }
+
+    private:
+        ThreadHeap* self;
+        HeapStats& stats;
+        MajorTracer& marker;
+        std::vector<Object*> pending;
+};
+
+// the state of the whole heap
+class Heap {
+    public:
+        Heap();
+
+        // registers the calling thread
+        ThreadHeap* attach();
+
+        // unregisters a thread which is exiting, keeping its old generation
+        void detach(ThreadHeap* thread);
+
+        // allocates total bytes once the thread's nursery chunk is used up
+        void* allocateSlow(ThreadHeap* thread, size_t total);
+
+        // allocates total bytes in the old generation
+        void* allocateOld(ThreadHeap* thread, size_t total);
+
+        // runs a minor collection if nursery is set, or everything a full collection needs if full is,
+        // and advances the major collection, recording how long it all took
+        void collect(ThreadHeap* self, bool full, bool nursery);
+
+        // starts a major collection if none is in progress
+        void beginMajor(ThreadHeap* self);
+
+        // removes a top level environment which is being destroyed from the roots
+        void forgetRoot(Environment* env);
+
+        // advances the major collection in progress until it finishes or deadline passes
+        void advance(ThreadHeap* self, Clock::time_point deadline);
+
+        // counts the objects in the nursery and old generation and the environments by kind
+        CountsByKind census();
+
+        //vars
+        char* nursery;
+        std::atomic<size_t> nurseryUsed{0}; // bytes handed out in chunks, may pass NURSERY_SIZE once full
+        std::mutex lock; // guards threads and roots
+        std::vector<ThreadHeap*> threads;
+        ThreadHeap exited; // old generation of threads which have exited
+        std::unordered_set<Environment*> roots;
+        HeapStats stats;
+        size_t majorAt = MAJOR_COLLECT_MIN; // oldBytes which triggers the next major collection
+        Clock::time_point nextSlice; // safe points leave the major collection alone until then
+
+    private:
+        // helper which marks the unused end of a thread's nursery chunk as filler
+        void retireChunk(ThreadHeap* thread);
+
+        // helper which returns every thread heap, the exited one last
+        std::vector<ThreadHeap*> allThreads();
+
+        void minor(ThreadHeap* self);
+
+        // helpers for the phases of a major collection, which return if the phase finished
+        bool mark(ThreadHeap* self, Clock::time_point deadline);
+        bool sweep(Clock::time_point deadline);
+
+        // helper which shades the roots
+        void shadeRoots();
+
+        // helper which hands the objects and environments the threads shaded to the marker
+        void mergeGrey();
+
+        // helper which sweeps the old generation of one thread until it is done or deadline passes
+        bool sweepThread(ThreadHeap* thread, Clock::time_point deadline);
+
+        //vars
+        MajorTracer marker;
+        size_t liveBytes = 0; // bytes the sweep in progress kept so far
+        bool rootForgotten = false; // a top level environment was destroyed since the last minor collection
+};
+
+// the heap, never destroyed so objects may be freed during static destruction
+static Heap& heap(){
+    static Heap* instance = new Heap();
+    return *instance;
+}
+
+static thread_local ThreadHeap* current = nullptr;
+
+// unregisters the thread's heap when the thread exits
+struct ThreadHeapOwner {
+    ThreadHeap* thread = nullptr;
+
+    ~ThreadHeapOwner(){
+        if(thread != nullptr)
+            heap().detach(thread);
+        current = nullptr;
+    }
+};
+
+static thread_local ThreadHeapOwner owner;
+
+// returns the calling thread's heap, registering the thread on first use
+static ThreadHeap* thisThreadHeap(){
+    if(current == nullptr){
+        current = heap().attach();
+        owner.thread = current;
+    }
+    return current;
+}
+
+// constructor
+Heap::Heap(){
+    nursery = static_cast<char*>(::operator new(NURSERY_SIZE, std::align_val_t(16)));
+}
+
+// registers the calling thread
+ThreadHeap* Heap::attach(){
+    ThreadHeap* thread = new ThreadHeap();
+    std::lock_guard<std::mutex> guard(lock);
+    threads.push_back(thread);
+    return thread;
+}
+
+// unregisters a thread which is exiting, keeping its old generation
+void Heap::detach(ThreadHeap* thread){
+    std::lock_guard<std::mutex> guard(lock);
+    retireChunk(thread);
+    if(phase == Phase::SWEEPING){
+        // what the thread kept goes where the exited sweep keeps what it has swept, so it isn't swept twice
+        sweepThread(thread, Clock::time_point::max());
+        exited.oldObjects.insert(exited.oldObjects.begin() + (std::ptrdiff_t)exited.keptObjects,
+            thread->oldObjects.begin(), thread->oldObjects.begin() + (std::ptrdiff_t)thread->keptObjects);
+        exited.keptObjects += thread->keptObjects;
+        exited.sweptObjects += thread->keptObjects;
+        exited.environments.insert(exited.environments.begin() + (std::ptrdiff_t)exited.keptEnvironments,
+            thread->environments.begin(), thread->environments.begin() + (std::ptrdiff_t)thread->keptEnvironments);
+        exited.keptEnvironments += thread->keptEnvironments;
+        exited.sweptEnvironments += thread->keptEnvironments;
+    }
+    else{
+        exited.oldObjects.insert(exited.oldObjects.end(), thread->oldObjects.begin(), thread->oldObjects.end());
+        exited.environments.insert(exited.environments.end(), thread->environments.begin(), thread->environments.end());
+    }
+    exited.grey.insert(exited.grey.end(), thread->grey.begin(), thread->grey.end());
+    exited.greyEnvironments.insert(exited.greyEnvironments.end(), thread->greyEnvironments.begin(),
+        thread->greyEnvironments.end());
+    exited.rememberedObjects.insert(exited.rememberedObjects.end(), thread->rememberedObjects.begin(),
+        thread->rememberedObjects.end());
+    exited.rememberedEnvironments.insert(exited.rememberedEnvironments.end(), thread->rememberedEnvironments.begin(),
+        thread->rememberedEnvironments.end());
+    exited.oldBytes += thread->oldBytes;
+    threads.erase(std::find(threads.begin(), threads.end(), thread));
+    delete thread;
+}
+
+// helper which marks the unused end of a thread's nursery chunk as filler
+void Heap::retireChunk(ThreadHeap* thread){
+    if(thread->cursor < thread->limit)
+        *reinterpret_cast<ObjectHeader*>(thread->cursor) =
+            ObjectHeader{(uint32_t)(thread->limit - thread->cursor), ObjectState::FILLER, false, false, nullptr};
+    thread->cursor = nullptr;
+    thread->limit = nullptr;
+}
+
+// helper which allocates total bytes from the thread's nursery chunk
+// REQUIRES: the chunk has room for them
+static void* bump(ThreadHeap* thread, size_t total){
+    ObjectHeader* header = reinterpret_cast<ObjectHeader*>(thread->cursor);
+    thread->cursor += total;
+    *header = ObjectHeader{(uint32_t)total, ObjectState::NURSERY, false, false, nullptr};
+    return header + 1;
+}
+
+// allocates total bytes once the thread's nursery chunk is used up
+void* Heap::allocateSlow(ThreadHeap* thread, size_t total){
+    if(total > NURSERY_CHUNK / 8 || nurseryUsed.load(std::memory_order_relaxed) >= NURSERY_SIZE)
+        return allocateOld(thread, total);
+    retireChunk(thread);
+    size_t offset = nurseryUsed.fetch_add(NURSERY_CHUNK, std::memory_order_relaxed);
+    if(offset + NURSERY_CHUNK > NURSERY_SIZE)
+        return allocateOld(thread, total);
+    thread->cursor = nursery + offset;
+    thread->limit = thread->cursor + NURSERY_CHUNK;
+    return bump(thread, total);
+}
+
+// allocates total bytes in the old generation, remembered as its constructor may store nursery values,
+// and grey while marking and black while sweeping as it may store any value without a barrier
+void* Heap::allocateOld(ThreadHeap* thread, size_t total){
+    ObjectHeader* header = static_cast<ObjectHeader*>(::operator new(total, std::align_val_t(16)));
+    *header = ObjectHeader{(uint32_t)total, ObjectState::OLD, phase == Phase::SWEEPING, true, nullptr};
+    Object* object = reinterpret_cast<Object*>(header + 1);
+    thread->oldObjects.push_back(object);
+    thread->rememberedObjects.push_back(object);
+    if(phase == Phase::MARKING)
+        thread->grey.push_back(object);
+    thread->oldBytes += total;
+    return object;
+}
+
+// visits what object points to
+void Tracer::children(Object* object){
+    switch(object->type()){
+        case ObjectType::RETURN_VALUE_OBJ:
+            value(static_cast<ReturnValue*>(object)->value);
+            break;
+        case ObjectType::FUNCTION_OBJ:
+            environment(static_cast<Function*>(object)->env);
+            break;
+        case ObjectType::STRING_OBJ: {
+            String* str = static_cast<String*>(object);
+            String* left = str->left.load(std::memory_order_relaxed);
+            if(left != nullptr){
+                str->left.store(static_cast<String*>(this->object(left)), std::memory_order_relaxed);
+                str->right = static_cast<String*>(this->object(str->right));
+            }
+            break;
+        }
+        case ObjectType::ARRAY_OBJ:
+            for(Value& element: static_cast<Array*>(object)->elements)
+                value(element);
+            break;
+        case ObjectType::HASH_OBJ:
+            for(auto& pair: static_cast<Hash*>(object)->pairs){
+                value(pair.second.key);
+                value(pair.second.value);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// visits what env holds, and the environment it is enclosed in if outer is set
+void Tracer::children(Environment* env, bool outer){
+    for(auto& entry: env->store)
+        value(entry.second);
+    if(outer && env->outer != nullptr)
+        environment(env->outer);
+}
+
+// visits what a RootScope names
+void Tracer::root(RootEntry& entry){
+    if(entry.env != nullptr)
+        children(entry.env, false);
+    if(entry.value != nullptr)
+        value(*entry.value);
+    if(entry.values != nullptr){
+        for(Value& element: *entry.values)
+            value(element);
+    }
+}
+
+// runs a minor collection if nursery is set, or everything a full collection needs if full is, and
+// advances the major collection, recording how long it all took
+void Heap::collect(ThreadHeap* self, bool full, bool nursery){
+    TraceSpan span(TRACE_COLLECTION, full ? "full collection" : "collection");
+    Clock::time_point start = Clock::now();
+    if(full){
+        // a collection in progress may keep what became garbage since it started, so a new one follows
+        advance(self, Clock::time_point::max());
+        minor(self);
+        beginMajor(self);
+        advance(self, Clock::time_point::max());
+    }
+    else{
+        if(nursery)
+            minor(self);
+        if(stats.oldBytes + self->oldBytes >= majorAt)
+            beginMajor(self);
+        if(phase != Phase::IDLE)
+            advance(self, start + collectionPauseBudget);
+    }
+
+    Clock::time_point end = Clock::now();
+    nextSlice = end + collectionPauseBudget;
+    size_t micros = (size_t)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    size_t bucket = 0;
+    while(bucket + 1 < PAUSE_BUCKETS && micros >> (bucket + 1) != 0)
+        bucket++;
+    stats.pauses[bucket]++;
+    stats.maxPauseMicros = std::max(stats.maxPauseMicros, micros);
+    stats.totalPauseMicros += micros;
+}
+
+// starts a major collection if none is in progress
+void Heap::beginMajor(ThreadHeap* self){
+    if(phase != Phase::IDLE)
+        return;
+    // the remembered lists may hold garbage pointing at a destroyed top level environment, which the
+    // marker would reach through the nursery objects it promotes, a minor collection empties them
+    if(rootForgotten)
+        minor(self);
+    phase = Phase::MARKING;
+    shadeRoots();
+}
+
+// removes a top level environment which is being destroyed from the roots, a marking in progress may
+// already hold garbage pointing at it so it is abandoned, sweeping doesn't look at environments
+void Heap::forgetRoot(Environment* env){
+    roots.erase(env);
+    rootForgotten = true;
+    if(phase != Phase::MARKING)
+        return;
+    marker.clear();
+    for(ThreadHeap* thread: allThreads()){
+        thread->grey.clear();
+        thread->greyEnvironments.clear();
+        for(Object* object: thread->oldObjects)
+            headerOf(object)->marked = false;
+        for(Environment* managed: thread->environments)
+            managed->marked = false;
+    }
+    for(Environment* root: roots)
+        root->marked = false;
+    phase = Phase::IDLE;
+}
+
+// advances the major collection in progress until it finishes or deadline passes
+void Heap::advance(ThreadHeap* self, Clock::time_point deadline){
+    if(phase == Phase::IDLE)
+        return;
+    stats.majorSlices++;
+    if(phase == Phase::MARKING && !mark(self, deadline))
+        return;
+    sweep(deadline);
+}
+
+// counts the objects in the nursery and old generation and the environments by kind
+CountsByKind Heap::census(){
+    CountsByKind counts;
+    std::vector<ThreadHeap*> all = allThreads();
+    for(ThreadHeap* thread: all)
+        retireChunk(thread); // so the nursery can be walked, the threads take new chunks
+    char* end = nursery + std::min(nurseryUsed.load(std::memory_order_relaxed), NURSERY_SIZE);
+    for(char* cursor = nursery; cursor < end;){
+        ObjectHeader* header = reinterpret_cast<ObjectHeader*>(cursor);
+        if(header->state == ObjectState::NURSERY){
+            AllocationCounts& kind = counts[(size_t)reinterpret_cast<Object*>(header + 1)->type()];
+            kind.objects++;
+            kind.bytes += header->size;
+        }
+        cursor += header->size;
+    }
+    for(ThreadHeap* thread: all){
+        // while sweeping the entries between what was kept and what is still to be swept are freed
+        for(size_t i = 0; i < thread->oldObjects.size(); i++){
+            if(i == thread->keptObjects)
+                i = thread->sweptObjects;
+            if(i == thread->oldObjects.size())
+                break;
+            ObjectHeader* header = headerOf(thread->oldObjects[i]);
+            if(header->state == ObjectState::OLD){
+                AllocationCounts& kind = counts[(size_t)thread->oldObjects[i]->type()];
+                kind.objects++;
+                kind.bytes += header->size;
+            }
+        }
+        size_t environments = thread->environments.size() - (thread->sweptEnvironments - thread->keptEnvironments);
+        counts[ENVIRONMENT_KIND].objects += environments;
+        counts[ENVIRONMENT_KIND].bytes += environments * ENVIRONMENT_BYTES;
+    }
+    return counts;
+}
+
+// helper which returns every thread heap, the exited one last
+std::vector<ThreadHeap*> Heap::allThreads(){
+    std::vector<ThreadHeap*> all(threads);
+    all.push_back(&exited);
+    return all;
+}
+
+// moves the reachable nursery objects to the old generation and destroys the rest
+void Heap::minor(ThreadHeap* self){
+    resolveAllocations(); // the profiler needs the types of the objects before they move or die
+    std::vector<ThreadHeap*> all = allThreads();
+    for(ThreadHeap* thread: all)
+        retireChunk(thread);
+
+    MinorTracer tracer(self, stats, marker);
+    for(Environment* env: roots)
+        tracer.children(env, false);
+    for(ThreadHeap* thread: all){
+        for(RootEntry& entry: thread->roots)
+            tracer.root(entry);
+        for(Environment* env: thread->rememberedEnvironments){
+            tracer.children(env, false);
+            env->remembered = false;
+        }
+        for(Object* object: thread->rememberedObjects){
+            ObjectHeader* header = headerOf(object);
+            if(header->state == ObjectState::OLD)
+                tracer.children(object);
+            header->remembered = false;
+        }
+        thread->rememberedEnvironments.clear();
+        thread->rememberedObjects.clear();
+    }
+    tracer.drain();
+
+    // everything left in the nursery is garbage, moved objects only leave their moved from shells
+    char* end = nursery + std::min(nurseryUsed.load(std::memory_order_relaxed), NURSERY_SIZE);
+    for(char* cursor = nursery; cursor < end;){
+        ObjectHeader* header = reinterpret_cast<ObjectHeader*>(cursor);
+        if(header->state == ObjectState::NURSERY || header->state == ObjectState::FORWARDED)
+            reinterpret_cast<Object*>(header + 1)->~Object();
+        cursor += header->size;
+    }
+    nurseryUsed.store(0, std::memory_order_relaxed);
+
+    for(ThreadHeap* thread: all){
+        stats.oldBytes += thread->oldBytes;
+        thread->oldBytes = 0;
+    }
+    stats.minorCollections++;
+    rootForgotten = false;
+}
+
+// helper which marks until nothing grey is left or deadline passes, then starts the sweep
+// EFFECTS: returns if marking finished
+bool Heap::mark(ThreadHeap* self, Clock::time_point deadline){
+    mergeGrey();
+    if(!marker.drain(deadline))
+        return false;
+
+    // the roots and the nursery were never scanned as a whole since the collection started, so they are
+    // now, and only if that reaches nothing new is every reachable old object marked
+    minor(self);
+    mergeGrey();
+    shadeRoots();
+    if(!marker.drain(deadline))
+        return false;
+
+    phase = Phase::SWEEPING;
+    liveBytes = 0;
+    return true;
+}
+
+// helper which shades the roots
+void Heap::shadeRoots(){
+    for(Environment* env: roots)
+        marker.environment(env);
+    for(ThreadHeap* thread: allThreads()){
+        for(RootEntry& entry: thread->roots){
+            if(entry.env != nullptr)
+                marker.environment(entry.env);
+            if(entry.value != nullptr)
+                marker.value(*entry.value);
+            if(entry.values != nullptr){
+                for(Value& element: *entry.values)
+                    marker.value(element);
+            }
+        }
+    }
+}
+
+// helper which hands the objects and environments the threads shaded to the marker
+void Heap::mergeGrey(){
+    for(ThreadHeap* thread: allThreads()){
+        for(Object* object: thread->grey)
+            marker.object(object);
+        for(Environment* env: thread->greyEnvironments)
+            marker.environment(env);
+        thread->grey.clear();
+        thread->greyEnvironments.clear();
+    }
+}
+
+// helper which frees the old objects and environments marking didn't reach until deadline passes,
+// then finishes the collection
+// EFFECTS: returns if the sweep finished
+bool Heap::sweep(Clock::time_point deadline){
+    std::vector<ThreadHeap*> all = allThreads();
+    for(ThreadHeap* thread: all){
+        if(!sweepThread(thread, deadline))
+            return false;
+    }
+
+    for(ThreadHeap* thread: all){
+        thread->oldObjects.resize(thread->keptObjects);
+        thread->environments.resize(thread->keptEnvironments);
+        thread->sweptObjects = thread->keptObjects = 0;
+        thread->sweptEnvironments = thread->keptEnvironments = 0;
+        thread->oldBytes = 0; // everything allocated during the sweep was swept too, so is in liveBytes
+    }
+    for(Environment* env: roots)
+        env->marked = false;
+    stats.oldBytes = liveBytes;
+    majorAt = liveBytes + std::max(liveBytes, MAJOR_COLLECT_MIN);
+    stats.majorCollections++;
+    phase = Phase::IDLE;
+    return true;
+}
+
+// helper which sweeps the old generation of one thread until it is done or deadline passes, unmarking
+// what it keeps, the lists may grow in between as new objects are allocated marked
+// EFFECTS: returns if the thread was swept up to the end of its lists
+bool Heap::sweepThread(ThreadHeap* thread, Clock::time_point deadline){
+    size_t count = 0;
+    while(thread->sweptObjects < thread->oldObjects.size()){
+        if(++count % 256 == 0 && Clock::now() >= deadline)
+            return false;
+        Object* object = thread->oldObjects[thread->sweptObjects++];
+        ObjectHeader* header = headerOf(object);
+        // remembered objects are kept until the next minor collection takes them off its lists
+        if((header->state == ObjectState::OLD && (header->marked || header->remembered)) ||
+           (header->state == ObjectState::FREED && header->remembered)){
+            header->marked = false;
+            if(header->state == ObjectState::OLD)
+                liveBytes += header->size;
+            thread->oldObjects[thread->keptObjects++] = object;
+            continue;
+        }
+        if(header->state == ObjectState::OLD){
+            object->~Object();
+            stats.freedObjects++;
+        }
+        ::operator delete(header, std::align_val_t(16));
+    }
+
+    while(thread->sweptEnvironments < thread->environments.size()){
+        if(++count % 256 == 0 && Clock::now() >= deadline)
+            return false;
+        Environment* env = thread->environments[thread->sweptEnvironments++];
+        if(env->marked || env->remembered){
+            env->marked = false;
+            liveBytes += ENVIRONMENT_BYTES;
+            thread->environments[thread->keptEnvironments++] = env;
+            continue;
+        }
+        delete env;
+        stats.freedEnvironments++;
+    }
+    return true;
+}
+
+// allocates size bytes for an Object, bumping the thread's nursery chunk when it has room
+void* allocateObject(size_t size){
+    size_t total = (sizeof(ObjectHeader) + size + 15) & ~(size_t)15;
+    ThreadHeap* thread = current;
+    void* memory;
+    if(thread != nullptr && (size_t)(thread->limit - thread->cursor) >= total)
+        memory = bump(thread, total);
+    else
+        memory = heap().allocateSlow(thisThreadHeap(), total);
+    if(allocationProfiling)
+        recordObjectAllocation(static_cast<Object*>(memory), total);
+    return memory;
+}
+
+// allocates size bytes for an Object which is never collected
+void* allocatePermanentObject(size_t size){
+    ObjectHeader* header = static_cast<ObjectHeader*>(::operator new(sizeof(ObjectHeader) + size, std::align_val_t(16)));
+    *header = ObjectHeader{(uint32_t)(sizeof(ObjectHeader) + size), ObjectState::PERMANENT, false, false, nullptr};
+    return header + 1;
+}
+
+// releases memory allocateObject returned after the object in it was destroyed by delete
+void freeObject(void* memory){
+    ObjectHeader* header = static_cast<ObjectHeader*>(memory) - 1;
+    if(header->state == ObjectState::PERMANENT)
+        ::operator delete(header, std::align_val_t(16));
+    else
+        header->state = ObjectState::FREED; // the nursery or old generation sweep reclaims it
+}
+
+// adds a new enclosed Environment to the old generation
+void registerEnvironment(Environment* env){
+    ThreadHeap* thread = thisThreadHeap();
+    thread->environments.push_back(env);
+    thread->oldBytes += ENVIRONMENT_BYTES;
+    if(allocationProfiling)
+        recordEnvironmentAllocation();
+    if(phase == Phase::MARKING)
+        thread->greyEnvironments.push_back(env);
+    else if(phase == Phase::SWEEPING)
+        env->marked = true;
+}
+
+// adds a top level Environment to the roots
+void addRootEnvironment(Environment* env){
+    Heap& instance = heap();
+    std::lock_guard<std::mutex> guard(instance.lock);
+    instance.roots.insert(env);
+}
+
+// removes a top level Environment from the roots
+void removeRootEnvironment(Environment* env){
+    Heap& instance = heap();
+    std::lock_guard<std::mutex> guard(instance.lock);
+    instance.forgetRoot(env);
+}
+
+// helper which checks if value is an object in the nursery
+static bool inNursery(Value value){
+    if(!value.isObject())
+        return false;
+    char* address = reinterpret_cast<char*>(value.asObject());
+    char* nursery = heap().nursery;
+    return address >= nursery && address < nursery + NURSERY_SIZE;
+}
+
+// helper which shades value while marking, as it may be stored where the marker has already looked
+static void shade(Value value){
+    if(!value.isObject())
+        return;
+    ObjectHeader* header = headerOf(value.asObject());
+    if(header->state == ObjectState::OLD && !header->marked)
+        thisThreadHeap()->grey.push_back(value.asObject());
+}
+
+// records that value was stored into env, top level environments are roots so need nothing more than
+// the shading
+void writeBarrier(Environment* env, Value value){
+    if(phase == Phase::MARKING)
+        shade(value);
+    if(env->remembered || !env->managed || !inNursery(value))
+        return;
+    env->remembered = true;
+    thisThreadHeap()->rememberedEnvironments.push_back(env);
+}
+
+// records that value was stored into owner, objects in the nursery are scanned anyway
+void writeBarrier(Object* owner, Value value){
+    ObjectHeader* header = headerOf(owner);
+    if(phase == Phase::MARKING && header->state == ObjectState::OLD)
+        shade(value);
+    if(header->state != ObjectState::OLD || header->remembered || !inNursery(value))
+        return;
+    header->remembered = true;
+    thisThreadHeap()->rememberedObjects.push_back(owner);
+}
+
+// runs a collection if the nursery or old generation is full enough or a slice of a major collection
+// is due, and nothing blocks one
+void safePoint(){
+    if(!collectionEnabled)
+        return;
+    ThreadHeap* thread = current;
+    if(thread == nullptr || thread->noCollection > 0)
+        return;
+    Heap& instance = heap();
+    bool nursery = instance.nurseryUsed.load(std::memory_order_relaxed) >= NURSERY_COLLECT_AT;
+    if(!nursery){
+        if(phase == Phase::IDLE && instance.stats.oldBytes + thread->oldBytes < instance.majorAt)
+            return;
+        if(phase != Phase::IDLE && Clock::now() < instance.nextSlice)
+            return;
+    }
+    std::lock_guard<std::mutex> guard(instance.lock);
+    instance.collect(thread, false, nursery);
+}
+
+// runs a minor collection and a slice of a major one, or all of a new one if full is set
+void collectGarbage(bool full){
+    ThreadHeap* self = thisThreadHeap();
+    Heap& instance = heap();
+    std::lock_guard<std::mutex> guard(instance.lock);
+    instance.collect(self, full, true);
+}
+
+// starts an incremental major collection unless one is in progress
+void beginMajorCollection(){
+    ThreadHeap* self = thisThreadHeap();
+    Heap& instance = heap();
+    std::lock_guard<std::mutex> guard(instance.lock);
+    instance.beginMajor(self);
+}
+
+// returns if a major collection is in progress
+bool majorCollectionInProgress(){
+    return phase != Phase::IDLE;
+}
+
+// returns the counters kept by the collector
+HeapStats heapStats(){
+    Heap& instance = heap();
+    std::lock_guard<std::mutex> guard(instance.lock);
+    return instance.stats;
+}
+
+// returns if object is still there rather than destroyed
+bool objectAlive(Object* object){
+    ObjectState state = headerOf(object)->state;
+    return state == ObjectState::NURSERY || state == ObjectState::OLD || state == ObjectState::PERMANENT;
+}
+
+// counts what the heap holds now by kind
+CountsByKind heapCensus(){
+    Heap& instance = heap();
+    std::lock_guard<std::mutex> guard(instance.lock);
+    return instance.census();
+}
+
+// constructor, names env and value as roots
+RootScope::RootScope(Environment* env, Value* value){
+    thisThreadHeap()->roots.push_back(RootEntry{env, value, nullptr});
+}
+
+// constructor, names value as a root
+RootScope::RootScope(Value* value){
+    thisThreadHeap()->roots.push_back(RootEntry{nullptr, value, nullptr});
+}
+
+// constructor, names every value values holds as a root
+RootScope::RootScope(std::vector<Value>* values){
+    thisThreadHeap()->roots.push_back(RootEntry{nullptr, nullptr, values});
+}
+
+// destructor
+RootScope::~RootScope(){
+    current->roots.pop_back();
+}
+
+// constructor, blocks collections on this thread
+NoCollection::NoCollection(){
+    thisThreadHeap()->noCollection++;
+}
+
+// destructor
+NoCollection::~NoCollection(){
+    current->noCollection--;
+}
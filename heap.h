@@ -0,0 +1,152 @@
+// generational garbage collector for the Objects and Environments the evaluator allocates
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+#include "object.h"
+
+// Objects are bump allocated into a nursery, each thread taking chunks of it so allocation needs no
+// lock. A minor collection moves the nursery objects which are still reachable into the old
+// generation and destroys the rest in one pass, the old generation and the Environments, which are
+// never moved, are marked and swept by a major collection once they have grown enough.
+//
+// Major collections are incremental so a large old generation doesn't stall the evaluator: safe
+// points mark and then sweep it in slices of at most collectionPauseBudget, and while marking the
+// write barrier shades stored values and new old objects are allocated grey so nothing reachable is
+// missed (tri-color marking with an insertion barrier).
+//
+// Collections only run at safe points, the top of each top level statement, function call and loop
+// iteration, when no C++ code holds a Value the collector can't see. The roots are the top level
+// Environments and what RootScopes name, and stores of nursery values into old Environments and Objects are
+// recorded by writeBarrier so a minor collection doesn't have to scan the old generation.
+
+// bytes of the nursery, split into chunks of NURSERY_CHUNK handed out to each allocating thread
+static const size_t NURSERY_SIZE = 8 << 20;
+static const size_t NURSERY_CHUNK = 32 << 10;
+
+// a minor collection runs at the first safe point after this much of the nursery is used, the rest
+// is headroom for the allocations between safe points, beyond which objects go straight to old
+static const size_t NURSERY_COLLECT_AT = NURSERY_SIZE / 4 * 3;
+
+// a major collection runs once the old generation has grown by the larger of this and its size
+// after the last major collection
+static const size_t MAJOR_COLLECT_MIN = 32 << 20;
+
+// whether safe points collect, off makes the heap only grow as before the collector existed
+extern bool collectionEnabled;
+
+// longest a safe point may spend on a slice of a major collection, slices are also spaced at least
+// this far apart so the evaluator gets at least half of the time while one is in progress
+extern std::chrono::microseconds collectionPauseBudget;
+
+// number of buckets in the pause histogram, bucket i counts pauses of [2^i, 2^(i+1)) microseconds
+// with the first also counting shorter pauses and the last longer ones
+static const size_t PAUSE_BUCKETS = 24;
+
+// counters kept by the collector
+struct HeapStats {
+    size_t minorCollections = 0;
+    size_t majorCollections = 0; // major collections which have finished
+    size_t majorSlices = 0; // safe points which advanced a major collection
+    size_t promotedObjects = 0; // moved from the nursery to the old generation
+    size_t freedObjects = 0; // old objects freed by major collections
+    size_t freedEnvironments = 0; // environments freed by major collections
+    size_t oldBytes = 0; // bytes held by the old generation, objects and environments
+    std::array<size_t, PAUSE_BUCKETS> pauses{}; // histogram of the time each collecting safe point took
+    size_t maxPauseMicros = 0;
+    size_t totalPauseMicros = 0;
+};
+
+// objects and bytes of one kind of allocation
+struct AllocationCounts {
+    size_t objects = 0;
+    size_t bytes = 0; // including the headers the heap keeps
+};
+
+// counts by the kind of allocation, one for each ObjectType followed by environments
+static const size_t ENVIRONMENT_KIND = (size_t)ObjectType::HASH_OBJ + 1;
+static const size_t ALLOCATION_KINDS = ENVIRONMENT_KIND + 1;
+typedef std::array<AllocationCounts, ALLOCATION_KINDS> CountsByKind;
+
+// bytes an environment is counted as, roughly one with a small store
+static const size_t ENVIRONMENT_BYTES = 128;
+
+// allocates size bytes for an Object, in the nursery if there is room, used by Object::operator new
+void* allocateObject(size_t size);
+
+// allocates size bytes for an Object which is never collected, like the builtins
+void* allocatePermanentObject(size_t size);
+
+// releases memory allocateObject returned after the object in it was destroyed by delete
+void freeObject(void* memory);
+
+// adds a new enclosed Environment to the old generation, called by its constructor
+void registerEnvironment(Environment* env);
+
+// adds or removes a top level Environment from the roots, called by its constructor and destructor
+void addRootEnvironment(Environment* env);
+void removeRootEnvironment(Environment* env);
+
+// records that value was stored into env or owner, which must happen for every store into an
+// Environment, Array or Hash after it was created
+void writeBarrier(Environment* env, Value value);
+void writeBarrier(Object* owner, Value value);
+
+// runs a minor collection if the nursery is full enough, starts a major collection if the old
+// generation is, and advances one in progress, unless something on this thread blocks collections
+void safePoint();
+
+// runs a minor collection and a slice of a major one, or if full is set finishes any major collection
+// in progress and runs a whole new one so everything unreachable now is freed
+// REQUIRES: every Value outside of the heap and top level Environments is named by a RootScope, and
+//           no other thread is evaluating
+void collectGarbage(bool full = false);
+
+// starts an incremental major collection now rather than once the old generation has grown, like a
+// host might when it expects to be idle, does nothing if one is in progress
+// REQUIRES: the same as collectGarbage
+void beginMajorCollection();
+
+// returns if a major collection is in progress
+bool majorCollectionInProgress();
+
+// returns the counters kept by the collector
+HeapStats heapStats();
+
+// returns if object, which allocateObject returned, is still there rather than destroyed by delete or
+// a collection
+bool objectAlive(Object* object);
+
+// counts what the heap holds now by kind, garbage which hasn't been collected yet included
+// REQUIRES: no other thread is evaluating
+CountsByKind heapCensus();
+
+// names an enclosed Environment, a Value or a vector of Values on the C++ stack as roots while it is
+// alive, the values are updated in place if their objects move
+class RootScope {
+    public:
+        RootScope(Environment* env, Value* value = nullptr);
+        explicit RootScope(Value* value);
+        explicit RootScope(std::vector<Value>* values);
+        ~RootScope();
+
+        RootScope(const RootScope&) = delete;
+        RootScope& operator=(const RootScope&) = delete;
+};
+
+// keeps safe points on this thread from collecting while it is alive, for code holding Values
+// across a call back into the evaluator
+class NoCollection {
+    public:
+        NoCollection();
+        ~NoCollection();
+
+        NoCollection(const NoCollection&) = delete;
+        NoCollection& operator=(const NoCollection&) = delete;
+};
+
+#endif // HEAP_H
@@ -0,0 +1,122 @@
+#include "incremental.h"
+#include <algorithm>
+#include <memory>
+
+// helper which moves the offsets of the tokens of node and everything under it by delta
+static void shiftOffsets(Node* node, int64_t delta){
+    std::vector<Node*> pending = {node};
+    while(!pending.empty()){
+        Node* current = pending.back();
+        pending.pop_back();
+        if(current->token.offset != UNKNOWN_OFFSET)
+            current->token.offset = (uint32_t)((int64_t)current->token.offset + delta);
+        current->children(pending);
+    }
+}
+
+// constructor, parses the whole of source
+IncrementalParser::IncrementalParser(std::string source){
+    buffer = std::move(source);
+    buffer.append(LexerSource::SOURCE_PADDING, '\0');
+    reparse(0, 0, 0, 0);
+}
+
+// replaces the length bytes at start with replacement and brings the program up to date
+void IncrementalParser::edit(size_t start, size_t length, const std::string& replacement){
+    buffer.replace(start, length, replacement);
+    int64_t delta = (int64_t)replacement.size() - (int64_t)length;
+
+    // the chunk holding start may end differently now, and so may the one before it as the parse of
+    // a statement can look at the first token of the next one
+    auto after = std::upper_bound(chunks.begin(), chunks.end(), start,
+        [](size_t offset, const Chunk& chunk){ return offset < chunk.start; });
+    if(after == chunks.begin()){
+        reparse(0, 0, start + length, delta);
+        return;
+    }
+    size_t first = (size_t)(after - chunks.begin()) - 1;
+    if(first > 0)
+        first--;
+    reparse(first, chunks[first].start, start + length, delta);
+}
+
+// helper which parses from offset from until it reaches the start of an old chunk it can keep
+void IncrementalParser::reparse(size_t first, uint32_t from, size_t limit, int64_t delta){
+    // an old chunk is only kept if the edit can't have changed its tokens, which needs at least one
+    // byte between it and the edit, and if it has no errors as their line and column may have moved
+    size_t keep = first;
+    for(size_t i = first; i < chunks.size(); i++){
+        if(chunks[i].start <= limit || !chunks[i].errors.empty())
+            keep = i + 1;
+    }
+
+    std::vector<Chunk> replacements;
+    Lexer lexer(std::make_shared<BorrowedSource>(buffer.data(), buffer.size() - LexerSource::SOURCE_PADDING), from);
+    Parser parser(&lexer);
+    while(true){
+        if(parser.curTokenIs(TokenType::ENDOFFILE)){
+            keep = chunks.size(); // never caught up with the old parse, every old chunk after first is gone
+            break;
+        }
+        // at the start of a statement the parse from here on only depends on the tokens from here on,
+        // so it would rebuild the old chunks exactly
+        int64_t offset = parser.getCurrentToken().offset;
+        while(keep < chunks.size() && chunks[keep].start + delta < offset)
+            keep++;
+        if(keep < chunks.size() && chunks[keep].start + delta == offset)
+            break;
+
+        size_t errorCount = parser.getErrors().size();
+        Chunk chunk = {(uint32_t)offset, parser.parseStatementOrRecover(), {}};
+        chunk.errors.assign(parser.getErrors().begin() + (std::ptrdiff_t)errorCount, parser.getErrors().end());
+        replacements.push_back(std::move(chunk));
+        parser.nextToken();
+    }
+    parsed = replacements.size();
+
+    for(size_t i = first; i < keep; i++)
+        delete chunks[i].statement;
+    if(delta != 0){
+        for(size_t i = keep; i < chunks.size(); i++){
+            chunks[i].start = (uint32_t)(chunks[i].start + delta);
+            if(chunks[i].statement != nullptr)
+                shiftOffsets(chunks[i].statement, delta);
+        }
+    }
+    chunks.erase(chunks.begin() + (std::ptrdiff_t)first, chunks.begin() + (std::ptrdiff_t)keep);
+    chunks.insert(chunks.begin() + (std::ptrdiff_t)first, std::make_move_iterator(replacements.begin()),
+        std::make_move_iterator(replacements.end()));
+    collectStatements();
+}
+
+// helper which rebuilds the statements of the program from the chunks
+void IncrementalParser::collectStatements(){
+    program.statements.clear();
+    for(Chunk& chunk : chunks){
+        if(chunk.statement != nullptr)
+            program.statements.push_back(chunk.statement);
+    }
+}
+
+// returns the program
+Program* IncrementalParser::getProgram(){
+    return &program;
+}
+
+// returns the errors of the whole buffer in source order
+std::vector<std::string> IncrementalParser::getErrors() const{
+    std::vector<std::string> errors;
+    for(const Chunk& chunk : chunks)
+        errors.insert(errors.end(), chunk.errors.begin(), chunk.errors.end());
+    return errors;
+}
+
+// returns the current contents of the buffer
+std::string IncrementalParser::getSource() const{
+    return buffer.substr(0, buffer.size() - LexerSource::SOURCE_PADDING);
+}
+
+// returns the number of top level statements the last edit or the constructor parsed
+size_t IncrementalParser::parsedStatements() const{
+    return parsed;
+}
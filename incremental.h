@@ -0,0 +1,62 @@
+// incremental parser which keeps a program in sync with a buffer as it is edited
+
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "parser.h"
+
+// keeps the parse of a buffer up to date as it is edited, an edit only lexes and parses the top level
+// statements it touches and reuses the rest of the previous program, shifting their offsets
+class IncrementalParser {
+    public:
+        // constructor
+        // EFFECTS:  parses the whole of source
+        IncrementalParser(std::string source);
+
+        IncrementalParser(const IncrementalParser&) = delete;
+        IncrementalParser& operator=(const IncrementalParser&) = delete;
+
+        // replaces the length bytes at start with replacement and brings the program up to date
+        // REQUIRES: start + length <= getSource().size()
+        // MODIFIES: the program, statements which were reparsed are deleted and replaced
+        void edit(size_t start, size_t length, const std::string& replacement);
+
+        // returns the program, which is owned by the parser and the same object after every edit
+        Program* getProgram();
+
+        // returns the errors of the whole buffer, in source order, as a full parse reports them
+        std::vector<std::string> getErrors() const;
+
+        // returns the current contents of the buffer
+        std::string getSource() const;
+
+        // returns the number of top level statements the last edit or the constructor parsed
+        size_t parsedStatements() const;
+
+    private:
+        // what one call to parseStatementOrRecover produced, which is at most one statement
+        struct Chunk {
+            uint32_t start; // offset of the chunk's first token
+            Statement* statement; // nullptr if it had errors
+            std::vector<std::string> errors;
+        };
+
+        // helper which parses from offset from, the start of chunk first or 0, until a parsed chunk starts
+        // where an old chunk whose start is after limit and after every chunk with errors used to start,
+        // then replaces the chunks in between and shifts the old chunks after them by delta
+        void reparse(size_t first, uint32_t from, size_t limit, int64_t delta);
+
+        // helper which rebuilds the statements of the program from the chunks
+        void collectStatements();
+
+        //vars
+        std::string buffer; // contents followed by the padding the lexer needs
+        std::vector<Chunk> chunks;
+        Program program;
+        size_t parsed = 0;
+};
+
+#endif // INCREMENTAL_H
@@ -1,23 +1,36 @@
 #include "lexer.h"
+#include <algorithm>
+#include "scan.h"
 
 
 // default lexer constructor
-Lexer::Lexer(){
-    input = "";
-    position = 0;
-    read_position = 0;
-    ch = '\0';
-};
+Lexer::Lexer(): Lexer(std::make_shared<StringSource>("")){
+}
 
 
 // Lexer constructor
 // REQUIRES: input is a string
 // EFFECTS:  creates a Lexer object
-Lexer::Lexer(std::string input){
-    this->input = input;
-    position = 0;
-    read_position = 1;
-    ch = input[position];
+Lexer::Lexer(std::string input): Lexer(std::make_shared<StringSource>(std::move(input))){
+}
+
+// source constructor, reads from a source such as a MappedFileSource
+Lexer::Lexer(std::shared_ptr<LexerSource> source): Lexer(source, 0){
+}
+
+// source constructor which starts lexing at start instead of the beginning
+Lexer::Lexer(std::shared_ptr<LexerSource> source, size_t start){
+    this->source = source;
+    input = source->data;
+    length = source->length;
+    position = start;
+    read_position = start;
+    token_start = start;
+    readChar();
+}
+
+// stream constructor, reads in through a fixed size window which is refilled as it is lexed
+Lexer::Lexer(std::istream& in): Lexer(std::make_shared<StreamSource>(in)){
 }
 
 // Get the next token
@@ -26,6 +39,8 @@ Token Lexer::nextToken(){
     Token tok;
 
     skipWhitespace();
+    token_start = position;
+    uint32_t offset = (uint32_t)std::min<size_t>(source->start + token_start, UNKNOWN_OFFSET - 1);
 
     switch(ch){
         case '=':
@@ -97,31 +112,47 @@ Token Lexer::nextToken(){
             tok = Token{TokenType::COLON, ":"};
             break;
         default:
-            if(isalpha(ch) || ch == '_'){
+            if(inClass(ch, CLASS_IDENTIFIER)){
                 tok.literal = readIdentifier();
                 tok.type = checkKeyword(tok.literal);
+                tok.offset = offset;
                 return tok; // this is needed because readIdentifier uses readChar so we don't want to do it again
             }
-            else if(isdigit(ch)){
+            else if(inClass(ch, CLASS_DIGIT)){
                 tok.literal = readDigit();
                 tok.type = TokenType::INT;
+                tok.offset = offset;
                 return tok; // this is needed because readIdentifier uses readChar so we don't want to do it again
             }
             else
                 tok = Token{TokenType::ILLEGAL, ""};
     }
     readChar();
+    tok.offset = offset;
     return tok;
 }
 
+// finds the line and column of the token starting at offset
+SourceLocation Lexer::locate(uint32_t offset){
+    return source->locate(offset);
+}
+
+// returns the line of the source holding the token starting at offset
+std::string Lexer::lineAt(uint32_t offset){
+    return source->lineAt(offset);
+}
+
 // Read the next character
 // MODIFIES: ch, position, read_position
 // EFFECTS:  reads the next character in the input
 void Lexer::readChar(){
-    if(read_position >= input.length()){
-        ch = 0;
-    }
-    else{
+    ch = input[read_position];
+    if(ch == '\0' && read_position >= length){ // only the sentinel needs the slow path
+        if(!refill()){
+            position = length; // stay on the sentinel however many more times we are called
+            read_position = length;
+            return;
+        }
         ch = input[read_position];
     }
     position = read_position;
@@ -131,22 +162,33 @@ void Lexer::readChar(){
 // Peak at the next char
 // EFFECTS:  returns the next character in the input
 char Lexer::peekChar(){
-    if(read_position >= input.length()){
-        return 0;
-    }
-    else{
-        return input[read_position];
-    }
+    char next = input[read_position];
+    if(next == '\0' && read_position >= length && refill())
+        next = input[read_position];
+    return next;
+}
+
+// Called when the sentinel is read to pull more input from a streaming source
+bool Lexer::refill(){
+    size_t keep = std::min(token_start, position);
+    if(!source->refill(keep))
+        return false;
+    input = source->data;
+    length = source->length;
+    position -= keep;
+    read_position -= keep;
+    token_start -= keep;
+    return true;
 }
 
 // Read an identifier
 // EFFECTS:  reads an identifier string from the input
 std::string Lexer::readIdentifier(){
-    size_t initial_position = position;
-    while(isalpha(ch) || ch == '_'){
-        readChar();
+    while(inClass(ch, CLASS_IDENTIFIER)){
+        read_position = (size_t)(scanRuns.identifier(input + read_position) - input); // jump to the end of the run
+        readChar(); // refills if the run went up to the sentinel
     }
-    return input.substr(initial_position, position - initial_position);
+    return std::string(input + token_start, position - token_start);
 }
 
 // Check type of string
@@ -162,26 +204,30 @@ TokenType Lexer::checkKeyword(std::string identifier){
 // Skips whitespace
 // EFFECTS: skips the whitespace in input until ch is not whitespace
 void Lexer::skipWhitespace(){
-    while(ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r')
+    while(inClass(ch, CLASS_WHITESPACE)){
+        position = (size_t)(scanRuns.whitespace(input + read_position) - input) - 1; // last byte of the run
+        read_position = position + 1;
+        token_start = position; // nothing before here is needed if the window is refilled
         readChar();
+    }
 }
 
 // Read digits
 // EFFECTS: reads in digits from the input
 std::string Lexer::readDigit(){
-    size_t initial_position = position;
-    while(isdigit(ch))
+    while(inClass(ch, CLASS_DIGIT)){
+        read_position = (size_t)(scanRuns.digits(input + read_position) - input);
         readChar();
-    return input.substr(initial_position, position-initial_position);
+    }
+    return std::string(input + token_start, position - token_start);
 }
 
 // Reads a string as input and processes to put in as a literal
 std::string Lexer::readString(){
-    size_t beginIndex = position +1;
-    while(true){
+    readChar(); // past the opening quote
+    while(!inClass(ch, CLASS_STRING_END)){
+        read_position = (size_t)(scanRuns.stringEnd(input + read_position) - input);
         readChar();
-        if(ch == '\"' || ch == 0)
-            break;
     }
-    return input.substr(beginIndex, position-beginIndex);
+    return std::string(input + token_start + 1, position - token_start - 1);
 }
\ No newline at end of file
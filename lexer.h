@@ -3,8 +3,11 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include <istream>
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include "lexersource.h"
 
 enum class TokenType : uint8_t {
     IDENT, // identifier for vars and function names
@@ -38,12 +41,28 @@ enum class TokenType : uint8_t {
     LBRACKET,
     RBRACKET,
     COLON,
+    WHILE,
+    FOR,
+    IN,
+    LAST = IN, // the highest type, kept the last one listed so types read back from files can be range checked
 };
 
 
 
+// offset of tokens which were not lexed from a source
+static const uint32_t UNKNOWN_OFFSET = UINT32_MAX;
+
 struct Token {
-    TokenType type;
+    // default constructor, an ILLEGAL token with no literal or offset
+    Token(){}
+
+    // constructor
+    Token(TokenType type, std::string literal, uint32_t offset = UNKNOWN_OFFSET):
+    type(type), offset(offset), literal(std::move(literal)){}
+
+    //vars
+    TokenType type = TokenType::ILLEGAL;
+    uint32_t offset = UNKNOWN_OFFSET; // byte offset of the token in its source, fits in the padding after type
     std::string literal;
 };
 
@@ -80,6 +99,9 @@ class Lexer{
             {TokenType::LBRACKET, "["},
             {TokenType::RBRACKET, "]"},
             {TokenType::COLON, ":"},
+            {TokenType::WHILE, "WHILE"},
+            {TokenType::FOR, "FOR"},
+            {TokenType::IN, "IN"},
             };
 
         // Lexer constructor
@@ -87,6 +109,19 @@ class Lexer{
         // EFFECTS:  creates a Lexer object
         Lexer(std::string input);
 
+        // source constructor, reads from a source such as a MappedFileSource
+        // EFFECTS:  creates a Lexer object over source, copies of the lexer share it
+        Lexer(std::shared_ptr<LexerSource> source);
+
+        // source constructor which starts lexing at start instead of the beginning
+        // REQUIRES: start <= source->length and is the start of a token or whitespace in a whole source
+        Lexer(std::shared_ptr<LexerSource> source, size_t start);
+
+        // stream constructor, reads in through a fixed size window which is refilled as it is lexed
+        // REQUIRES: in outlives the lexer, copies of a stream lexer must not be used side by side
+        // EFFECTS:  creates a Lexer object over in
+        Lexer(std::istream& in);
+
         // default lexer constructor
         Lexer();
 
@@ -94,10 +129,21 @@ class Lexer{
         // EFFECTS:  returns the next token in the input
         Token nextToken();
 
+        // finds the line and column of the token starting at offset
+        // REQUIRES: offset came from a token of this lexer
+        SourceLocation locate(uint32_t offset);
+
+        // returns the line of the source holding the token starting at offset, "" if it has been dropped
+        // REQUIRES: offset came from a token of this lexer
+        std::string lineAt(uint32_t offset);
+
     private:
-        std::string input;
+        std::shared_ptr<LexerSource> source; // owns the characters input points into
+        const char* input; // characters being lexed, followed by a '\0' sentinel at input[length]
+        size_t length; // number of characters in input
         size_t position; // current position in input
         size_t read_position; // current reading position in input (after current char)
+        size_t token_start; // position of the start of the token being read, kept across refills
         char ch; // current char under examination
         std::unordered_map<std::string, TokenType> keywords{ // map of the keywords in the language
             {"fn", TokenType::FUNCTION},
@@ -106,7 +152,10 @@ class Lexer{
             {"false", TokenType::FALSE},
             {"return", TokenType::RETURN},
             {"if", TokenType::IF},
-            {"else", TokenType::ELSE}
+            {"else", TokenType::ELSE},
+            {"while", TokenType::WHILE},
+            {"for", TokenType::FOR},
+            {"in", TokenType::IN}
         };
 
         
@@ -120,6 +169,11 @@ class Lexer{
         // EFFECTS:  returns the next character in the input
         char peekChar();
 
+        // Called when the sentinel is read to pull more input from a streaming source
+        // MODIFIES: input, length, position, read_position, token_start
+        // EFFECTS:  returns false if the sentinel really is the end of the input
+        bool refill();
+
         // Read an identifier
         // EFFECTS:  reads an identifier string from the input
         std::string readIdentifier();
@@ -0,0 +1,160 @@
+// definitions for lexersource.h
+
+#include "lexersource.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// sentinel and padding used by sources with no characters at all
+static const char emptyInput[LexerSource::SOURCE_PADDING] = {};
+
+// records the lines starting within text, which holds the input from offset onwards
+void LineIndex::extend(const char* text, size_t length, size_t offset){
+    if(offset + length <= end)
+        return;
+    const char* p = text + (end - offset); // skip what is already indexed
+    const char* last = text + length;
+    while((p = static_cast<const char*>(std::memchr(p, '\n', (size_t)(last - p)))) != nullptr){
+        p++;
+        lineStarts.push_back((uint32_t)std::min<size_t>((size_t)(p - text) + offset, UINT32_MAX));
+    }
+    end = offset + length;
+}
+
+// returns the number of bytes of the input indexed so far
+size_t LineIndex::indexed() const{
+    return end;
+}
+
+// finds the line and column of the byte at offset
+SourceLocation LineIndex::locate(uint32_t offset) const{
+    auto next = std::upper_bound(lineStarts.begin(), lineStarts.end(), offset); // first line after offset
+    size_t line = (size_t)(next - lineStarts.begin());
+    return SourceLocation{(uint32_t)line, offset - lineStarts[line - 1] + 1};
+}
+
+// drops the characters before keep and reads more of the input after the rest
+bool LexerSource::refill(size_t){
+    return false; // whole input is already in memory
+}
+
+// finds the line and column of the byte at offset in the whole input
+SourceLocation LexerSource::locate(uint32_t offset){
+    lines.extend(data, length, start);
+    return lines.locate((uint32_t)std::min<size_t>(offset, lines.indexed()));
+}
+
+// returns the line of the input holding the byte at offset
+std::string LexerSource::lineAt(uint32_t offset){
+    offset = (uint32_t)std::min<size_t>(offset, start + length);
+    size_t lineStart = offset - (locate(offset).column - 1);
+    if(lineStart < start)
+        return "";
+    const char* first = data + (lineStart - start);
+    const char* last = static_cast<const char*>(std::memchr(first, '\n', (size_t)(data + length - first)));
+    return std::string(first, last != nullptr ? last : data + length);
+}
+
+// constructor, takes ownership of the string and pads it with the sentinel
+StringSource::StringSource(std::string input){
+    storage = std::move(input);
+    length = storage.size();
+    storage.append(SOURCE_PADDING, '\0');
+    data = storage.data();
+}
+
+// constructor, an empty input
+AppendableSource::AppendableSource(){
+    storage.assign(SOURCE_PADDING, '\0');
+    data = storage.data();
+}
+
+// appends text to the input and pads it with the sentinel
+void AppendableSource::append(const std::string& text){
+    storage.resize(length); // the padding, the capacity is kept so appending is amortized constant time
+    storage += text;
+    storage.append(SOURCE_PADDING, '\0');
+    length += text.size();
+    data = storage.data();
+}
+
+// constructor, reads data without copying it
+BorrowedSource::BorrowedSource(const char* data, size_t length){
+    this->data = data;
+    this->length = length;
+}
+
+// constructor, maps the file at path
+MappedFileSource::MappedFileSource(const std::string& path){
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("could not open " + path);
+    struct stat info;
+    if(fstat(fd, &info) != 0){
+        close(fd);
+        throw std::runtime_error("could not stat " + path);
+    }
+    length = (size_t)info.st_size;
+    if(length == 0){
+        close(fd);
+        data = emptyInput;
+        return;
+    }
+
+    // reserve an extra zeroed page past the end of the file then map the file over the start of it,
+    // the rest of the file's last page is zero filled too so there is always a sentinel after it
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    regionSize = (length + page - 1) / page * page + page;
+    region = mmap(nullptr, regionSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(region == MAP_FAILED){
+        close(fd);
+        region = nullptr;
+        throw std::runtime_error("could not map " + path);
+    }
+    void* mapped = mmap(region, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED){
+        munmap(region, regionSize);
+        region = nullptr;
+        throw std::runtime_error("could not map " + path);
+    }
+    madvise(region, length, MADV_SEQUENTIAL);
+    data = static_cast<const char*>(region);
+}
+
+// destructor unmaps the file
+MappedFileSource::~MappedFileSource(){
+    if(region)
+        munmap(region, regionSize);
+}
+
+// constructor, reads the first window of in
+StreamSource::StreamSource(std::istream& in, size_t window): stream(in), window(window){
+    buffer.resize(window + SOURCE_PADDING);
+    data = buffer.data();
+    refill(0);
+}
+
+// drops the characters before keep and reads more of the stream after the rest
+bool StreamSource::refill(size_t keep){
+    if(!stream || stream.peek() == std::char_traits<char>::eof())
+        return false; // nothing more to read, keep everything where the lexer expects it
+    lines.extend(data, keep, start); // lines before keep can't be indexed once they are dropped
+    start += keep;
+    size_t kept = length - keep;
+    std::memmove(buffer.data(), buffer.data() + keep, kept);
+    size_t space = buffer.size() - SOURCE_PADDING - kept;
+    if(space == 0 || space < window / 2) // a token is filling the window, grow it
+        buffer.resize(kept + window + SOURCE_PADDING);
+
+    stream.read(buffer.data() + kept, (std::streamsize)(buffer.size() - SOURCE_PADDING - kept));
+    size_t got = (size_t)stream.gcount();
+    length = kept + got;
+    std::memset(buffer.data() + length, 0, SOURCE_PADDING);
+    data = buffer.data();
+    return got > 0;
+}
@@ -0,0 +1,138 @@
+// character sources the Lexer reads from
+
+#ifndef LEXERSOURCE_H
+#define LEXERSOURCE_H
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+// line and column of a byte of the input, both counted from 1
+struct SourceLocation {
+    uint32_t line;
+    uint32_t column;
+};
+
+// index of the offsets each line of the input starts at, only built as far as it is needed
+class LineIndex {
+    public:
+        // records the lines starting within text, which holds the input from offset onwards
+        // REQUIRES: offset <= indexed()
+        void extend(const char* text, size_t length, size_t offset);
+
+        // returns the number of bytes of the input indexed so far
+        size_t indexed() const;
+
+        // finds the line and column of the byte at offset
+        // REQUIRES: offset <= indexed()
+        SourceLocation locate(uint32_t offset) const;
+
+    private:
+        std::vector<uint32_t> lineStarts = {0}; // offset of the first byte of each line
+        size_t end = 0; // bytes of the input scanned for line starts
+};
+
+// base class of the storage a Lexer reads, data always has length characters followed by at least
+// SOURCE_PADDING '\0' bytes so the lexer only checks for the end of input when it reads a '\0'
+class LexerSource {
+    public:
+        static const size_t SOURCE_PADDING = 64;
+
+        virtual ~LexerSource() = default;
+
+        // drops the characters before keep and reads more of the input after the rest
+        // REQUIRES: keep <= length
+        // EFFECTS:  returns false and drops nothing if there was nothing more to read, data may
+        //           move if true
+        virtual bool refill(size_t keep);
+
+        // finds the line and column of the byte at offset in the whole input, indexing the
+        // lines of the input the first time it is called
+        SourceLocation locate(uint32_t offset);
+
+        // returns the line of the input holding the byte at offset, without its newline
+        // EFFECTS:  returns "" if a stream has already dropped the start of the line
+        std::string lineAt(uint32_t offset);
+
+        //vars
+        const char* data = nullptr; // characters of the input currently available
+        size_t length = 0; // number of characters in data before the sentinel
+        size_t start = 0; // offset of data[0] in the whole input, grows as a stream drops what it has lexed
+
+    protected:
+        LineIndex lines; // sources which drop input index it before it is dropped
+};
+
+// source over a string held in memory
+class StringSource : public LexerSource {
+    public:
+        // constructor, takes ownership of the string and pads it with the sentinel
+        StringSource(std::string input);
+
+    private:
+        std::string storage;
+};
+
+// source over a string appended to a piece at a time, like the lines typed into a REPL, so a lexer can be
+// created over each piece as it arrives without copying what came before
+class AppendableSource : public LexerSource {
+    public:
+        // constructor, an empty input
+        AppendableSource();
+
+        // appends text to the input and pads it with the sentinel
+        // EFFECTS:  data may move, so lexers created before must not lex any further, locating with them
+        //           still works as it reads the source rather than their copy of data
+        void append(const std::string& text);
+
+    private:
+        std::string storage;
+};
+
+// source over characters owned by something else which are already followed by the padding, like the
+// data of another source when several lexers read it at once
+class BorrowedSource : public LexerSource {
+    public:
+        // constructor
+        // REQUIRES: data is followed by SOURCE_PADDING '\0' bytes and outlives the source
+        BorrowedSource(const char* data, size_t length);
+};
+
+// source over a read only memory mapped file, the file is never copied onto the heap
+class MappedFileSource : public LexerSource {
+    public:
+        // constructor
+        // EFFECTS:  maps the file at path, throws std::runtime_error if it can't be opened or mapped
+        MappedFileSource(const std::string& path);
+
+        // destructor unmaps the file
+        ~MappedFileSource();
+
+        MappedFileSource(const MappedFileSource&) = delete;
+        MappedFileSource& operator=(const MappedFileSource&) = delete;
+
+    private:
+        void* region = nullptr; // mapping of the file plus a zeroed page after it for the sentinel
+        size_t regionSize = 0;
+};
+
+// source over an input stream read through a fixed size window which is refilled as the lexer
+// reaches the end of it, the window only grows when a single token is longer than it
+class StreamSource : public LexerSource {
+    public:
+        static const size_t DEFAULT_WINDOW = 1 << 16;
+
+        // constructor, reads the first window of in
+        StreamSource(std::istream& in, size_t window = DEFAULT_WINDOW);
+
+        // drops the characters before keep and reads more of the stream after the rest
+        bool refill(size_t keep) override;
+
+    private:
+        std::istream& stream;
+        size_t window;
+        std::vector<char> buffer;
+};
+
+#endif // LEXERSOURCE_H
@@ -1,12 +1,164 @@
 // main runner for interpreter
 
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include "allocationprofile.h"
+#include "flateval.h"
+#include "heap.h"
+#include "nodeprofile.h"
+#include "parallelparser.h"
+#include "programcache.h"
 #include "repl.h"
+#include "sampleprofiler.h"
+#include "tracing.h"
 
-int main(){
+// traces the run into the file at path from its construction, writing the trace when it is destroyed
+// however the run ends
+struct TraceFile {
+    const char* path;
+    Lexer* lexer;
+
+    TraceFile(const char* path, Lexer* lexer): path(path), lexer(lexer){
+        if(path != nullptr)
+            startTracing();
+    }
+
+    ~TraceFile(){
+        if(path == nullptr)
+            return;
+        stopTracing();
+        std::ofstream file(path);
+        file<<traceJson(lexer);
+        if(!file)
+            std::cerr<<"could not write the trace to "<<path<<"\n";
+        if(droppedTraceEvents() != 0)
+            std::cerr<<"the trace dropped "<<droppedTraceEvents()<<" events\n";
+    }
+};
+
+// runs the program in the file at path, or standard input if path is "-", without copying it onto the heap
+// files are only parsed if the directory in MONKEY_CACHE_DIR, when set, has no parse of them cached, and
+// are parsed in chunks on the thread pool, a cached parse is evaluated as it is unless a profiler needs Nodes
+// EFFECTS:  returns the exit status, 1 if the program could not be read, parsed or evaluated
+int runFile(const std::string& path){
+    std::shared_ptr<LexerSource> source;
+    try{
+        if(path == "-")
+            source = std::make_shared<StreamSource>(std::cin);
+        else
+            source = std::make_shared<MappedFileSource>(path);
+    }
+    catch(const std::runtime_error& e){
+        std::cerr<<e.what()<<"\n";
+        return 1;
+    }
+
+    // a stream is dropped as it is lexed so only whole files can be hashed up front
+    const char* cacheDirectory = std::getenv("MONKEY_CACHE_DIR");
+    std::unique_ptr<ProgramCache> cache;
+    if(cacheDirectory != nullptr && *cacheDirectory != '\0' && path != "-")
+        cache = std::make_unique<ProgramCache>(cacheDirectory);
+
+    Lexer lexer = Lexer(source); // kept even when the program is cached to locate runtime errors
+
+    // MONKEY_TRACE, when set, is a file the run's trace is written to in Chrome's trace-event format, with
+    // function calls shorter than MONKEY_TRACE_MIN_US microseconds left out
+    const char* tracePath = std::getenv("MONKEY_TRACE");
+    const char* traceMinimum = std::getenv("MONKEY_TRACE_MIN_US");
+    if(traceMinimum != nullptr && *traceMinimum != '\0')
+        traceCallThreshold = std::chrono::microseconds(std::strtol(traceMinimum, nullptr, 10));
+    TraceFile trace(tracePath != nullptr && *tracePath != '\0' ? tracePath : nullptr, &lexer);
+
+    Program* program = nullptr;
+    FlatAst flat;
+    if(cache){
+        TraceSpan span(TRACE_PHASE, "load cached parse");
+        cache->load(source->data, source->length, flat);
+    }
+    if(flat.size() == 0){
+        TraceSpan span(TRACE_PHASE, "parse");
+        std::vector<std::string> errors;
+        if(path == "-"){
+            Parser parser = Parser(&lexer);
+            program = parser.parseProgram();
+            errors = parser.errors;
+        }
+        else{
+            program = parseProgramParallel(source, errors); // a whole file can be split up front
+        }
+        if(errors.size() != 0){
+            for(std::string& error: errors)
+                std::cerr<<error<<"\n";
+            return 1;
+        }
+        if(cache)
+            cache->store(source->data, source->length, program);
+    }
+
+    // MONKEY_ALLOC_PROFILE, when set, is the number of top allocation sites reported on standard error
+    const char* profile = std::getenv("MONKEY_ALLOC_PROFILE");
+    allocationProfiling = profile != nullptr && *profile != '\0';
+
+    // MONKEY_PROFILE, when set, is a file the run's samples are written to as collapsed stacks
+    const char* samplesPath = std::getenv("MONKEY_PROFILE");
+    bool sampled = samplesPath != nullptr && *samplesPath != '\0' && startSampling();
+
+    // MONKEY_NODE_PROFILE, when set, is a file the evaluations of each node are written to as JSON
+    const char* nodesPath = std::getenv("MONKEY_NODE_PROFILE");
+    nodeProfiling = nodesPath != nullptr && *nodesPath != '\0';
+
+    if(program == nullptr && (allocationProfiling || sampled || nodeProfiling || tracing)){
+        TraceSpan span(TRACE_PHASE, "rebuild cached parse");
+        program = flat.toProgram();
+    }
+
+    Environment env = Environment();
+    Value result;
+    {
+        TraceSpan span(TRACE_PHASE, "evaluate");
+        result = program != nullptr ? Eval(program, &env) : evalFlat(flat, &env);
+    }
+    standardOutput().flush();
+    if(nodeProfiling){
+        std::ofstream nodesFile(nodesPath);
+        nodesFile<<nodeProfileJson(nodeProfile(), &lexer);
+        if(!nodesFile)
+            std::cerr<<"could not write the node profile to "<<nodesPath<<"\n";
+    }
+    if(sampled){
+        stopSampling();
+        std::ofstream samplesFile(samplesPath);
+        samplesFile<<collapsedStacks(&lexer);
+        if(!samplesFile)
+            std::cerr<<"could not write samples to "<<samplesPath<<"\n";
+    }
+    if(allocationProfiling)
+        std::cerr<<formatAllocationReport(allocationProfile(), (size_t)std::strtoul(profile, nullptr, 10), &lexer);
+    if(isError(result)){
+        uint32_t offset = static_cast<Error*>(result.asObject())->offset;
+        if(offset != UNKNOWN_OFFSET){
+            SourceLocation location = lexer.locate(offset);
+            std::cerr<<location.line<<":"<<location.column<<": ";
+        }
+        std::cerr<<result.inspect()<<"\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]){
+    // MONKEY_GC_PAUSE_US, when set, is the longest in microseconds a collection may pause evaluation for
+    const char* pause = std::getenv("MONKEY_GC_PAUSE_US");
+    if(pause != nullptr && *pause != '\0')
+        collectionPauseBudget = std::chrono::microseconds(std::strtol(pause, nullptr, 10));
+    if(argc > 1)
+        return runFile(argv[1]);
     REPL repl;
     std::cout<<"Welcome to the Monkey programming language REPL!"<<std::endl;
     repl.start();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,350 @@
+// definitions for nodeprofile.h
+
+#include "nodeprofile.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <typeinfo>
+#include <unordered_map>
+
+bool nodeProfiling = false;
+
+// nodes keep at most this many characters of their source text in reports, JSON keeps all of it
+static const size_t REPORT_SOURCE_LENGTH = 60;
+
+// an evaluation a NodeTimer is timing
+struct RunningTimer {
+    std::chrono::steady_clock::time_point started;
+    NodeCounter* counter; // null for builtins
+    KindCounter* kindCounter;
+    bool application;
+};
+
+// what the profiler keeps for each thread which evaluates, only touched by that thread outside of the
+// functions which read the counts, which run while no thread is evaluating
+struct ThreadNodeProfile {
+    std::unordered_map<Node*, NodeCounter> nodes;
+    std::array<KindCounter, PROFILED_KINDS> kinds;
+    std::vector<RunningTimer> running; // innermost last
+};
+
+// the profiles of every thread
+struct NodeProfiler {
+    std::mutex lock; // guards threads
+    std::vector<ThreadNodeProfile*> threads;
+    ThreadNodeProfile exited; // counts of threads which have exited
+};
+
+// the profiler, never destroyed so threads may exit during static destruction
+static NodeProfiler& profiler(){
+    static NodeProfiler* instance = new NodeProfiler();
+    return *instance;
+}
+
+// helper which adds the counts of from to to
+static void add(EvaluationCounts& to, const EvaluationCounts& from){
+    to.evaluations += from.evaluations;
+    to.nanoseconds += from.nanoseconds;
+}
+
+// helper which merges the counts of from into to
+static void merge(ThreadNodeProfile& to, const ThreadNodeProfile& from){
+    for(size_t kind = 0; kind < PROFILED_KINDS; kind++)
+        add(to.kinds[kind].counts, from.kinds[kind].counts);
+    for(auto& entry: from.nodes){
+        auto found = to.nodes.find(entry.first);
+        if(found == to.nodes.end()){
+            to.nodes.emplace(entry.first, entry.second);
+            continue;
+        }
+        add(found->second.evaluated, entry.second.evaluated);
+        add(found->second.applied, entry.second.applied);
+    }
+}
+
+// moves the counts of the thread's profile to the exited one when the thread exits
+struct ThreadNodeProfileOwner {
+    ThreadNodeProfile* thread = nullptr;
+
+    ~ThreadNodeProfileOwner(){
+        if(thread == nullptr)
+            return;
+        NodeProfiler& instance = profiler();
+        std::lock_guard<std::mutex> guard(instance.lock);
+        merge(instance.exited, *thread);
+        instance.threads.erase(std::find(instance.threads.begin(), instance.threads.end(), thread));
+        delete thread;
+        thread = nullptr;
+    }
+};
+
+static thread_local ThreadNodeProfileOwner owner;
+
+// returns the calling thread's profile, registering the thread on first use
+static ThreadNodeProfile* thisThreadProfile(){
+    if(owner.thread == nullptr){
+        ThreadNodeProfile* thread = new ThreadNodeProfile();
+        NodeProfiler& instance = profiler();
+        std::lock_guard<std::mutex> guard(instance.lock);
+        instance.threads.push_back(thread);
+        owner.thread = thread;
+    }
+    return owner.thread;
+}
+
+// helper which returns the kind of node
+static size_t kindOf(Node* node){
+    const std::type_info& node_type = typeid(*node);
+    if(node_type == typeid(Program))
+        return (size_t)NodeKind::PROGRAM;
+    else if(node_type == typeid(LetStatement))
+        return (size_t)NodeKind::LET;
+    else if(node_type == typeid(ReturnStatement))
+        return (size_t)NodeKind::RETURN;
+    else if(node_type == typeid(ExpressionStatement))
+        return (size_t)NodeKind::EXPRESSION_STATEMENT;
+    else if(node_type == typeid(BlockStatement))
+        return (size_t)NodeKind::BLOCK;
+    else if(node_type == typeid(AssignStatement))
+        return (size_t)NodeKind::ASSIGN;
+    else if(node_type == typeid(WhileStatement))
+        return (size_t)NodeKind::WHILE;
+    else if(node_type == typeid(ForStatement))
+        return (size_t)NodeKind::FOR;
+    else if(node_type == typeid(Identifier))
+        return (size_t)NodeKind::IDENTIFIER;
+    else if(node_type == typeid(IntegerLiteral))
+        return (size_t)NodeKind::INTEGER;
+    else if(node_type == typeid(StringLiteral))
+        return (size_t)NodeKind::STRING;
+    else if(node_type == typeid(Boolean))
+        return (size_t)NodeKind::BOOLEAN;
+    else if(node_type == typeid(PrefixExpression))
+        return (size_t)NodeKind::PREFIX;
+    else if(node_type == typeid(InfixExpression))
+        return (size_t)NodeKind::INFIX;
+    else if(node_type == typeid(IfExpression))
+        return (size_t)NodeKind::IF;
+    else if(node_type == typeid(FunctionLiteral))
+        return (size_t)NodeKind::FUNCTION;
+    else if(node_type == typeid(CallExpression))
+        return (size_t)NodeKind::CALL;
+    else if(node_type == typeid(ArrayLiteral))
+        return (size_t)NodeKind::ARRAY;
+    else if(node_type == typeid(IndexExpression))
+        return (size_t)NodeKind::INDEX;
+    return (size_t)NodeKind::HASH;
+}
+
+// starts counting an evaluation of node, or an application of the function created from it or of a
+// builtin if node is null
+bool NodeTimer::start(Node* node, bool application){
+    ThreadNodeProfile* thread = thisThreadProfile();
+    NodeCounter* counter = nullptr;
+    size_t kind = application ? (node == nullptr ? BUILTIN_CALL_KIND : FUNCTION_CALL_KIND) : 0;
+    if(node != nullptr){
+        auto found = thread->nodes.find(node);
+        if(found == thread->nodes.end()){
+            NodeCounter created;
+            created.kind = kindOf(node);
+            found = thread->nodes.emplace(node, created).first;
+        }
+        counter = &found->second;
+        if(!application)
+            kind = counter->kind;
+        (application ? counter->applying : counter->evaluating)++;
+    }
+    KindCounter* kindCounter = &thread->kinds[kind];
+    kindCounter->evaluating++;
+    // the clock is read last so the profiler's own work isn't counted
+    thread->running.push_back({std::chrono::steady_clock::now(), counter, kindCounter, application});
+    return true;
+}
+
+// helper which counts an evaluation which took nanoseconds, the time only if it was the outermost
+static void count(EvaluationCounts& counts, size_t& running, uint64_t nanoseconds){
+    counts.evaluations++;
+    if(--running == 0)
+        counts.nanoseconds += nanoseconds;
+}
+
+// counts the innermost evaluation being timed
+void NodeTimer::stop(){
+    ThreadNodeProfile* thread = thisThreadProfile();
+    RunningTimer timer = thread->running.back();
+    thread->running.pop_back();
+    uint64_t nanoseconds = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - timer.started).count();
+    if(timer.counter != nullptr){
+        if(timer.application)
+            count(timer.counter->applied, timer.counter->applying, nanoseconds);
+        else
+            count(timer.counter->evaluated, timer.counter->evaluating, nanoseconds);
+    }
+    count(timer.kindCounter->counts, timer.kindCounter->evaluating, nanoseconds);
+}
+
+// returns the counts
+NodeProfile nodeProfile(){
+    NodeProfiler& instance = profiler();
+    std::lock_guard<std::mutex> guard(instance.lock);
+    ThreadNodeProfile all = instance.exited;
+    for(ThreadNodeProfile* thread: instance.threads)
+        merge(all, *thread);
+
+    NodeProfile profile;
+    for(size_t kind = 0; kind < PROFILED_KINDS; kind++)
+        profile.kinds[kind] = all.kinds[kind].counts;
+    for(auto& entry: all.nodes)
+        profile.nodes.push_back({entry.first, entry.second.kind, entry.second.evaluated, entry.second.applied});
+    std::sort(profile.nodes.begin(), profile.nodes.end(), [](const NodeProfileEntry& a, const NodeProfileEntry& b){
+        uint64_t aTime = std::max(a.evaluated.nanoseconds, a.applied.nanoseconds);
+        uint64_t bTime = std::max(b.evaluated.nanoseconds, b.applied.nanoseconds);
+        return aTime != bTime ? aTime > bTime : a.node->token.offset < b.node->token.offset;
+    });
+    return profile;
+}
+
+// forgets every count
+void resetNodeProfile(){
+    NodeProfiler& instance = profiler();
+    std::lock_guard<std::mutex> guard(instance.lock);
+    std::vector<ThreadNodeProfile*> all(instance.threads);
+    all.push_back(&instance.exited);
+    for(ThreadNodeProfile* thread: all){
+        thread->nodes.clear();
+        thread->kinds = std::array<KindCounter, PROFILED_KINDS>();
+    }
+}
+
+// returns the name of a kind
+std::string profiledKindName(size_t kind){
+    static const char* names[PROFILED_KINDS] = {
+        "PROGRAM", "LET", "RETURN", "EXPRESSION_STATEMENT", "BLOCK", "ASSIGN", "WHILE", "FOR",
+        "IDENTIFIER", "INTEGER", "STRING", "BOOLEAN", "PREFIX", "INFIX", "IF", "FUNCTION", "CALL",
+        "ARRAY", "INDEX", "HASH", "FUNCTION_CALL", "BUILTIN_CALL",
+    };
+    return names[kind];
+}
+
+// helper which returns the source text of node on one line
+static std::string sourceOf(Node* node){
+    std::string source = node->toString();
+    std::replace(source.begin(), source.end(), '\n', ' ');
+    return source;
+}
+
+// helper which returns where offset is in the source, as "line:column" if lexer is given
+static std::string locationOf(uint32_t offset, Lexer* lexer){
+    if(offset == UNKNOWN_OFFSET)
+        return "-";
+    if(lexer == nullptr)
+        return std::to_string(offset);
+    SourceLocation location = lexer->locate(offset);
+    return std::to_string(location.line) + ":" + std::to_string(location.column);
+}
+
+// helper which formats nanoseconds as microseconds with one decimal
+static std::string micros(uint64_t nanoseconds){
+    return std::to_string(nanoseconds / 1000) + "." + std::to_string(nanoseconds / 100 % 10);
+}
+
+// helper which pads text with spaces on the left up to width
+static std::string padLeft(const std::string& text, size_t width){
+    return text.size() >= width ? text : std::string(width - text.size(), ' ') + text;
+}
+
+// helper which pads text with spaces on the right up to width
+static std::string padRight(const std::string& text, size_t width){
+    return text.size() >= width ? text : text + std::string(width - text.size(), ' ');
+}
+
+// formats profile as a table of kinds followed by the top nodes
+std::string formatNodeReport(const NodeProfile& profile, size_t top, Lexer* lexer){
+    std::string report = padRight("kind", 22) + padLeft("evaluations", 14) + padLeft("inclusive us", 16) + "\n";
+    for(size_t kind = 0; kind < PROFILED_KINDS; kind++){
+        const EvaluationCounts& counts = profile.kinds[kind];
+        if(counts.evaluations == 0)
+            continue;
+        report += padRight(profiledKindName(kind), 22) + padLeft(std::to_string(counts.evaluations), 14) +
+            padLeft(micros(counts.nanoseconds), 16) + "\n";
+    }
+
+    size_t shown = std::min(top, profile.nodes.size());
+    if(shown == 0)
+        return report;
+    report += "\ntop " + std::to_string(shown) + " nodes by inclusive time\n";
+    for(size_t i = 0; i < shown; i++){
+        const NodeProfileEntry& entry = profile.nodes[i];
+        std::string source = sourceOf(entry.node);
+        if(source.size() > REPORT_SOURCE_LENGTH)
+            source = source.substr(0, REPORT_SOURCE_LENGTH - 3) + "...";
+        report += padLeft(micros(entry.evaluated.nanoseconds), 12) + padLeft(std::to_string(entry.evaluated.evaluations), 10) +
+            "  " + padRight(locationOf(entry.node->token.offset, lexer), 9) + padRight(profiledKindName(entry.kind), 22) + source;
+        if(entry.applied.evaluations != 0)
+            report += "  [called " + std::to_string(entry.applied.evaluations) + " times, " +
+                micros(entry.applied.nanoseconds) + " us]";
+        report += "\n";
+    }
+    return report;
+}
+
+// helper which quotes text as a JSON string
+static std::string jsonString(const std::string& text){
+    static const char* hex = "0123456789abcdef";
+    std::string quoted = "\"";
+    for(char c: text){
+        if(c == '"' || c == '\\'){
+            quoted += '\\';
+            quoted += c;
+        }
+        else if((unsigned char)c < 0x20){
+            quoted += "\\u00";
+            quoted += hex[(unsigned char)c >> 4];
+            quoted += hex[(unsigned char)c & 0xf];
+        }
+        else
+            quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// helper which formats counts as the members of a JSON object
+static std::string jsonCounts(const EvaluationCounts& counts){
+    return "\"evaluations\": " + std::to_string(counts.evaluations) + ", \"nanoseconds\": " +
+        std::to_string(counts.nanoseconds);
+}
+
+// formats profile as JSON
+std::string nodeProfileJson(const NodeProfile& profile, Lexer* lexer){
+    std::string json = "{\n  \"kinds\": [";
+    bool first = true;
+    for(size_t kind = 0; kind < PROFILED_KINDS; kind++){
+        if(profile.kinds[kind].evaluations == 0)
+            continue;
+        json += std::string(first ? "" : ",") + "\n    {\"kind\": " + jsonString(profiledKindName(kind)) + ", " +
+            jsonCounts(profile.kinds[kind]) + "}";
+        first = false;
+    }
+    json += "\n  ],\n  \"nodes\": [";
+    first = true;
+    for(const NodeProfileEntry& entry: profile.nodes){
+        uint32_t offset = entry.node->token.offset;
+        json += std::string(first ? "" : ",") + "\n    {\"kind\": " + jsonString(profiledKindName(entry.kind));
+        if(offset != UNKNOWN_OFFSET)
+            json += ", \"offset\": " + std::to_string(offset);
+        if(offset != UNKNOWN_OFFSET && lexer != nullptr){
+            SourceLocation location = lexer->locate(offset);
+            json += ", \"line\": " + std::to_string(location.line) + ", \"column\": " + std::to_string(location.column);
+            std::string line = lexer->lineAt(offset);
+            if(!line.empty())
+                json += ", \"source\": " + jsonString(line);
+        }
+        json += ", \"node\": " + jsonString(sourceOf(entry.node)) + ", " + jsonCounts(entry.evaluated);
+        if(entry.applied.evaluations != 0)
+            json += ", \"calls\": {" + jsonCounts(entry.applied) + "}";
+        json += "}";
+        first = false;
+    }
+    return json + "\n  ]\n}\n";
+}
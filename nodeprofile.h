@@ -0,0 +1,105 @@
+// execution profiler which counts how often each AST node is evaluated and the time spent evaluating it
+
+#ifndef NODEPROFILE_H
+#define NODEPROFILE_H
+
+#include <array>
+#include <string>
+#include <vector>
+#include "ast.h"
+#include "flatast.h"
+#include "lexer.h"
+
+// Eval and applyFunction time themselves with a NodeTimer while profiling is on, which counts the
+// evaluation against the node and against its kind. Times are inclusive of the children, a node or
+// kind evaluated inside an evaluation of itself, like a call in a recursive function, only counts the
+// outermost evaluation's time so nothing is counted twice.
+
+// whether evaluations are counted, off by default as every evaluation then reads the clock twice
+extern bool nodeProfiling;
+
+// kinds the profile adds up, one for each NodeKind followed by applications of functions and builtins
+static const size_t FUNCTION_CALL_KIND = (size_t)NodeKind::HASH + 1;
+static const size_t BUILTIN_CALL_KIND = FUNCTION_CALL_KIND + 1;
+static const size_t PROFILED_KINDS = BUILTIN_CALL_KIND + 1;
+
+// evaluations of one node or kind and the time they took
+struct EvaluationCounts {
+    size_t evaluations = 0;
+    uint64_t nanoseconds = 0; // inclusive, of the outermost evaluations only
+};
+
+// what was counted for one node
+struct NodeProfileEntry {
+    Node* node;
+    size_t kind;
+    EvaluationCounts evaluated;
+    EvaluationCounts applied; // applications of the functions a FunctionLiteral created
+};
+
+// everything counted since profiling started or was last reset
+struct NodeProfile {
+    std::array<EvaluationCounts, PROFILED_KINDS> kinds;
+    std::vector<NodeProfileEntry> nodes; // most time first
+};
+
+// the counts of one node on one thread, with how many of its evaluations and applications are running
+struct NodeCounter {
+    size_t kind;
+    EvaluationCounts evaluated, applied;
+    size_t evaluating = 0, applying = 0;
+};
+
+// the counts of one kind on one thread, with how many of its evaluations are running
+struct KindCounter {
+    EvaluationCounts counts;
+    size_t evaluating = 0;
+};
+
+// counts an evaluation of node, or an application of the function created from it, while it is alive
+// if profiling is on. Applications of builtins have no node. What is being timed is kept on a stack of
+// the calling thread rather than in the timer so it adds as little as possible to the frames of the
+// evaluator, whose depth limits how deep Monkey code can recurse
+class NodeTimer {
+    public:
+        NodeTimer(Node* node, bool application = false){
+            if(nodeProfiling)
+                active = start(node, application);
+        }
+
+        ~NodeTimer(){
+            if(active)
+                stop();
+        }
+
+        NodeTimer(const NodeTimer&) = delete;
+        NodeTimer& operator=(const NodeTimer&) = delete;
+
+    private:
+        static bool start(Node* node, bool application);
+        static void stop();
+
+        bool active = false;
+};
+
+// returns the counts
+// REQUIRES: no thread is evaluating and the programs the nodes belong to are still alive
+NodeProfile nodeProfile();
+
+// forgets every count
+// REQUIRES: no thread is evaluating
+void resetNodeProfile();
+
+// returns the name of a kind, like "INFIX" or "FUNCTION_CALL"
+std::string profiledKindName(size_t kind);
+
+// formats profile as a table of kinds followed by the top nodes, located with lexer if it is given
+std::string formatNodeReport(const NodeProfile& profile, size_t top, Lexer* lexer = nullptr);
+
+// formats profile as JSON, an object with "kinds" and "nodes" arrays, each node with its kind, offset, the
+// text the node prints as and counts. With lexer each node also has its line and column and, as "source",
+// the text of the source line it starts on
+// REQUIRES: the programs the nodes belong to are still alive, and were lexed by lexer if it is given
+std::string nodeProfileJson(const NodeProfile& profile, Lexer* lexer = nullptr);
+
+#endif // NODEPROFILE_H
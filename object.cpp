@@ -1,11 +1,136 @@
 #include "object.h"
+#include "flatast.h"
+#include "heap.h"
+#include <charconv>
+#include <mutex>
 #include <string>
 
+// the shared objects booleans and null box to
+BooleanObj TRUE = BooleanObj(true);
+BooleanObj FALSE = BooleanObj(false);
+Null NULLOBJ = Null();
+
+// constructor for an object, unboxing the types which have an inline encoding
+Value::Value(Object* object){
+    if(object == nullptr){
+        bits = 0;
+        return;
+    }
+    switch(object->type()){
+        case ObjectType::INTEGER_OBJ:
+            bits = integer(static_cast<Integer*>(object)->value).bits;
+            break;
+        case ObjectType::BOOLEAN_OBJ:
+            bits = boolean(static_cast<BooleanObj*>(object)->value).bits;
+            break;
+        case ObjectType::NULL_OBJ:
+            bits = NULL_TAG;
+            break;
+        default:
+            bits = (uint64_t)reinterpret_cast<uintptr_t>(object);
+    }
+}
+
+// returns the type of the value, only objects need a virtual call
+ObjectType Value::type() const{
+    if(isInteger())
+        return ObjectType::INTEGER_OBJ;
+    if(isBoolean())
+        return ObjectType::BOOLEAN_OBJ;
+    if(isNull())
+        return ObjectType::NULL_OBJ;
+    return asObject()->type();
+}
+
+// returns the value as a string
+std::string Value::inspect() const{
+    if(isObject())
+        return asObject()->inspect();
+    std::string output;
+    OutputSink out(output);
+    inspect(out);
+    return output;
+}
+
+// streams the same text as inspect() into out
+void Value::inspect(OutputSink& out) const{
+    if(isInteger()){
+        char digits[16];
+        std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), asInteger());
+        out.write(digits, (size_t)(result.ptr - digits));
+    }
+    else if(isBoolean() && asBoolean())
+        out.write("true", 4);
+    else if(isBoolean())
+        out.write("false", 5);
+    else if(isNull())
+        out.write("null", 4);
+    else if(isObject())
+        asObject()->inspect(out);
+}
+
+// boxes the value into an Object
+Object* Value::toObject() const{
+    if(isInteger())
+        return new Integer(asInteger());
+    if(isBoolean())
+        return asBoolean() ? &TRUE : &FALSE;
+    if(isNull())
+        return &NULLOBJ;
+    return asObject();
+}
+
+// returns if the value can be a hash key
+bool Value::hashable() const{
+    return isInteger() || isBoolean() || (isObject() && asObject()->type() == ObjectType::STRING_OBJ);
+}
+
+// returns the key of the value in a Hash
+HashKey Value::hashKey() const{
+    if(isInteger())
+        return HashKey{ObjectType::INTEGER_OBJ, asInteger()};
+    if(isBoolean())
+        return HashKey{ObjectType::BOOLEAN_OBJ, asBoolean() ? 1 : 0};
+    return static_cast<String*>(asObject())->hashKey();
+}
+
+// allocates an object on the collected heap
+void* Object::operator new(size_t size){
+    return allocateObject(size);
+}
+
+// releases the memory of an object destroyed by delete
+void Object::operator delete(void* memory){
+    freeObject(memory);
+}
+
+// allocates a builtin outside of the collected heap
+void* Builtin::operator new(size_t size){
+    return allocatePermanentObject(size);
+}
+
+// releases the memory of a builtin
+void Builtin::operator delete(void* memory){
+    freeObject(memory);
+}
+
+// streams the same text as inspect() into out, by default by writing inspect() itself
+void Object::inspect(OutputSink& out){
+    out.write(inspect());
+}
+
 // returns the value of the intger as a string
 std::string Integer::inspect(){
     return std::to_string(value);
 }
 
+// writes the digits of the integer into out
+void Integer::inspect(OutputSink& out){
+    char digits[16];
+    std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.write(digits, (size_t)(result.ptr - digits));
+}
+
 // returns the object type of this particular object INTEGER
 ObjectType Integer::type() {
     return ObjectType::INTEGER_OBJ;
@@ -36,7 +161,12 @@ ObjectType Null::type() {
 
 // returns the value of the intger as a string
 std::string ReturnValue::inspect(){
-    return value->inspect();
+    return value.inspect();
+}
+
+// streams the wrapped value into out
+void ReturnValue::inspect(OutputSink& out){
+    value.inspect(out);
 }
 
 // returns the object type of this particular object INTEGER
@@ -57,6 +187,12 @@ ObjectType Error::type() {
  // returns the value of the intger as a string
 std::string Function::inspect()  {
     std::string output = "fn(";
+    if(flat != nullptr){
+        FlatAst::ChildRange child = flat->children(flatNode);
+        for(size_t i = 0; i + 1 < child.size(); i++)
+            output += (i == 0 ? "" : ",") + flat->literal(child[i]);
+        return output + ") {\n" + flat->toString(child[child.size() - 1]) + "\n}";
+    }
     for(size_t i = 0; i < parameters.size(); i++){
         output += parameters[i]->toString();
         if(i+1 < parameters.size())
@@ -74,9 +210,66 @@ ObjectType Function::type() {
     return ObjectType::FUNCTION_OBJ;
 }
 
+// returns the number of parameters
+size_t Function::parameterCount(){
+    if(flat != nullptr)
+        return flat->children(flatNode).size() - 1;
+    return parameters.size();
+}
+
+// concatenation constructor, represents left + right without copying them unless short
+String::String(String* left, String* right){
+    length = left->length + right->length;
+    if(length <= ROPE_MIN_LENGTH){
+        value.reserve(length);
+        value += left->flatten();
+        value += right->flatten();
+    }
+    else{
+        this->left = left;
+        this->right = right;
+    }
+}
+
+// guards flattening so threads sharing a rope don't build it at the same time
+static std::mutex flattenLock;
+
+// flattens the rope into value if it has not been already
+// done with an explicit stack so long chains of concatenation don't overflow the call stack
+std::string& String::flatten(){
+    if(left.load(std::memory_order_acquire) == nullptr)
+        return value;
+    std::lock_guard<std::mutex> guard(flattenLock);
+    if(left.load(std::memory_order_relaxed) == nullptr) // another thread finished it first
+        return value;
+    std::string result;
+    result.reserve(length);
+    std::vector<String*> pending = {right, left};
+    while(!pending.empty()){
+        String* piece = pending.back();
+        pending.pop_back();
+        if(piece->left == nullptr){
+            result += piece->value;
+        }
+        else{
+            pending.push_back(piece->right);
+            pending.push_back(piece->left);
+        }
+    }
+    value = std::move(result);
+    right = nullptr;
+    left.store(nullptr, std::memory_order_release);
+    return value;
+}
+
 // returns the value of the string
 std::string String::inspect() {
-    return value;
+    return flatten();
+}
+
+// writes the flattened contents of the string into out
+void String::inspect(OutputSink& out){
+    out.write(flatten());
 }
 
 // returns the object type of this particular object INTEGER
@@ -96,14 +289,21 @@ ObjectType Builtin::type() {
 
 // returns the value of the function as a string
 std::string Array::inspect() {
-    std::string output = "[";
+    std::string output;
+    OutputSink out(output);
+    inspect(out);
+    return output;
+}
+
+// streams each element into out without building their strings
+void Array::inspect(OutputSink& out){
+    out.put('[');
     for(size_t i = 0; i < elements.size(); i++){
-        output += elements[i]->inspect();
+        elements[i].inspect(out);
         if(i+1 < elements.size())
-            output += ", ";
+            out.write(", ", 2);
     }
-    output += "]";
-    return output;
+    out.put(']');
 }
 
 // returns the object type of this particular object BUILTIN_OBJ
@@ -124,7 +324,7 @@ HashKey BooleanObj::hashKey(){
 // returns the hash of the object
 HashKey String::hashKey(){
     std::hash<std::string> hasher;
-    return HashKey{type(), (int)hasher(value)};
+    return HashKey{type(), (int)hasher(flatten())};
 }
 
 bool operator==(const HashKey& lhs, const HashKey& rhs){
@@ -145,15 +345,24 @@ HashKey Integer::hashKey(){
 
 // returns the value of the function as a string
 std::string Hash::inspect() {
-    std::string output = "{";
+    std::string output;
+    OutputSink out(output);
+    inspect(out);
+    return output;
+}
+
+// streams each key value pair into out without building their strings
+void Hash::inspect(OutputSink& out){
+    out.put('{');
     for(auto it = pairs.begin(); it != pairs.end(); it++){
-        output += it->second.key->inspect() + ": " + it->second.value->inspect();
+        it->second.key.inspect(out);
+        out.write(": ", 2);
+        it->second.value.inspect(out);
         auto next = it;
         if(++next != pairs.end())
-            output += ", ";
+            out.write(", ", 2);
     }
-    output += "}";
-    return output;
+    out.put('}');
 }
 
 // returns the object type of this particular object BUILTIN_OBJ
@@ -164,10 +373,3 @@ ObjectType Hash::type() {
 std::size_t std::hash<HashKey>::operator()(const HashKey& k) const{
     return ((std::hash<std::string>()(ObjectTypeToString[k.type]) >> 3) ^ (size_t)k.value);
 }
-
-// returns if the object pointer is hashable
-bool hashable(Object* obj){
-    return (obj->type() == ObjectType::STRING_OBJ ||
-            obj->type() == ObjectType::INTEGER_OBJ ||
-            obj->type() == ObjectType::BOOLEAN_OBJ);
-}
\ No newline at end of file
@@ -3,11 +3,15 @@
 #ifndef OBJECT_H
 #define OBJECT_H
 
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include "ast.h"
+#include "outputsink.h"
 
 // forward declaration of Environment class
 class Environment;
+class FlatAst;
 
 
 enum class ObjectType : uint8_t {
@@ -54,20 +58,97 @@ bool operator==(const HashKey& lhs, const HashKey& rhs);
 
 bool operator!=(const HashKey& lhs, const HashKey& rhs);
 
+class Object;
+
+// a Monkey value in one 64 bit word, integers, booleans and null are held in the word itself and every
+// other value is a pointer to its Object, which are at least 8 byte aligned so the low bits tell them apart
+//   0           no value, what statements like let evaluate to
+//   ...xxxx000  pointer to an Object
+//   ...xxxxxx1  integer, held in the upper 32 bits
+//   ...xxxxx10  boolean, held in bit 3
+//   ...xxxx100  null
+class Value {
+    public:
+        // constructor for no value
+        constexpr Value(): bits(0){}
+
+        // constructor for an object, Integers, BooleanObjs and Nulls are unboxed so every value has one
+        // encoding, nullptr is no value
+        Value(Object* object);
+
+        // constructors for the inline values
+        static constexpr Value integer(int value){ return Value(((uint64_t)(uint32_t)value << 32) | INTEGER_TAG); }
+        static constexpr Value boolean(bool value){ return Value(((uint64_t)value << 3) | BOOLEAN_TAG); }
+        static constexpr Value null(){ return Value(NULL_TAG); }
+
+        // checks for each kind of value
+        bool empty() const { return bits == 0; }
+        bool isInteger() const { return (bits & INTEGER_TAG) != 0; }
+        bool isBoolean() const { return (bits & 3) == BOOLEAN_TAG; }
+        bool isNull() const { return bits == NULL_TAG; }
+        bool isObject() const { return bits != 0 && (bits & 7) == 0; }
+
+        // accessors for each kind of value
+        // REQUIRES: the value is of that kind
+        int asInteger() const { return (int)(int32_t)(bits >> 32); }
+        bool asBoolean() const { return ((bits >> 3) & 1) != 0; }
+        Object* asObject() const { return reinterpret_cast<Object*>((uintptr_t)bits); }
+
+        // returns the type of the value, only objects need a virtual call
+        // REQUIRES: the value is not empty
+        ObjectType type() const;
+
+        // returns the value as a string, the same as inspect() of the object it would box to
+        std::string inspect() const;
+
+        // streams the same text as inspect() into out
+        void inspect(OutputSink& out) const;
+
+        // boxes the value into an Object for callers which want one
+        // EFFECTS:  returns a new Integer for integers, a shared object for booleans and null, the object
+        //           itself for objects and nullptr for no value
+        Object* toObject() const;
+
+        // returns if the value can be a hash key, which integers, booleans and strings can
+        bool hashable() const;
+
+        // returns the key of the value in a Hash
+        // REQUIRES: hashable()
+        HashKey hashKey() const;
+
+        // compares identity, which for the inline values is equality
+        bool operator==(const Value& other) const { return bits == other.bits; }
+        bool operator!=(const Value& other) const { return bits != other.bits; }
+
+    private:
+        static const uint64_t INTEGER_TAG = 1, BOOLEAN_TAG = 2, NULL_TAG = 4;
+
+        constexpr explicit Value(uint64_t word): bits(word){}
+
+        uint64_t bits;
+};
+
 class Object {
     public:
+        virtual ~Object(){}
+
+        // objects are allocated by the collector in heap.h, which owns and frees them
+        static void* operator new(size_t size);
+        static void* operator new(size_t, void* place){ return place; }
+        static void operator delete(void* memory);
+
         virtual ObjectType type() = 0;
 
         virtual std::string inspect() = 0;
-};
 
-// returns if the object pointer is hashable
-bool hashable(Object* obj);
+        // streams the same text as inspect() into out, by default by writing inspect() itself
+        virtual void inspect(OutputSink& out);
+};
 
 // struct for the key value pair the hash goes to 
 struct HashPair {
-    Object* key;
-    Object* value;
+    Value key;
+    Value value;
 };
 
 class HashableObject: public Object{
@@ -83,6 +164,9 @@ class Integer: public HashableObject {
     // returns the value of the intger as a string
     std::string inspect() override;
 
+    // writes the digits of the integer into out
+    void inspect(OutputSink& out) override;
+
     // returns the object type of this particular object INTEGER
     ObjectType type() override;
 
@@ -93,22 +177,45 @@ class Integer: public HashableObject {
         int value;
 };
 
+// concatenations shorter than this are copied eagerly instead of building a rope node
+static const size_t ROPE_MIN_LENGTH = 64;
+
+// String object, concatenation builds a lazy rope over the two operands which is only
+// flattened into value when the full contents are needed (hashing, comparing, inspect)
 class String: public HashableObject {
     public:
     //constructor
-    String(std::string val): value(val){}
+    String(std::string val): value(val), length(value.size()){}
+
+    // concatenation constructor, represents left + right without copying them unless short
+    String(String* left, String* right);
+
+    // move constructor, used by the collector when it moves a string out of the nursery
+    String(String&& other): value(std::move(other.value)), length(other.length),
+        left(other.left.load(std::memory_order_relaxed)), right(other.right){}
 
     // returns the value of the string
     std::string inspect() override;
 
+    // writes the flattened contents of the string into out
+    void inspect(OutputSink& out) override;
+
     // returns the object type of this particular object INTEGER
     ObjectType type() override;
 
     // returns the hash of the object
     HashKey hashKey() override;
 
+    // flattens the rope into value if it has not been already
+    // EFFECTS: returns the full contents of the string
+    std::string& flatten();
+
     // vars
-        std::string value;
+        std::string value; // only holds the full contents once flattened
+        size_t length; // length of the full contents, known without flattening
+        std::atomic<String*> left{nullptr}; // left half of an unflattened concatenation, atomic as
+                                            // parallel builtins may flatten a shared rope
+        String* right = nullptr; // right half of an unflattened concatenation
 };
 
 class BooleanObj: public HashableObject {
@@ -142,7 +249,7 @@ class Null: public Object {
 class ReturnValue: public Object {
     public:
         //constructor
-        ReturnValue(Object* obj): value(obj){}
+        ReturnValue(Value val): value(val){}
 
         // destructor
         ~ReturnValue(){
@@ -151,11 +258,14 @@ class ReturnValue: public Object {
         // returns the value of the intger as a string
         std::string inspect() override;
 
+        // streams the wrapped value into out
+        void inspect(OutputSink& out) override;
+
         // returns the object type of this particular object from value
         ObjectType type() override;
     
     //vars
-    Object* value;
+    Value value;
 };
 
 class Error: public Object{
@@ -171,6 +281,7 @@ class Error: public Object{
     
     //vars
     std::string message;
+    uint32_t offset = UNKNOWN_OFFSET; // offset in the source of the node which raised it, set by Eval
 };
 
 class Function: public Object{
@@ -179,10 +290,14 @@ class Function: public Object{
     Function(std::vector<Identifier*>& params, BlockStatement* bod, Environment* e): 
     parameters(params), body(bod), env(e){}
 
-    // destructor
-    ~Function(){
-        delete body;
-    }
+    // constructor for a function created from a literal, which profiles name it after
+    Function(FunctionLiteral* lit, Environment* e):
+    parameters(lit->parameters), body(lit->body), env(e), literal(lit){}
+
+    // constructor for a function evalFlat created from the FUNCTION node of flat, which has no parameters
+    // or body outside of the flat tree
+    Function(const FlatAst* flat, uint32_t node, Environment* e):
+    body(nullptr), env(e), flat(flat), flatNode(node){}
 
     // returns the value of the intger as a string
     std::string inspect() override;
@@ -190,19 +305,36 @@ class Function: public Object{
     // returns the object type of this particular object FUNCTION_OBJ
     ObjectType type() override;
 
+    // returns the number of parameters
+    size_t parameterCount();
+
     //vars
     std::vector<Identifier*> parameters;
-    BlockStatement* body;
+    BlockStatement* body; // belongs to the FunctionLiteral the function was created from
     Environment* env;
+    FunctionLiteral* literal = nullptr;
+    const FlatAst* flat = nullptr; // set for functions evalFlat created, whose literal is node flatNode of it
+    uint32_t flatNode = 0;
 };
 
 class Builtin: public Object{
     public:
     // constructor
-    Builtin(Object* (*inFunc)(std::vector<Object*>)){
+    Builtin(Value (*inFunc)(std::vector<Value>)){
+        fn = inFunc;
+    }
+
+    // constructor for builtins which may have side effects
+    Builtin(Value (*inFunc)(std::vector<Value>), bool isPure){
         fn = inFunc;
+        pure = isPure;
     }
 
+    // builtins live for the whole run, outside of the collected heap
+    static void* operator new(size_t size);
+    static void* operator new(size_t, void* place){ return place; }
+    static void operator delete(void* memory);
+
     // returns the value of the function as a string
     std::string inspect() override;
 
@@ -210,23 +342,27 @@ class Builtin: public Object{
     ObjectType type() override;
 
     //vars 
-    Object* (*fn)(std::vector<Object*>); // this is a function pointer outputs an object with input as object is bad!
+    Value (*fn)(std::vector<Value>); // function pointer to the native implementation
+    bool pure = true; // false if calling it has side effects, which keeps callers from running in parallel
 
 };
 
 class Array: public Object{
     public:
     // constructor
-    Array(std::vector<Object*>& ar){elements = ar;};
+    Array(std::vector<Value>& ar){elements = ar;};
 
     // returns the value of the function as a string
     std::string inspect() override;
 
+    // streams each element into out without building their strings
+    void inspect(OutputSink& out) override;
+
     // returns the object type of this particular object BUILTIN_OBJ
     ObjectType type() override;
 
     //vars
-    std::vector<Object*> elements;
+    std::vector<Value> elements;
 };
 
 class Hash: public Object {
@@ -237,6 +373,9 @@ class Hash: public Object {
     // returns the value of the function as a string
     std::string inspect() override;
 
+    // streams each key value pair into out without building their strings
+    void inspect(OutputSink& out) override;
+
     // returns the object type of this particular object BUILTIN_OBJ
     ObjectType type() override;
 
@@ -244,4 +383,9 @@ class Hash: public Object {
     std::unordered_map<HashKey, HashPair> pairs;
 };
 
+// the shared objects booleans and null box to
+extern BooleanObj TRUE;
+extern BooleanObj FALSE;
+extern Null NULLOBJ;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,85 @@
+// definitions for outputsink.h
+
+#include "outputsink.h"
+#include "tracing.h"
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+// stream constructor
+OutputSink::OutputSink(std::ostream& out, bool lineBuffered){
+    stream = &out;
+    this->lineBuffered = lineBuffered;
+    buffer = new char[BUFFER_SIZE];
+}
+
+// string constructor
+OutputSink::OutputSink(std::string& target){
+    this->target = &target;
+}
+
+// destructor flushes anything still buffered
+OutputSink::~OutputSink(){
+    flush();
+    delete[] buffer;
+}
+
+// writes size bytes from data into the sink
+void OutputSink::write(const char* data, size_t size){
+    if(target){
+        target->append(data, size);
+        return;
+    }
+    if(used + size > BUFFER_SIZE){
+        TraceSpan span(TRACE_PHASE, "output");
+        stream->write(buffer, (std::streamsize)used);
+        used = 0;
+        if(size >= BUFFER_SIZE){ // too big to be worth copying into the buffer
+            stream->write(data, (std::streamsize)size);
+            return;
+        }
+    }
+    std::memcpy(buffer + used, data, size);
+    used += size;
+    if(lineBuffered && std::memchr(data, '\n', size) != nullptr)
+        flush();
+}
+
+// writes the contents of str into the sink
+void OutputSink::write(const std::string& str){
+    write(str.data(), str.size());
+}
+
+// writes a single character into the sink
+void OutputSink::put(char c){
+    if(target){
+        target->push_back(c);
+        return;
+    }
+    if(used == BUFFER_SIZE){
+        TraceSpan span(TRACE_PHASE, "output");
+        stream->write(buffer, (std::streamsize)used);
+        used = 0;
+    }
+    buffer[used++] = c;
+    if(lineBuffered && c == '\n')
+        flush();
+}
+
+// writes the buffered bytes out to the stream and flushes it
+void OutputSink::flush(){
+    if(!stream)
+        return;
+    TraceSpan span(TRACE_PHASE, "output");
+    if(used > 0){
+        stream->write(buffer, (std::streamsize)used);
+        used = 0;
+    }
+    stream->flush();
+}
+
+// returns the sink shared by puts and the REPL which writes to std::cout
+OutputSink& standardOutput(){
+    static OutputSink sink(std::cout, isatty(STDOUT_FILENO) != 0);
+    return sink;
+}
@@ -0,0 +1,52 @@
+// buffered output for streaming inspect() results without building intermediate strings
+
+#ifndef OUTPUTSINK_H
+#define OUTPUTSINK_H
+
+#include <ostream>
+#include <string>
+
+class OutputSink {
+    public:
+        static const size_t BUFFER_SIZE = 1 << 16; // bytes buffered before a flush to the stream
+
+        // stream constructor
+        // EFFECTS:  creates a sink which buffers writes and flushes them to out in large blocks, and also
+        //           at the end of every line if lineBuffered, so each line shows as soon as it is written
+        OutputSink(std::ostream& out, bool lineBuffered = false);
+
+        // string constructor
+        // EFFECTS:  creates a sink which appends writes directly onto target
+        OutputSink(std::string& target);
+
+        // destructor flushes anything still buffered
+        ~OutputSink();
+
+        OutputSink(const OutputSink&) = delete;
+        OutputSink& operator=(const OutputSink&) = delete;
+
+        // writes size bytes from data into the sink
+        void write(const char* data, size_t size);
+
+        // writes the contents of str into the sink
+        void write(const std::string& str);
+
+        // writes a single character into the sink
+        void put(char c);
+
+        // writes the buffered bytes out to the stream and flushes it
+        void flush();
+
+    private:
+        std::ostream* stream = nullptr;
+        std::string* target = nullptr;
+        char* buffer = nullptr;
+        size_t used = 0;
+        bool lineBuffered = false;
+};
+
+// returns the sink shared by puts and the REPL which writes to std::cout, line buffered when standard
+// output is a terminal so what was printed is seen even if the process then dies
+OutputSink& standardOutput();
+
+#endif // OUTPUTSINK_H
@@ -0,0 +1,120 @@
+#include "parallelparser.h"
+#include <cstdint>
+#include <cstring>
+#include "scan.h"
+#include "tracing.h"
+
+// finds the offsets top level statements may start at
+std::vector<size_t> findStatementBoundaries(const char* data, size_t length, size_t minimum){
+    std::vector<size_t> boundaries;
+    size_t previous = 0;
+    long depth = 0; // may go negative in a broken input, which only means no boundaries are found
+    for(size_t i = 0; i < length; i++){
+        switch(data[i]){
+            case '"': {
+                const void* end = memchr(data + i + 1, '"', length - i - 1);
+                if(end == nullptr)
+                    return boundaries; // the rest of the input is one unterminated string
+                i = (size_t)((const char*)end - data);
+                break;
+            }
+            case '(': case '[': case '{':
+                depth++;
+                break;
+            case ')': case ']': case '}':
+                depth--;
+                break;
+            case ';': {
+                if(depth != 0 || i + 1 - previous < minimum)
+                    break;
+                size_t next = i + 1;
+                while(next < length && inClass(data[next], CLASS_WHITESPACE))
+                    next++;
+                if(next < length){
+                    boundaries.push_back(next);
+                    previous = next;
+                }
+                i = next - 1;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    return boundaries;
+}
+
+// statements and errors of the input between two boundaries
+struct ParsedChunk {
+    std::vector<Statement*> statements;
+    std::vector<std::string> errors;
+    bool aligned = false; // whether the last statement ended right before the next boundary
+};
+
+// helper which parses the statements starting in [start, stop) of source
+static void parseChunk(const LexerSource& source, size_t start, size_t stop, ParsedChunk& chunk){
+    TraceSpan span(TRACE_PHASE, "parse chunk");
+    // every chunk gets its own source as the line index of one isn't safe to build from several threads
+    Lexer lexer(std::make_shared<BorrowedSource>(source.data, source.length), start);
+    Parser parser(&lexer);
+    while(!parser.curTokenIs(TokenType::ENDOFFILE) && parser.getCurrentToken().offset < stop){
+        Statement* stmt = parser.parseStatementOrRecover();
+        if(stmt != nullptr)
+            chunk.statements.push_back(stmt);
+        parser.nextToken();
+    }
+    // the serial parse starts a statement at stop only if this one did, everything after a statement
+    // starts is decided by the tokens from there on
+    chunk.aligned = parser.curTokenIs(TokenType::ENDOFFILE) ? stop == SIZE_MAX : parser.getCurrentToken().offset == stop;
+    chunk.errors = std::move(parser.errors);
+}
+
+// parses the whole of source, in chunks on pool if it is large enough
+Program* parseProgramParallel(std::shared_ptr<LexerSource> source, std::vector<std::string>& errors,
+    ThreadPool& pool, size_t chunkSize, bool* reparsed){
+    if(reparsed != nullptr)
+        *reparsed = false;
+    std::vector<size_t> starts = {0};
+    if(pool.concurrency() > 1 && source->start == 0 && source->length < UNKNOWN_OFFSET){
+        TraceSpan span(TRACE_PHASE, "find statement boundaries");
+        std::vector<size_t> boundaries = findStatementBoundaries(source->data, source->length, chunkSize);
+        starts.insert(starts.end(), boundaries.begin(), boundaries.end());
+    }
+
+    if(starts.size() > 1){
+        std::vector<ParsedChunk> chunks(starts.size());
+        pool.parallelFor(starts.size(), 1, [&](size_t begin, size_t end){
+            for(size_t i = begin; i < end; i++)
+                parseChunk(*source, starts[i], i + 1 < starts.size() ? starts[i + 1] : SIZE_MAX, chunks[i]);
+        });
+
+        bool aligned = true;
+        size_t count = 0;
+        for(ParsedChunk& chunk : chunks){
+            aligned = aligned && chunk.aligned;
+            count += chunk.statements.size();
+        }
+        if(aligned){
+            Program* program = new Program();
+            program->statements.reserve(count);
+            for(ParsedChunk& chunk : chunks){
+                program->statements.insert(program->statements.end(), chunk.statements.begin(), chunk.statements.end());
+                errors.insert(errors.end(), chunk.errors.begin(), chunk.errors.end());
+            }
+            return program;
+        }
+        for(ParsedChunk& chunk : chunks){
+            for(Statement* stmt : chunk.statements)
+                delete stmt;
+        }
+        if(reparsed != nullptr)
+            *reparsed = true;
+    }
+
+    TraceSpan span(TRACE_PHASE, "parse serially");
+    Lexer lexer(source);
+    Parser parser(&lexer);
+    Program* program = parser.parseProgram();
+    errors.insert(errors.end(), parser.errors.begin(), parser.errors.end());
+    return program;
+}
@@ -0,0 +1,30 @@
+// parser which splits a whole input into runs of top level statements and parses them on the thread pool
+
+#ifndef PARALLELPARSER_H
+#define PARALLELPARSER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "parser.h"
+#include "threadpool.h"
+
+// inputs are split into chunks of about this many bytes, smaller inputs are parsed on the calling thread
+static const size_t PARALLEL_PARSE_CHUNK = 1 << 18;
+
+// finds the offsets top level statements may start at, which are the first token after each ';' outside
+// of any brackets and strings
+// EFFECTS:  returns at most one offset for every minimum bytes, in increasing order and without 0
+std::vector<size_t> findStatementBoundaries(const char* data, size_t length, size_t minimum);
+
+// parses the whole of source into the same program and errors as Parser::parseProgram, parsing chunks
+// between the boundaries findStatementBoundaries finds on pool and joining their statements in order
+// REQUIRES: source holds the whole input, so refill has nothing more to read
+// MODIFIES: errors, which gets the parse errors appended, and reparsed if it is given
+// EFFECTS:  returns a new Program owned by the caller, if a boundary turns out to be inside a statement
+//           like a ';' in a broken one the input is parsed again on the calling thread and reparsed is
+//           set to true, otherwise to false
+Program* parseProgramParallel(std::shared_ptr<LexerSource> source, std::vector<std::string>& errors,
+    ThreadPool& pool = sharedThreadPool(), size_t chunkSize = PARALLEL_PARSE_CHUNK, bool* reparsed = nullptr);
+
+#endif // PARALLELPARSER_H
@@ -1,6 +1,8 @@
 // implementations of parser.h
 
 #include "parser.h"
+#include <algorithm>
+#include <stdexcept>
 
 // defualt constructor for Parser initiation
 Parser::Parser(){
@@ -48,7 +50,7 @@ void Parser::nextToken(){
 Program* Parser::parseProgram(){
     Program* program = new Program();
     while(!curTokenIs(TokenType::ENDOFFILE)){
-        Statement* stmt = parseStatement();
+        Statement* stmt = parseStatementOrRecover();
         if(stmt != nullptr){
             program->statements.push_back(stmt);
         }
@@ -57,6 +59,44 @@ Program* Parser::parseProgram(){
     return program;
 }
 
+// Parses a statement, and if it has errors nothing has recovered from yet drops it and skips ahead
+// to where the next statement should start so later errors are still found
+Statement* Parser::parseStatementOrRecover(){
+    size_t errorCount = errors.size(); // errors of an enclosing statement are not this one's to recover from
+    Statement* stmt = parseStatement();
+    if(errors.size() > std::max(errorCount, recoveredErrors)){
+        delete stmt; // partial statements can be missing children
+        stmt = nullptr;
+        synchronize();
+        recoveredErrors = errors.size();
+    }
+    return stmt;
+}
+
+// Skips tokens until the end of the broken statement, which is a ';' or just before a '}' or a keyword
+// starting a statement, braces opened while skipping are skipped over with their contents
+void Parser::synchronize(){
+    int depth = 0;
+    while(!curTokenIs(TokenType::ENDOFFILE)){
+        if(curTokenIs(TokenType::LBRACE))
+            depth++;
+        else if(curTokenIs(TokenType::RBRACE) && depth > 0)
+            depth--;
+        if(depth == 0){
+            if(curTokenIs(TokenType::SEMICOLON) || peekTokenIs(TokenType::RBRACE) ||
+               peekTokenIs(TokenType::ENDOFFILE) || startsStatement(peekToken.type))
+                return;
+        }
+        nextToken();
+    }
+}
+
+// Checks if a token is a keyword which starts a statement
+bool Parser::startsStatement(TokenType type){
+    return type == TokenType::LET || type == TokenType::RETURN || type == TokenType::WHILE ||
+           type == TokenType::FOR || type == TokenType::IF;
+}
+
 // Parses a statement and returns a statement pointer
 Statement* Parser::parseStatement(){
     switch(currentToken.type){
@@ -64,6 +104,14 @@ Statement* Parser::parseStatement(){
             return parseLetStatement();
         case TokenType::RETURN:
             return parseReturnStatement();
+        case TokenType::WHILE:
+            return parseWhileStatement();
+        case TokenType::FOR:
+            return parseForStatement();
+        case TokenType::IDENT:
+            if(peekTokenIs(TokenType::ASSIGN))
+                return parseAssignStatement();
+            return parseExpressionStatement();
         default:
             return parseExpressionStatement();
     }
@@ -97,6 +145,7 @@ Statement* Parser::parseLetStatement(){
     
     nextToken();
     stmt->expressionValue = parseExpression(LOWEST);
+    nameFunctionLiteral(stmt);
 
     if(peekTokenIs(TokenType::SEMICOLON))
         nextToken();
@@ -104,6 +153,61 @@ Statement* Parser::parseLetStatement(){
     return stmt;
 }
 
+// Parses an assignment to an existing binding like x = 5;
+Statement* Parser::parseAssignStatement(){
+    AssignStatement* stmt = new AssignStatement(currentToken, new Identifier(currentToken, currentToken.literal));
+    nextToken(); // onto '='
+    nextToken();
+    stmt->expressionValue = parseExpression(LOWEST);
+
+    if(peekTokenIs(TokenType::SEMICOLON))
+        nextToken();
+
+    return stmt;
+}
+
+// Parses a while loop like while(x < 5) { x = x + 1; }
+Statement* Parser::parseWhileStatement(){
+    WhileStatement* stmt = new WhileStatement(currentToken);
+    if(!expectPeek(TokenType::LPAREN)){
+        delete stmt;
+        return nullptr;
+    }
+    nextToken(); // get past LPAREN to the condition
+    stmt->expressionValue = parseExpression(LOWEST);
+
+    if(!expectPeek(TokenType::RPAREN) || !expectPeek(TokenType::LBRACE)){
+        delete stmt;
+        return nullptr;
+    }
+    stmt->body = parseBlockStatement();
+    return stmt;
+}
+
+// Parses a for in loop like for(x in [1, 2]) { puts(x) }
+Statement* Parser::parseForStatement(){
+    ForStatement* stmt = new ForStatement(currentToken);
+    if(!expectPeek(TokenType::LPAREN) || !expectPeek(TokenType::IDENT)){
+        delete stmt;
+        return nullptr;
+    }
+    stmt->iterator = new Identifier(currentToken, currentToken.literal);
+
+    if(!expectPeek(TokenType::IN)){
+        delete stmt;
+        return nullptr;
+    }
+    nextToken(); // get past IN to the iterable
+    stmt->expressionValue = parseExpression(LOWEST);
+
+    if(!expectPeek(TokenType::RPAREN) || !expectPeek(TokenType::LBRACE)){
+        delete stmt;
+        return nullptr;
+    }
+    stmt->body = parseBlockStatement();
+    return stmt;
+}
+
 // Checks if peek token is what we expect and advances the token if so
 bool Parser::expectPeek(TokenType type){
     if(peekTokenIs(type)){
@@ -133,7 +237,19 @@ bool Parser::peekTokenIs(TokenType type){
 void Parser::addPeekError(TokenType type){
     std::string error = "expected next token to be " + lexer->TokenTypeToString[type]
     + " but got " + lexer->TokenTypeToString[peekToken.type] + " instead";
-    errors.push_back(error);
+    addError(peekToken, error);
+}
+
+// Adds an error at token to the errors vector, prefixed with its line and column
+void Parser::addError(Token& token, std::string message){
+    if(errors.size() > recoveredErrors)
+        return; // the statement already has an error, anything after it until recovery is likely a cascade
+    if(token.offset == UNKNOWN_OFFSET){
+        errors.push_back(message);
+        return;
+    }
+    SourceLocation location = lexer->locate(token.offset);
+    errors.push_back(std::to_string(location.line) + ":" + std::to_string(location.column) + ": " + message);
 }
 
 // Returns the errors vector
@@ -141,6 +257,11 @@ std::vector<std::string>& Parser::getErrors(){
     return errors;
 }
 
+// Returns the token the parser is on
+Token& Parser::getCurrentToken(){
+    return currentToken;
+}
+
 // Adds a prefix parse function to the prefixParseFns map
 void Parser::registerPrefix(TokenType type, prefixParseFnPtr fn){
     prefixParseFns[type] = fn;
@@ -192,9 +313,9 @@ Expression* Parser::parseIntegerLiteral(){
         int val = std::stoi(currentToken.literal);
         lit->value = val;
     }   
-    catch(std::invalid_argument& e){
+    catch(std::logic_error& e){ // invalid_argument or out_of_range
         std::string error = "could not parse " + currentToken.literal + " as integer";
-        errors.push_back(error);
+        addError(currentToken, error);
         return nullptr;
     }
     return lit;
@@ -203,7 +324,7 @@ Expression* Parser::parseIntegerLiteral(){
 // error catcher if there is no parser function
 void Parser::noPrefixParseFnError(TokenType type){
     std::string message = "no prefix parse function for " + lexer->TokenTypeToString[type] + " found";
-    errors.push_back(message);
+    addError(currentToken, message);
 }
 
 // Parses a prefix expression
@@ -287,7 +408,7 @@ BlockStatement* Parser::parseBlockStatement(){
     BlockStatement* block = new BlockStatement(currentToken);
     nextToken(); // to move off '{'
     while( !curTokenIs(TokenType::RBRACE) && !curTokenIs(TokenType::ENDOFFILE)){
-        Statement* stmt = parseStatement();
+        Statement* stmt = parseStatementOrRecover();
         if(stmt != nullptr){
             block->statements.push_back(stmt);
         }
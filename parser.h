@@ -53,12 +53,32 @@ class Parser {
         // Parses a statement and returns a statement pointer
         Statement* parseStatement();
 
+        // Parses a statement, and if it has new errors drops it and skips to the start of the next one
+        // EFFECTS:  returns the statement or nullptr if it had errors
+        Statement* parseStatementOrRecover();
+
+        // Skips the rest of a statement with errors, stopping on its ';' or before a '}' or statement keyword
+        // MODIFIES: currentToken, peekToken
+        void synchronize();
+
+        // Checks if a token is a keyword which starts a statement
+        bool startsStatement(TokenType type);
+
         // Parses a let statement and returns a statement pointer
         Statement* parseLetStatement();
 
         // Parses a return statement and returns a statement pointer
         Statement* parseReturnStatement();
 
+        // Parses an assignment to an existing binding like x = 5;
+        Statement* parseAssignStatement();
+
+        // Parses a while loop like while(x < 5) { x = x + 1; }
+        Statement* parseWhileStatement();
+
+        // Parses a for in loop like for(x in [1, 2]) { puts(x) }
+        Statement* parseForStatement();
+
         // Checks if peek token is what we expect and advances the token if so and throws errors if not
         bool expectPeek(TokenType type);
 
@@ -71,9 +91,16 @@ class Parser {
         // Adds a peek error to the errors vector
         void addPeekError(TokenType type);
 
+        // Adds an error at token to the errors vector, prefixed with its line and column like 3:14: 
+        // only the first error of a statement is added, the rest are dropped until it is recovered from
+        void addError(Token& token, std::string message);
+
         // Returns the errors vector
         std::vector<std::string>& getErrors();
 
+        // Returns the token the parser is on, which is the first token of the next statement between statements
+        Token& getCurrentToken();
+
         // Adds a prefix parse function to the prefixParseFns map
         void registerPrefix(TokenType type, prefixParseFnPtr fn);
 
@@ -150,6 +177,7 @@ class Parser {
         std::vector<std::string> errors;
 
     private:
+        size_t recoveredErrors = 0; // errors which a statement has already been skipped for
         Lexer* lexer;
         Token currentToken;
         Token peekToken;
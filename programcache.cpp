@@ -0,0 +1,126 @@
+// definitions for programcache.h
+
+#include "programcache.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// start of each cache file, checked before anything else is read, followed by the source the program was
+// parsed from and then the serialized FlatAst
+struct CacheHeader {
+    char magic[4]; // "MKYC"
+    uint32_t version; // ProgramCache::VERSION
+    uint32_t astVersion; // FlatAst::FORMAT_VERSION
+    uint32_t pointerSize; // files are written in the host's layout so are only read back on hosts like it
+    uint64_t sourceHash;
+    uint64_t sourceLength; // bytes of source after the header, compared in full so a hash collision can't hit
+    uint64_t bodyLength; // bytes of serialized FlatAst after the source
+    uint64_t bodyHash; // catches damage to the body which still deserializes to a well formed tree
+};
+
+static const char CACHE_MAGIC[4] = {'M', 'K', 'Y', 'C'};
+
+// returns a 64 bit FNV-1a style hash of the length bytes at data
+uint64_t hashSource(const char* data, size_t length){
+    const uint64_t prime = 1099511628211ull;
+    uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    for(; i + 8 <= length; i += 8){ // a word at a time as large sources are hashed on every run
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 32; // multiplying only carries upwards, fold the high bits back down
+    }
+    for(; i < length; i++)
+        hash = (hash ^ (unsigned char)data[i]) * prime;
+    return hash;
+}
+
+// constructor
+ProgramCache::ProgramCache(std::string directory): directory(std::move(directory)){
+}
+
+// returns the path of the file for source
+std::string ProgramCache::pathFor(const char* source, size_t length){
+    return pathFor(hashSource(source, length));
+}
+
+// returns the path of the file for a source with sourceHash
+std::string ProgramCache::pathFor(uint64_t sourceHash){
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.ast", (unsigned long long)sourceHash);
+    return directory + "/" + name;
+}
+
+// helper which builds the header describing a source of length bytes with sourceHash
+static CacheHeader headerFor(uint64_t sourceHash, size_t length, const char* body, size_t bodyLength){
+    CacheHeader header;
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = ProgramCache::VERSION;
+    header.astVersion = FlatAst::FORMAT_VERSION;
+    header.pointerSize = (uint32_t)sizeof(void*);
+    header.sourceHash = sourceHash;
+    header.sourceLength = length;
+    header.bodyLength = bodyLength;
+    header.bodyHash = hashSource(body, bodyLength);
+    return header;
+}
+
+// loads the program parsed from source into flat if it was stored before
+bool ProgramCache::load(const char* source, size_t length, FlatAst& flat){
+    flat = FlatAst();
+    uint64_t sourceHash = hashSource(source, length);
+    std::string path = pathFor(sourceHash);
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(CacheHeader) + length){
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)info.st_size;
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED)
+        return false;
+
+    const char* data = static_cast<const char*>(mapped);
+    const char* body = data + sizeof(CacheHeader) + length;
+    size_t bodyLength = size - sizeof(CacheHeader) - length;
+    CacheHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    CacheHeader expected = headerFor(sourceHash, length, body, bodyLength);
+    bool loaded = std::memcmp(&header, &expected, sizeof(header)) == 0 &&
+                  std::memcmp(data + sizeof(CacheHeader), source, length) == 0 &&
+                  flat.deserialize(body, bodyLength);
+    munmap(mapped, size);
+    return loaded;
+}
+
+// saves program as the parse of source
+bool ProgramCache::store(const char* source, size_t length, Program* program){
+    std::string body;
+    FlatAst(program).serialize(body);
+    uint64_t sourceHash = hashSource(source, length);
+    CacheHeader header = headerFor(sourceHash, length, body.data(), body.size());
+
+    mkdir(directory.c_str(), 0755); // fails harmlessly if it already exists
+    std::string path = pathFor(sourceHash);
+    std::string temporary = path + "." + std::to_string(getpid()) + ".tmp";
+    FILE* file = std::fopen(temporary.c_str(), "wb");
+    if(file == nullptr)
+        return false;
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   std::fwrite(source, 1, length, file) == length &&
+                   std::fwrite(body.data(), 1, body.size(), file) == body.size();
+    written = std::fclose(file) == 0 && written;
+    if(!written || std::rename(temporary.c_str(), path.c_str()) != 0){
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+// on disk cache of parsed programs, keyed by a hash of their source and checked against a copy of it
+
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <cstdint>
+#include <string>
+#include "flatast.h"
+
+// returns a 64 bit FNV-1a style hash of the length bytes at data, taken a word at a time
+uint64_t hashSource(const char* data, size_t length);
+
+// directory of parsed programs saved as serialized FlatAsts, each in a file named after the hash of
+// its source so an unchanged script is loaded instead of being lexed and parsed again. The hash only
+// names the file, each file also holds the source it was parsed from, which a load compares byte for
+// byte, so two sources with the same hash replace each other's file rather than load the wrong program
+class ProgramCache {
+    public:
+        // bumped whenever the file layout changes, files of other versions are ignored
+        static const uint32_t VERSION = 2;
+
+        // constructor
+        // EFFECTS:  creates a cache over directory, which is created when the first program is stored
+        ProgramCache(std::string directory);
+
+        // loads the program parsed from source into flat if it was stored before, to be evaluated with evalFlat
+        // or rebuilt with toProgram
+        // EFFECTS:  returns false and leaves flat empty if there is no file for source or it is from another
+        //           version, for a different source or corrupt
+        bool load(const char* source, size_t length, FlatAst& flat);
+
+        // saves program as the parse of source, replacing the file atomically so concurrent runs never
+        // see half of one
+        // REQUIRES: program was parsed from source without errors
+        // EFFECTS:  returns false if the file could not be written
+        bool store(const char* source, size_t length, Program* program);
+
+        // returns the path of the file for source
+        std::string pathFor(const char* source, size_t length);
+
+    private:
+        // helper which returns the path of the file for a source with sourceHash, so a load or store
+        // hashes the source once
+        std::string pathFor(uint64_t sourceHash);
+
+        std::string directory;
+};
+
+#endif // PROGRAMCACHE_H
@@ -0,0 +1,80 @@
+// definitions for regression.h
+
+#include "regression.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+// returns the median of values
+double median(std::vector<double> values){
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 == 1 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+// returns the median of samples and their median absolute deviation from it
+Statistics summarize(const std::vector<double>& samples){
+    Statistics statistics;
+    statistics.median = median(samples);
+    std::vector<double> deviations;
+    for(double sample: samples)
+        deviations.push_back(std::fabs(sample - statistics.median));
+    statistics.deviation = median(deviations);
+    return statistics;
+}
+
+// returns whether now regressed from before beyond threshold and the noise
+bool isRegression(const Statistics& now, const Statistics& before, double threshold){
+    double change = (now.median - before.median) / before.median;
+    double noise = NOISE_DEVIATIONS * std::max(now.deviation, before.deviation);
+    return change > threshold && now.median - before.median > noise;
+}
+
+// returns results as the baseline's JSON
+std::string baselineJson(const std::vector<Result>& results){
+    std::ostringstream json;
+    json << std::setprecision(6) << "{\"workloads\": [";
+    for(size_t i = 0; i < results.size(); i++){
+        json << (i == 0 ? "" : ",") << "\n  {\"name\": \"" << results[i].name << "\", \"median_ms\": "
+             << results[i].statistics.median << ", \"mad_ms\": " << results[i].statistics.deviation << "}";
+    }
+    json << "\n]}\n";
+    return json.str();
+}
+
+// helper which returns the number after key in object, or -1 if key isn't in it
+static double jsonNumber(const std::string& object, const std::string& key){
+    size_t found = object.find("\"" + key + "\":");
+    if(found == std::string::npos)
+        return -1;
+    return std::strtod(object.c_str() + found + key.size() + 3, nullptr);
+}
+
+// reads the results of a baseline written by baselineJson
+bool parseBaseline(const std::string& json, std::vector<Result>& results){
+    size_t before = results.size();
+    for(size_t start = json.find("{\"name\": \""); start != std::string::npos; start = json.find("{\"name\": \"", start + 1)){
+        std::string object = json.substr(start, json.find('}', start) - start);
+        Result result;
+        size_t nameStart = std::string("{\"name\": \"").size();
+        result.name = object.substr(nameStart, object.find('"', nameStart) - nameStart);
+        result.statistics.median = jsonNumber(object, "median_ms");
+        result.statistics.deviation = jsonNumber(object, "mad_ms");
+        if(result.statistics.median > 0 && result.statistics.deviation >= 0)
+            results.push_back(result);
+    }
+    return results.size() > before;
+}
+
+// reads the baseline at path
+bool readBaseline(const std::string& path, std::vector<Result>& results){
+    std::ifstream file(path);
+    if(!file)
+        return false;
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return parseBaseline(contents.str(), results);
+}
@@ -0,0 +1,53 @@
+// statistics and baseline handling of the benchmark regression gate in benchmarks/regression.cpp
+
+#ifndef REGRESSION_H
+#define REGRESSION_H
+
+#include <string>
+#include <vector>
+
+// Timings only compare to a baseline recorded on the same machine with the same build, so the intended
+// use is to record with the interpreter currently deployed and then run the candidate against it. A
+// workload regresses when its median is more than the threshold slower than the baseline's and the
+// difference is also larger than the noise of either measurement, so a noisy run can't fail the gate.
+// The gate fails closed, a baseline with no workloads in it or a workload missing from it is a failure.
+
+// multiple of the median absolute deviation a difference must exceed to not be noise
+static const double NOISE_DEVIATIONS = 3;
+
+// the median and median absolute deviation of a workload's times in milliseconds
+struct Statistics {
+    double median = 0;
+    double deviation = 0;
+};
+
+// a workload's statistics as measured or recorded
+struct Result {
+    std::string name;
+    Statistics statistics;
+};
+
+// returns the median of values, the mean of the middle two for an even number
+// REQUIRES: values isn't empty
+double median(std::vector<double> values);
+
+// returns the median of samples and their median absolute deviation from it
+// REQUIRES: samples isn't empty
+Statistics summarize(const std::vector<double>& samples);
+
+// returns whether now is more than threshold, a fraction, slower than before and the difference is more
+// than NOISE_DEVIATIONS times the larger of their deviations
+bool isRegression(const Statistics& now, const Statistics& before, double threshold);
+
+// returns results as the baseline's JSON
+std::string baselineJson(const std::vector<Result>& results);
+
+// reads the results of a baseline baselineJson wrote, objects missing a field are skipped
+// EFFECTS:  returns false if not a single workload could be read
+bool parseBaseline(const std::string& json, std::vector<Result>& results);
+
+// reads the baseline at path with parseBaseline
+// EFFECTS:  returns false if the file can't be read or parseBaseline fails
+bool readBaseline(const std::string& path, std::vector<Result>& results);
+
+#endif // REGRESSION_H
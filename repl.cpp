@@ -1,12 +1,23 @@
 // repl.h definitions
 #include "repl.h"
+#include "allocationprofile.h"
+#include "nodeprofile.h"
+#include "flatast.h"
+#include "heap.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
 
 void printParserErrors(Parser& p);
 
 // REPL constructor
 // EFFECTS:  creates a REPL object
 REPL::REPL(){
-    lexer = Lexer();
+    session = std::make_shared<AppendableSource>();
+    lexer = Lexer(session);
 };
 
 
@@ -15,31 +26,267 @@ REPL::REPL(){
 void REPL::start(){
     Environment env = Environment();
 
+    OutputSink& out = standardOutput();
+
     while(true){
-        std::cout << PROMPT;
-        std::string input;
+        out.write(PROMPT);
+        out.flush(); // anything puts wrote and the prompt must be visible before blocking on input
         std::getline(std::cin, input);
         if(input == "")
             return;
-        lexer = Lexer(input);
-        parser = Parser(&lexer);
-        Program* program = parser.parseProgram();
-
-        if(parser.errors.size() != 0){
-            printParserErrors(parser);
+        linesRead++;
+        if(input.rfind(":allocations", 0) == 0){
+            allocationsCommand(input.substr(12));
+            continue;
+        }
+        if(input.rfind(":nodes", 0) == 0){
+            nodesCommand(input.substr(6));
+            continue;
+        }
+        if(input.rfind(":time", 0) == 0){
+            timeCommand(input.substr(5), &env);
+            continue;
+        }
+        if(input.rfind(":alloc", 0) == 0){
+            allocCommand(input.substr(6), &env);
+            continue;
+        }
+        if(input.rfind(":ast", 0) == 0){
+            astCommand(input.substr(4));
             continue;
         }
+        if(input == ":stats"){
+            statsCommand();
+            continue;
+        }
+        Program* program = parse(input);
+        if(program == nullptr)
+            continue;
 
-        Object* evaluated = Eval(program, &env);
-        if(evaluated){
-            std::cout<<evaluated->inspect()<<"\n";
+        Value evaluated = Eval(program, &env);
+        if(!evaluated.empty()){
+            evaluated.inspect(out);
+            out.put('\n');
         }
     }
 }
 
+// runs the :allocations command, which turns allocation profiling on or off or prints what it counted
+void REPL::allocationsCommand(const std::string& argument){
+    OutputSink& out = standardOutput();
+    if(argument == " on"){
+        allocationProfiling = true;
+        resetAllocationProfile();
+    }
+    else if(argument == " off")
+        allocationProfiling = false;
+    else if(argument.empty()){
+        if(!allocationProfiling)
+            out.write("allocation profiling is off, ':allocations on' starts it, live counts follow\n");
+        out.write(formatAllocationReport(allocationProfile(), ALLOCATION_REPORT_SITES, &lexer));
+    }
+    else
+        out.write("usage: :allocations [on|off]\n");
+}
+
+// runs the :nodes command, which turns node profiling on or off, prints what it counted or writes it as JSON
+void REPL::nodesCommand(const std::string& argument){
+    OutputSink& out = standardOutput();
+    if(argument == " on"){
+        nodeProfiling = true;
+        resetNodeProfile();
+    }
+    else if(argument == " off")
+        nodeProfiling = false;
+    else if(argument.empty()){
+        if(!nodeProfiling)
+            out.write("node profiling is off, ':nodes on' starts it\n");
+        out.write(formatNodeReport(nodeProfile(), NODE_REPORT_NODES, &lexer));
+    }
+    else if(argument.rfind(" json ", 0) == 0){
+        std::string path = argument.substr(6);
+        std::ofstream file(path);
+        file<<nodeProfileJson(nodeProfile(), &lexer);
+        if(!file)
+            out.write("could not write " + path + "\n");
+    }
+    else
+        out.write("usage: :nodes [on|off|json <path>]\n");
+}
+
+// parses source, the program is kept as functions defined in it may outlive the line. The line is appended
+// to the session and lexed from there so every program's offsets are in the same source, which the
+// profilers' reports locate them in as the line they were typed on. Lines which ran a command without code
+// are only kept as empty lines
+Program* REPL::parse(const std::string& source){
+    session->append(std::string(linesRead - 1 - sessionLines, '\n') + input + '\n');
+    sessionLines = linesRead;
+    lexer = Lexer(session, session->length - 1 - source.size());
+    parser = Parser(&lexer);
+    Program* program = parser.parseProgram();
+    if(parser.errors.size() != 0){
+        printParserErrors(parser);
+        return nullptr;
+    }
+    return program;
+}
+
+// helper which formats seconds as milliseconds with three decimals
+static std::string milliseconds(double seconds){
+    std::string formatted = std::to_string(seconds * 1e3);
+    return formatted.substr(0, formatted.find('.') + 4) + " ms";
+}
+
+// returns the fastest and the median of times, the mean of the middle two for an even number
+std::string fastestAndMedian(std::vector<double> times){
+    std::sort(times.begin(), times.end());
+    size_t middle = times.size() / 2;
+    double median = times.size() % 2 == 1 ? times[middle] : (times[middle - 1] + times[middle]) / 2;
+    return "min " + milliseconds(times.front()) + ", median " + milliseconds(median);
+}
+
+// parses the argument of :time, a count too long for strtoull is out of range like any other large one
+bool parseTimeArgument(const std::string& argument, size_t& runs, std::string& code){
+    runs = TIME_RUNS;
+    code = argument;
+    if(code.rfind(" x", 0) == 0){
+        size_t end = code.find(' ', 2);
+        std::string count = code.substr(2, end == std::string::npos ? std::string::npos : end - 2);
+        if(count.empty() || count.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+        errno = 0;
+        unsigned long long parsed = std::strtoull(count.c_str(), nullptr, 10);
+        if(errno == ERANGE || parsed == 0 || parsed > MAX_TIME_RUNS)
+            return false;
+        runs = (size_t)parsed;
+        code = end == std::string::npos ? "" : code.substr(end);
+    }
+    if(code.size() < 2 || code[0] != ' ')
+        return false;
+    code = code.substr(1);
+    return true;
+}
+
+// runs the :time command, which evaluates code in env a number of times and prints how long it took
+void REPL::timeCommand(const std::string& argument, Environment* env){
+    OutputSink& out = standardOutput();
+    size_t runs;
+    std::string code;
+    if(!parseTimeArgument(argument, runs, code)){
+        out.write("usage: :time [xN] <code>\n");
+        return;
+    }
+    Program* program = parse(code);
+    if(program == nullptr)
+        return;
+
+    std::vector<double> wall, cpu;
+    Value evaluated;
+    for(size_t run = 0; run < runs; run++){
+        auto wallStart = std::chrono::steady_clock::now();
+        std::clock_t cpuStart = std::clock();
+        evaluated = Eval(program, env);
+        cpu.push_back((double)(std::clock() - cpuStart) / CLOCKS_PER_SEC);
+        wall.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count());
+    }
+    if(!evaluated.empty()){
+        evaluated.inspect(out);
+        out.put('\n');
+    }
+    out.write(std::to_string(runs) + (runs == 1 ? " run" : " runs") + "\n");
+    out.write("wall  " + fastestAndMedian(wall) + "\n");
+    out.write("cpu   " + fastestAndMedian(cpu) + "\n"); // of the whole process, so pmap's workers count
+}
+
+// runs the :alloc command, which evaluates code in env and prints what it allocated by kind
+void REPL::allocCommand(const std::string& argument, Environment* env){
+    OutputSink& out = standardOutput();
+    if(argument.size() < 2 || argument[0] != ' '){
+        out.write("usage: :alloc <code>\n");
+        return;
+    }
+    Program* program = parse(argument.substr(1));
+    if(program == nullptr)
+        return;
+
+    // counts what the code allocates as the difference, so whatever :allocations counted is kept
+    bool profiling = allocationProfiling;
+    allocationProfiling = true;
+    CountsByKind before = allocationProfile().allocated;
+    Value evaluated = Eval(program, env);
+    AllocationProfile after = allocationProfile();
+    allocationProfiling = profiling;
+    if(!evaluated.empty()){
+        evaluated.inspect(out);
+        out.put('\n');
+    }
+    for(size_t kind = 0; kind < ALLOCATION_KINDS; kind++){
+        after.allocated[kind].objects -= before[kind].objects;
+        after.allocated[kind].bytes -= before[kind].bytes;
+    }
+    out.write(formatAllocationReport(after, 0));
+}
+
+// helper which writes node of flat and its children indented by depth, returning the nodes written
+static size_t writeTree(const FlatAst& flat, uint32_t node, size_t depth, std::string& tree){
+    NodeKind kind = flat.kind(node);
+    tree += std::string(2 * depth, ' ') + profiledKindName((size_t)kind);
+    if(kind == NodeKind::IDENTIFIER || kind == NodeKind::INTEGER || kind == NodeKind::BOOLEAN ||
+        kind == NodeKind::PREFIX || kind == NodeKind::INFIX)
+        tree += " " + flat.literal(node);
+    else if(kind == NodeKind::STRING)
+        tree += " \"" + flat.literal(node) + "\"";
+    tree += "\n";
+    size_t written = 1;
+    for(uint32_t child: flat.children(node)){
+        if(child != NO_NODE)
+            written += writeTree(flat, child, depth + 1, tree);
+    }
+    return written;
+}
+
+// runs the :ast command, which prints the tree code parses to
+void REPL::astCommand(const std::string& argument){
+    OutputSink& out = standardOutput();
+    if(argument.size() < 2 || argument[0] != ' '){
+        out.write("usage: :ast <code>\n");
+        return;
+    }
+    Program* program = parse(argument.substr(1));
+    if(program == nullptr)
+        return;
+    FlatAst flat(program);
+    std::string tree;
+    size_t nodes = writeTree(flat, flat.root(), 0, tree);
+    out.write(tree + std::to_string(nodes) + (nodes == 1 ? " node\n" : " nodes\n"));
+}
+
+// runs the :stats command, which prints what the heap holds now and the collector's counters
+void REPL::statsCommand(){
+    OutputSink& out = standardOutput();
+    CountsByKind census = heapCensus();
+    AllocationCounts objects;
+    for(size_t kind = 0; kind < ENVIRONMENT_KIND; kind++){
+        objects.objects += census[kind].objects;
+        objects.bytes += census[kind].bytes;
+    }
+    HeapStats stats = heapStats();
+    out.write("objects        " + std::to_string(objects.objects) + " (" + std::to_string(objects.bytes) + " bytes)\n");
+    out.write("environments   " + std::to_string(census[ENVIRONMENT_KIND].objects) + " (" +
+        std::to_string(census[ENVIRONMENT_KIND].bytes) + " bytes)\n");
+    out.write("old generation " + std::to_string(stats.oldBytes) + " bytes at the last collection\n");
+    out.write("collections    " + std::to_string(stats.minorCollections) + " minor, " +
+        std::to_string(stats.majorCollections) + " major\n");
+    out.write("pauses         " + std::to_string(stats.maxPauseMicros) + " us max, " +
+        std::to_string(stats.totalPauseMicros) + " us total\n");
+}
+
 void printParserErrors(Parser& p){
-    std::cout<<"ERRORS:\n\tParser Errors:\n";
-    for(std::string error:p.errors){
-        std::cout<<"\t"<<error<<"\n";
+    OutputSink& out = standardOutput();
+    out.write("ERRORS:\n\tParser Errors:\n");
+    for(std::string& error:p.errors){
+        out.put('\t');
+        out.write(error);
+        out.put('\n');
     }
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 #include "lexer.h"
 #include "parser.h"
 #include "object.h"
@@ -19,16 +20,71 @@ class REPL {
         REPL();
 
         // Start the REPL
-        // EFFECTS:  starts the REPL
+        // EFFECTS:  starts the REPL, lines starting with ':' are commands rather than Monkey code
+        //           :allocations [on|off]  starts or stops counting allocations, or prints the counts
+        //           :nodes [on|off|json <path>]  starts or stops counting evaluations of each node, or prints
+        //                                        the counts or writes them to path as JSON
+        //           :time [xN] <code>  evaluates code N times and prints the fastest and median wall and CPU time
+        //           :alloc <code>  evaluates code and prints the objects and bytes it allocated
+        //           :ast <code>  prints the tree code parses to and its number of nodes without evaluating it
+        //           :stats  prints what the heap holds and what the collector has done
         void start();
 
     private:
+        // number of sites :allocations prints
+        static const size_t ALLOCATION_REPORT_SITES = 10;
 
-        std::string input;
+        // number of nodes :nodes prints
+        static const size_t NODE_REPORT_NODES = 15;
+
+        // helper which parses source with the REPL's lexer and parser
+        // REQUIRES: source is the end of input and is the only code parsed from it
+        // EFFECTS:  returns the program, or prints the parser errors and returns nullptr
+        Program* parse(const std::string& source);
+
+        // runs the :allocations command with what followed it on the line
+        void allocationsCommand(const std::string& argument);
+
+        // runs the :nodes command with what followed it on the line
+        void nodesCommand(const std::string& argument);
+
+        // runs the :time command with what followed it on the line, evaluating in env
+        void timeCommand(const std::string& argument, Environment* env);
+
+        // runs the :alloc command with what followed it on the line, evaluating in env
+        void allocCommand(const std::string& argument, Environment* env);
+
+        // runs the :ast command with what followed it on the line
+        void astCommand(const std::string& argument);
+
+        // runs the :stats command
+        void statsCommand();
+
+
+        std::string input; // the line being run
+        size_t linesRead = 0;
+        std::shared_ptr<AppendableSource> session; // the lines read up to the last one parsed, which lexer
+                                                   // lexes from its place in it
+        size_t sessionLines = 0;
         Lexer lexer;
         Parser parser;
 };
 
+// number of times :time evaluates code unless told otherwise
+static const size_t TIME_RUNS = 10;
+
+// most times :time evaluates code, larger counts print the usage line
+static const size_t MAX_TIME_RUNS = 1000000;
+
+// parses what followed :time on the line, an optional " xN" then " <code>"
+// EFFECTS:  returns false if there is no code or N isn't a count from 1 to MAX_TIME_RUNS, otherwise sets
+//           runs to N, or TIME_RUNS without one, and code to the code
+bool parseTimeArgument(const std::string& argument, size_t& runs, std::string& code);
+
+// returns the fastest and the median of times in seconds as "min <ms> ms, median <ms> ms"
+// REQUIRES: times isn't empty
+std::string fastestAndMedian(std::vector<double> times);
+
 
 const std::string PROMPT = ">> ";
 
@@ -0,0 +1,125 @@
+// definitions for sampleprofiler.h
+
+#include "sampleprofiler.h"
+#include <algorithm>
+#include <csignal>
+#include <map>
+#include <sys/time.h>
+
+std::atomic<bool> shadowStackEnabled{false};
+thread_local ShadowStack shadowStack;
+
+// samples, each the number of frames it kept followed by them from the outermost, allocated on first use
+// and only written by the signal handler while sampling
+static uintptr_t* samples = nullptr;
+static std::atomic<size_t> reservedWords{0}; // words handed out to samples, may pass SAMPLE_BUFFER_WORDS
+static std::atomic<size_t> firstDropped{SIZE_MAX}; // word the first sample which didn't fit would have started at
+static std::atomic<size_t> taken{0};
+static std::atomic<size_t> dropped{0};
+static std::atomic<int> handlersRunning{0};
+static bool sampling = false;
+
+// copies the shadow stack of the interrupted thread into the sample buffer, unless sampling has stopped
+static void takeSample(int){
+    // sequentially consistent with stopSampling, so either it waits for this handler or this sees it stopped
+    handlersRunning.fetch_add(1);
+    if(!shadowStackEnabled.load()){
+        handlersRunning.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+    size_t depth = shadowStack.depth.load(std::memory_order_relaxed);
+    std::atomic_signal_fence(std::memory_order_acquire);
+    size_t kept = std::min(depth, MAX_SAMPLE_DEPTH);
+    size_t start = reservedWords.fetch_add(kept + 1, std::memory_order_relaxed);
+    if(start + kept + 1 > SAMPLE_BUFFER_WORDS){
+        size_t none = SIZE_MAX;
+        firstDropped.compare_exchange_strong(none, start, std::memory_order_relaxed);
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    else{
+        samples[start] = kept;
+        for(size_t i = 0; i < kept; i++)
+            samples[start + 1 + i] = reinterpret_cast<uintptr_t>(shadowStack.frames[i]);
+        taken.fetch_add(1, std::memory_order_relaxed);
+    }
+    handlersRunning.fetch_sub(1, std::memory_order_release);
+}
+
+// starts sampling every interval of CPU time the process uses
+bool startSampling(std::chrono::microseconds interval){
+    if(sampling)
+        return false;
+    if(samples == nullptr)
+        samples = new uintptr_t[SAMPLE_BUFFER_WORDS];
+    reservedWords.store(0);
+    firstDropped.store(SIZE_MAX);
+    taken.store(0);
+    dropped.store(0);
+
+    struct sigaction action = {};
+    action.sa_handler = takeSample;
+    action.sa_flags = SA_RESTART; // reads of the REPL's input carry on rather than fail
+    sigemptyset(&action.sa_mask);
+    if(sigaction(SIGPROF, &action, nullptr) != 0)
+        return false;
+    shadowStackEnabled.store(true);
+
+    struct itimerval timer = {};
+    timer.it_interval.tv_sec = (time_t)(interval.count() / 1000000);
+    timer.it_interval.tv_usec = (suseconds_t)(interval.count() % 1000000);
+    timer.it_value = timer.it_interval;
+    if(setitimer(ITIMER_PROF, &timer, nullptr) != 0){
+        shadowStackEnabled.store(false);
+        return false;
+    }
+    sampling = true;
+    return true;
+}
+
+// stops sampling
+void stopSampling(){
+    if(!sampling)
+        return;
+    struct itimerval timer = {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    // a signal sent before the timer stopped may still be pending or handled on another thread, the
+    // handler stays installed and returns once it sees this, and the ones which didn't are waited for
+    shadowStackEnabled.store(false);
+    while(handlersRunning.load() != 0){}
+    sampling = false;
+}
+
+// returns the number of samples taken
+size_t sampleCount(){
+    return taken.load(std::memory_order_relaxed);
+}
+
+// returns the number of samples dropped as the buffer was full
+size_t droppedSamples(){
+    return dropped.load(std::memory_order_relaxed);
+}
+
+// returns the samples as collapsed stacks
+std::string collapsedStacks(Lexer* lexer){
+    std::map<std::string, size_t> stacks; // ordered so the output is stable
+    size_t end = std::min(reservedWords.load(), firstDropped.load());
+    std::map<FunctionLiteral*, std::string> names;
+    for(size_t position = 0; position < end && samples != nullptr;){
+        size_t kept = samples[position];
+        std::string stack = "monkey";
+        for(size_t i = 0; i < kept; i++){
+            FunctionLiteral* literal = reinterpret_cast<FunctionLiteral*>(samples[position + 1 + i]);
+            auto found = names.find(literal);
+            if(found == names.end())
+                found = names.emplace(literal, functionName(literal, lexer)).first;
+            stack += ";" + found->second;
+        }
+        stacks[stack]++;
+        position += kept + 1;
+    }
+
+    std::string output;
+    for(auto& entry: stacks)
+        output += entry.first + " " + std::to_string(entry.second) + "\n";
+    return output;
+}
@@ -0,0 +1,82 @@
+// sampling profiler which attributes time to Monkey functions rather than to the evaluator's C++ frames
+
+#ifndef SAMPLEPROFILER_H
+#define SAMPLEPROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include "ast.h"
+#include "lexer.h"
+
+// Calls to Monkey functions push their FunctionLiteral on a shadow call stack of the calling thread while
+// sampling is on. A SIGPROF timer interrupts whichever thread is using the CPU, and the handler copies
+// that thread's shadow stack into a buffer set aside when sampling started, so it neither locks nor
+// allocates. The samples are turned into the collapsed stacks flamegraph tools read once sampling stops.
+
+// deepest stack a sample keeps, deeper ones keep their outermost frames
+static const size_t MAX_SAMPLE_DEPTH = 128;
+
+// words of the sample buffer, each sample takes one more than its depth, later samples are dropped
+static const size_t SAMPLE_BUFFER_WORDS = 1 << 20;
+
+// whether calls push shadow frames, only set while sampling, the SIGPROF handler ignores signals while
+// it is off, as one sent before the timer stopped may arrive after
+extern std::atomic<bool> shadowStackEnabled;
+
+// shadow call stack of one thread, written by the thread and read by the signal handler interrupting it
+struct ShadowStack {
+    FunctionLiteral* frames[MAX_SAMPLE_DEPTH] = {};
+    std::atomic<size_t> depth{0}; // may pass MAX_SAMPLE_DEPTH, frames past it aren't kept
+};
+
+extern thread_local ShadowStack shadowStack;
+
+// pushes a call of the function created from literal onto the calling thread's shadow stack while it
+// is alive, if sampling is on
+class ShadowFrame {
+    public:
+        ShadowFrame(FunctionLiteral* literal){
+            if(shadowStackEnabled.load(std::memory_order_relaxed)){
+                size_t depth = shadowStack.depth.load(std::memory_order_relaxed);
+                if(depth < MAX_SAMPLE_DEPTH)
+                    shadowStack.frames[depth] = literal;
+                // the frame must be written before the handler can see the depth which includes it
+                std::atomic_signal_fence(std::memory_order_release);
+                shadowStack.depth.store(depth + 1, std::memory_order_relaxed);
+                active = true;
+            }
+        }
+
+        ~ShadowFrame(){
+            if(active)
+                shadowStack.depth.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        ShadowFrame(const ShadowFrame&) = delete;
+        ShadowFrame& operator=(const ShadowFrame&) = delete;
+
+    private:
+        bool active = false;
+};
+
+// starts sampling every interval of CPU time the process uses, forgetting earlier samples
+// EFFECTS:  returns false if sampling is already on or the timer or handler couldn't be set up
+bool startSampling(std::chrono::microseconds interval = std::chrono::microseconds(1000));
+
+// stops sampling, the samples taken are kept until the next start
+// EFFECTS:  leaves the handler installed, ignoring the SIGPROFs still pending, rather than restoring the
+//           previous action whose default would end the process
+void stopSampling();
+
+// returns the number of samples taken, and dropped as the buffer was full
+size_t sampleCount();
+size_t droppedSamples();
+
+// returns the samples as collapsed stacks, one line per distinct stack of its frames from the outermost
+// separated by ';' and then the number of samples, like "monkey;run;fib;fib 12". Functions are named
+// after their let binding, anonymous ones after where they start, located with lexer if it is given
+// REQUIRES: sampling is off and the programs the samples were taken in are still alive
+std::string collapsedStacks(Lexer* lexer = nullptr);
+
+#endif // SAMPLEPROFILER_H
@@ -0,0 +1,233 @@
+// definitions for scan.h
+
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// builds the class table at compile time
+static constexpr uint8_t classOf(int c){
+    uint8_t bits = 0;
+    if(c == ' ' || c == '\n' || c == '\t' || c == '\r')
+        bits |= CLASS_WHITESPACE;
+    if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_')
+        bits |= CLASS_IDENTIFIER;
+    if(c >= '0' && c <= '9')
+        bits |= CLASS_DIGIT;
+    if(c == '"' || c == '\0')
+        bits |= CLASS_STRING_END;
+    return bits;
+}
+
+#define CLASS_ROW(n) classOf(n), classOf(n + 1), classOf(n + 2), classOf(n + 3), \
+                     classOf(n + 4), classOf(n + 5), classOf(n + 6), classOf(n + 7)
+#define CLASS_ROWS(n) CLASS_ROW(n), CLASS_ROW(n + 8), CLASS_ROW(n + 16), CLASS_ROW(n + 24)
+
+const uint8_t charClass[256] = {
+    CLASS_ROWS(0), CLASS_ROWS(32), CLASS_ROWS(64), CLASS_ROWS(96),
+    CLASS_ROWS(128), CLASS_ROWS(160), CLASS_ROWS(192), CLASS_ROWS(224),
+};
+
+// scalar scanners, one table lookup per byte
+
+// helper which advances p while its byte is in mask
+template <uint8_t mask>
+static const char* scalarRun(const char* p){
+    while(inClass(*p, mask))
+        p++;
+    return p;
+}
+
+// first '"' or '\0' from p
+static const char* scalarStringEnd(const char* p){
+    while(!inClass(*p, CLASS_STRING_END))
+        p++;
+    return p;
+}
+
+#ifdef SCAN_X86
+
+// sse2 scanners, classify 16 bytes per step with range compares and find the end with a bit scan
+
+// bytes of chunk which are whitespace
+static inline __m128i sse2Whitespace(__m128i chunk){
+    __m128i space = _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' '));
+    __m128i newline = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'));
+    __m128i tab = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'));
+    __m128i ret = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r'));
+    return _mm_or_si128(_mm_or_si128(space, newline), _mm_or_si128(tab, ret));
+}
+
+// bytes of chunk which are within [low, low + count), using the signed compare sse2 has by
+// shifting the range down to start at -128
+static inline __m128i sse2InRange(__m128i chunk, char low, char count){
+    __m128i shifted = _mm_add_epi8(chunk, _mm_set1_epi8((char)(-128 - low)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(-128 + count)));
+}
+
+// bytes of chunk which are letters or '_'
+static inline __m128i sse2Identifier(__m128i chunk){
+    __m128i letter = sse2InRange(_mm_or_si128(chunk, _mm_set1_epi8(0x20)), 'a', 26); // folds case
+    return _mm_or_si128(letter, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_')));
+}
+
+// bytes of chunk which are digits
+static inline __m128i sse2Digits(__m128i chunk){
+    return sse2InRange(chunk, '0', 10);
+}
+
+// bytes of chunk which end a string
+static inline __m128i sse2StringEnd(__m128i chunk){
+    __m128i quote = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('"'));
+    return _mm_or_si128(quote, _mm_cmpeq_epi8(chunk, _mm_setzero_si128()));
+}
+
+// helper which advances p 16 bytes at a time until a byte classify doesn't accept
+template <__m128i (*classify)(__m128i)>
+static const char* sse2Run(const char* p){
+    while(true){
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = (unsigned)_mm_movemask_epi8(classify(chunk)) ^ 0xFFFFu;
+        if(mask != 0)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+}
+
+// first '"' or '\0' from p, 16 bytes at a time
+static const char* sse2StringEndScan(const char* p){
+    while(true){
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = (unsigned)_mm_movemask_epi8(sse2StringEnd(chunk));
+        if(mask != 0)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+}
+
+// avx2 scanners, the same classification 32 bytes per step, compiled for avx2 only in these
+// functions so the rest of the interpreter still runs on any x86-64 cpu
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+AVX2_TARGET static inline __m256i avx2InRange(__m256i chunk, char low, char count){
+    __m256i shifted = _mm256_add_epi8(chunk, _mm256_set1_epi8((char)(-128 - low)));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-128 + count)), shifted);
+}
+
+AVX2_TARGET static inline __m256i avx2Whitespace(__m256i chunk){
+    __m256i space = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' '));
+    __m256i newline = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n'));
+    __m256i tab = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\t'));
+    __m256i ret = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\r'));
+    return _mm256_or_si256(_mm256_or_si256(space, newline), _mm256_or_si256(tab, ret));
+}
+
+AVX2_TARGET static inline __m256i avx2Identifier(__m256i chunk){
+    __m256i letter = avx2InRange(_mm256_or_si256(chunk, _mm256_set1_epi8(0x20)), 'a', 26);
+    return _mm256_or_si256(letter, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('_')));
+}
+
+AVX2_TARGET static inline __m256i avx2Digits(__m256i chunk){
+    return avx2InRange(chunk, '0', 10);
+}
+
+AVX2_TARGET static const char* avx2WhitespaceRun(const char* p){
+    while(true){
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(avx2Whitespace(chunk));
+        if(mask != 0)
+            return p + __builtin_ctz(mask);
+        p += 32;
+    }
+}
+
+AVX2_TARGET static const char* avx2IdentifierRun(const char* p){
+    while(true){
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(avx2Identifier(chunk));
+        if(mask != 0)
+            return p + __builtin_ctz(mask);
+        p += 32;
+    }
+}
+
+AVX2_TARGET static const char* avx2DigitRun(const char* p){
+    while(true){
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(avx2Digits(chunk));
+        if(mask != 0)
+            return p + __builtin_ctz(mask);
+        p += 32;
+    }
+}
+
+AVX2_TARGET static const char* avx2StringEndScan(const char* p){
+    while(true){
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i quote = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('"'));
+        __m256i end = _mm256_or_si256(quote, _mm256_cmpeq_epi8(chunk, _mm256_setzero_si256()));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(end);
+        if(mask != 0)
+            return p + __builtin_ctz(mask);
+        p += 32;
+    }
+}
+
+#endif // SCAN_X86
+
+// returns the fastest implementation the cpu supports
+ScanImplementation bestScanImplementation(){
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return ScanImplementation::AVX2;
+    if(__builtin_cpu_supports("sse2"))
+        return ScanImplementation::SSE2;
+#endif
+    return ScanImplementation::SCALAR;
+}
+
+// switches scanRuns to implementation
+bool useScanImplementation(ScanImplementation implementation){
+    switch(implementation){
+        case ScanImplementation::SCALAR:
+            scanRuns = {&scalarRun<CLASS_WHITESPACE>, &scalarRun<CLASS_IDENTIFIER>, &scalarRun<CLASS_DIGIT>, &scalarStringEnd};
+            return true;
+#ifdef SCAN_X86
+        case ScanImplementation::SSE2:
+            if(!__builtin_cpu_supports("sse2"))
+                return false;
+            scanRuns = {&sse2Run<sse2Whitespace>, &sse2Run<sse2Identifier>, &sse2Run<sse2Digits>, &sse2StringEndScan};
+            return true;
+        case ScanImplementation::AVX2:
+            if(!__builtin_cpu_supports("avx2"))
+                return false;
+            scanRuns = {&avx2WhitespaceRun, &avx2IdentifierRun, &avx2DigitRun, &avx2StringEndScan};
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+// returns the name of implementation for reports
+std::string scanImplementationName(ScanImplementation implementation){
+    switch(implementation){
+        case ScanImplementation::SCALAR:
+            return "scalar";
+        case ScanImplementation::SSE2:
+            return "sse2";
+        case ScanImplementation::AVX2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+// starts on the scalar scanners, constant initialized so lexers built during static initialization work
+RunScanners scanRuns = {&scalarRun<CLASS_WHITESPACE>, &scalarRun<CLASS_IDENTIFIER>, &scalarRun<CLASS_DIGIT>, &scalarStringEnd};
+
+// picks the best scanners when the program starts
+static const bool scannersSelected = useScanImplementation(bestScanImplementation());
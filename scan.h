@@ -0,0 +1,54 @@
+// vectorized scanning of character runs for the Lexer
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstdint>
+#include <string>
+
+// bits of the character classes in charClass
+enum CharClass : uint8_t {
+    CLASS_WHITESPACE = 1, // ' ', '\n', '\t', '\r'
+    CLASS_IDENTIFIER = 2, // letters and '_'
+    CLASS_DIGIT = 4, // '0' to '9'
+    CLASS_STRING_END = 8, // '"' and the '\0' sentinel
+};
+
+// class bits of each byte, unlike isalpha and isdigit this ignores the locale
+extern const uint8_t charClass[256];
+
+// returns if c is in any of the classes in mask
+inline bool inClass(char c, uint8_t mask){
+    return (charClass[(unsigned char)c] & mask) != 0;
+}
+
+// implementations the run scanners can be backed by, chosen from what the cpu supports on startup
+enum class ScanImplementation : uint8_t {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+// run scanners, each returns the first position at or after p which ends the run
+// REQUIRES: the run is ended by a '\0' sentinel followed by at least 32 readable bytes
+struct RunScanners {
+    const char* (*whitespace)(const char* p); // first byte which isn't whitespace
+    const char* (*identifier)(const char* p); // first byte which isn't a letter or '_'
+    const char* (*digits)(const char* p); // first byte which isn't a digit
+    const char* (*stringEnd)(const char* p); // first '"' or '\0'
+};
+
+// scanners the Lexer uses
+extern RunScanners scanRuns;
+
+// switches scanRuns to implementation
+// EFFECTS:  returns false and leaves scanRuns alone if the cpu doesn't support implementation
+bool useScanImplementation(ScanImplementation implementation);
+
+// returns the fastest implementation the cpu supports
+ScanImplementation bestScanImplementation();
+
+// returns the name of implementation for reports
+std::string scanImplementationName(ScanImplementation implementation);
+
+#endif // SCAN_H
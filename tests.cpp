@@ -4,8 +4,27 @@
 #include "object.h"
 #include <string>
 #include <variant>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <csignal>
 #include "evaluator.h"
 #include "environment.h"
+#include "threadpool.h"
+#include "scan.h"
+#include "flatast.h"
+#include "flateval.h"
+#include "programcache.h"
+#include "incremental.h"
+#include "parallelparser.h"
+#include "allocationprofile.h"
+#include "sampleprofiler.h"
+#include "nodeprofile.h"
+#include "tracing.h"
+#include "heap.h"
+#include "differential.h"
+#include "repl.h"
+#include "regression.h"
 
 using namespace std;
 
@@ -245,6 +264,178 @@ TEST(LexerTests, SpecialSymbolsAndKeywordsTest) {
 }
 
 
+TEST(LexerTests, LoopKeywordsTest) {
+    string input = "while (x) { x = 1; } for (y in z) {}";
+    ExpectedToken tests[] = {
+        {TokenType::WHILE, "while"},
+        {TokenType::LPAREN, "("},
+        {TokenType::IDENT, "x"},
+        {TokenType::RPAREN, ")"},
+        {TokenType::LBRACE, "{"},
+        {TokenType::IDENT, "x"},
+        {TokenType::ASSIGN, "="},
+        {TokenType::INT, "1"},
+        {TokenType::SEMICOLON, ";"},
+        {TokenType::RBRACE, "}"},
+        {TokenType::FOR, "for"},
+        {TokenType::LPAREN, "("},
+        {TokenType::IDENT, "y"},
+        {TokenType::IN, "in"},
+        {TokenType::IDENT, "z"},
+        {TokenType::RPAREN, ")"},
+        {TokenType::LBRACE, "{"},
+        {TokenType::RBRACE, "}"},
+        {TokenType::ENDOFFILE, ""},
+    };
+
+    Lexer lexer = Lexer(input);
+    for(ExpectedToken ex_tok : tests){
+        Token tok = lexer.nextToken();
+        EXPECT_EQ(tok.type, ex_tok.expectedType);
+        EXPECT_EQ(tok.literal, ex_tok.expectedLiteral);
+    }
+}
+
+// helper which lexes all of the tokens from a lexer up to and including ENDOFFILE
+vector<Token> lexAll(Lexer& lexer){
+    vector<Token> tokens;
+    while(true){
+        tokens.push_back(lexer.nextToken());
+        if(tokens.back().type == TokenType::ENDOFFILE)
+            return tokens;
+    }
+}
+
+TEST(LexerTests, SourcesMatchStringLexerTest) {
+    string input = "let add = fn(x, y) { x + y; };\n"
+                   "let longer_identifier_name = \"a string literal which is longer than the window\";\n"
+                   "if (10 == 10) { add(1, 2) } else { 12345 != 67890 }\n";
+    for(int i = 0; i < 50; i++)
+        input += "let x" + std::string(i % 7, 'y') + " = [1, 22, 333];\t\r\n";
+
+    Lexer stringLexer = Lexer(input);
+    vector<Token> expected = lexAll(stringLexer);
+
+    // tiny windows force refills in the middle of tokens, whitespace and two character operators
+    for(size_t window: {1, 2, 3, 7, 16, 4096}){
+        std::istringstream stream(input);
+        Lexer streamLexer = Lexer(std::make_shared<StreamSource>(stream, window));
+        vector<Token> tokens = lexAll(streamLexer);
+        ASSERT_EQ(tokens.size(), expected.size()) << "window " << window;
+        for(size_t i = 0; i < tokens.size(); i++){
+            EXPECT_EQ(tokens[i].type, expected[i].type) << "window " << window << " token " << i;
+            EXPECT_EQ(tokens[i].literal, expected[i].literal) << "window " << window << " token " << i;
+        }
+    }
+
+    std::string path = ::testing::TempDir() + "lexer_source_test.monkey";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << input;
+    }
+    Lexer fileLexer = Lexer(std::make_shared<MappedFileSource>(path));
+    vector<Token> tokens = lexAll(fileLexer);
+    ASSERT_EQ(tokens.size(), expected.size());
+    for(size_t i = 0; i < tokens.size(); i++)
+        EXPECT_EQ(tokens[i].literal, expected[i].literal) << "token " << i;
+
+    // the lexer keeps returning ENDOFFILE once the input runs out
+    EXPECT_EQ(fileLexer.nextToken().type, TokenType::ENDOFFILE);
+    EXPECT_EQ(fileLexer.nextToken().type, TokenType::ENDOFFILE);
+    std::remove(path.c_str());
+
+    EXPECT_THROW(MappedFileSource("/nonexistent/file.monkey"), std::runtime_error);
+}
+
+TEST(LexerTests, TokenOffsetsTest) {
+    string input = "let x = 5;\n\n  puts(\"hi\")\r\n\tx";
+    struct {
+        std::string literal;
+        uint32_t offset;
+        uint32_t line;
+        uint32_t column;
+    } tests[] = {
+        {"let", 0, 1, 1},
+        {"x", 4, 1, 5},
+        {"=", 6, 1, 7},
+        {"5", 8, 1, 9},
+        {";", 9, 1, 10},
+        {"puts", 14, 3, 3},
+        {"(", 18, 3, 7},
+        {"hi", 19, 3, 8},
+        {")", 23, 3, 12},
+        {"x", 27, 4, 2},
+        {"", 28, 4, 3},
+    };
+
+    // a tiny window drops lines before they are located so the stream source has to index them first
+    for(size_t window: {0, 3}){
+        std::istringstream stream(input);
+        Lexer lexer = window == 0 ? Lexer(input) : Lexer(std::make_shared<StreamSource>(stream, window));
+        vector<Token> tokens = lexAll(lexer);
+        ASSERT_EQ(tokens.size(), std::size(tests));
+        for(size_t i = 0; i < tokens.size(); i++){
+            EXPECT_EQ(tokens[i].literal, tests[i].literal);
+            EXPECT_EQ(tokens[i].offset, tests[i].offset) << "window " << window << " token " << i;
+            SourceLocation location = lexer.locate(tokens[i].offset);
+            EXPECT_EQ(location.line, tests[i].line) << "window " << window << " token " << i;
+            EXPECT_EQ(location.column, tests[i].column) << "window " << window << " token " << i;
+        }
+    }
+    Lexer lineLexer = Lexer(input);
+    EXPECT_EQ(lineLexer.lineAt(19), "  puts(\"hi\")\r");
+    EXPECT_EQ(lineLexer.lineAt(28), "\tx");
+
+    // lexers over an appendable source each lex their own piece and locate in the whole input
+    auto session = std::make_shared<AppendableSource>();
+    session->append("let a = 1;\n");
+    Lexer first = Lexer(session, 0);
+    EXPECT_EQ(first.nextToken().offset, 0u);
+    session->append("\n  a + 2\n");
+    Lexer second = Lexer(session, 12);
+    vector<Token> secondTokens = lexAll(second);
+    ASSERT_EQ(secondTokens.size(), 4u);
+    EXPECT_EQ(secondTokens[1].offset, 16u);
+    SourceLocation plus = first.locate(secondTokens[1].offset);
+    EXPECT_EQ(plus.line, 3u);
+    EXPECT_EQ(plus.column, 5u);
+    EXPECT_EQ(first.lineAt(secondTokens[1].offset), "  a + 2");
+
+    // the offset lives in the padding after the type so tokens are no bigger than before
+    EXPECT_EQ(sizeof(Token), sizeof(std::string) + alignof(std::string));
+}
+
+TEST(LexerTests, ScanImplementationsMatchTest) {
+    // runs which end at every offset within and across the 16 and 32 byte chunks
+    string input;
+    for(int i = 1; i < 70; i++){
+        input += std::string((size_t)i, 'a') + std::string((size_t)(i % 5), ' ') + std::to_string(i * 987654321LL);
+        input += "\t\r\n\"" + std::string((size_t)i, 'z') + " _Zz@[`{\" _x" + std::to_string(i) + ";\n";
+    }
+    input += "\xc3\xa9 \"unterminated";
+
+    ScanImplementation best = bestScanImplementation();
+    ASSERT_TRUE(useScanImplementation(ScanImplementation::SCALAR));
+    Lexer scalarLexer = Lexer(input);
+    vector<Token> expected = lexAll(scalarLexer);
+
+    for(ScanImplementation implementation: {ScanImplementation::SSE2, ScanImplementation::AVX2}){
+        if(!useScanImplementation(implementation))
+            continue;
+        for(size_t window: {3, 4096}){
+            std::istringstream stream(input);
+            Lexer lexer = Lexer(std::make_shared<StreamSource>(stream, window));
+            vector<Token> tokens = lexAll(lexer);
+            ASSERT_EQ(tokens.size(), expected.size()) << scanImplementationName(implementation);
+            for(size_t i = 0; i < tokens.size(); i++){
+                EXPECT_EQ(tokens[i].type, expected[i].type) << scanImplementationName(implementation) << " token " << i;
+                EXPECT_EQ(tokens[i].literal, expected[i].literal) << scanImplementationName(implementation) << " token " << i;
+            }
+        }
+    }
+    useScanImplementation(best);
+}
+
 // PARSER TESTS:
 TEST(ParserTests, LetStatementsTest) {
     struct {
@@ -992,6 +1183,74 @@ TEST(ParserTests, TestCallExpressionParameterParsing){
     }
 }
 
+TEST(ParserTests, TestLoopAndAssignStatements){
+    struct {
+        std::string input;
+        std::string expected;
+    } tests[] = {
+        {"x = 5;", "x = 5;"},
+        {"x = y + 2 * z", "x = (y + (2 * z));"},
+        {"while (x < 10) { x = x + 1; }", "while(x < 10) x = (x + 1);"},
+        {"for (item in [1, 2]) { puts(item) }", "for(item in [1, 2]) puts(item)"},
+        {"x == 5", "(x == 5)"},
+    };
+    for(auto test: tests){
+        Lexer l = Lexer(test.input);
+        Parser p = Parser(&l);
+        Program* program = p.parseProgram();
+        checkParserErrors(p);
+        ASSERT_EQ(program->statements.size(), 1u) << test.input;
+        EXPECT_EQ(program->toString(), test.expected);
+        delete program;
+    }
+
+    std::string input = "for (x [1]) {}";
+    Lexer l = Lexer(input);
+    Parser p = Parser(&l);
+    delete p.parseProgram();
+    EXPECT_NE(p.getErrors().size(), 0u) << "for loop without 'in' should not parse";
+}
+
+TEST(ParserTests, TestErrorLocations){
+    std::string input = "let x = 5;\nlet = 10;\n  let y = );";
+    Lexer l = Lexer(input);
+    Parser p = Parser(&l);
+    delete p.parseProgram();
+    vector<string> errors = p.getErrors();
+    ASSERT_EQ(errors.size(), 2u);
+    EXPECT_EQ(errors[0], "2:5: expected next token to be IDENT but got = instead");
+    EXPECT_EQ(errors[1], "3:11: no prefix parse function for ) found");
+}
+
+TEST(ParserTests, TestErrorRecovery){
+    std::string input = "let x 5;\n"
+                        "let y = 10;\n"
+                        "if (y { y = 1; let z = 2; }\n"
+                        "let f = fn(a) { let = a; a * 2 };\n"
+                        "let big = 99999999999;\n"
+                        "puts(f(y) + );\n"
+                        "while (y < 99999999999) { y = 1; }\n"
+                        "return y";
+    Lexer l = Lexer(input);
+    Parser p = Parser(&l);
+    Program* program = p.parseProgram();
+    vector<string> errors = p.getErrors();
+    vector<string> expected = {
+        "1:7: expected next token to be = but got INT instead",
+        "3:7: expected next token to be ) but got { instead",
+        "4:21: expected next token to be IDENT but got = instead",
+        "5:11: could not parse 99999999999 as integer",
+        "6:13: no prefix parse function for ) found",
+        "7:12: could not parse 99999999999 as integer",
+    };
+    EXPECT_EQ(errors, expected);
+
+    // the statements without errors are kept, the function keeps the rest of its body, and the loop
+    // whose block parsed cleanly is still dropped for the error in its condition
+    EXPECT_EQ(program->toString(), "let y = 10;let f = fn(a)(a * 2);return y;");
+    delete program;
+}
+
 TEST(ParserTests, TestArrayLiteral){
     std::string input = "[1, 2 * 2, 3 + 3]";
     Lexer* l = new Lexer(input);
@@ -1246,7 +1505,7 @@ Object* testEval(std::string& input){
     Parser p = Parser(&l);
     Program* program = p.parseProgram();
     Environment env = Environment();
-    return Eval(program, &env);
+    return Eval(program, &env).toObject();
 }
 bool testIntegerObject(Object* obj, int expectedVal){
     if(!obj)
@@ -1503,6 +1762,82 @@ TEST(EvaluatorTests, TestErrorHandling){
     }
 }
 
+TEST(EvaluatorTests, TestErrorLocations){
+    struct {
+        std::string input;
+        uint32_t offset;
+    } tests[] = {
+        {"5 + true;", 2},
+        {"let f = fn(x) { x + y };\nf(1)", 20},
+        {"[1, 2][true]", 6},
+        {"len(1)", 3},
+        {"let a = 1;\n-true", 11},
+        {"b = 2", 0},
+        {"for (x in 5) { x }", 0},
+    };
+    for(auto test: tests){
+        Object* evaluated = testEval(test.input);
+        Error* error = dynamic_cast<Error*>(evaluated);
+        ASSERT_NE(error, nullptr) << test.input;
+        EXPECT_EQ(error->offset, test.offset) << test.input;
+    }
+}
+
+TEST(EvaluatorTests, TestQuickening){
+    std::string input = "let f = fn(a, b) { a + b };\n"
+                        "let g = fn(c, i) { c[i] };\n"
+                        "let h = {\"k\": 4};\n";
+    Lexer l = Lexer(input);
+    Parser p = Parser(&l);
+    Program* program = p.parseProgram();
+    checkParserErrors(p);
+    Environment env = Environment();
+    Eval(program, &env);
+    InfixExpression* add = dynamic_cast<InfixExpression*>(
+        dynamic_cast<FunctionLiteral*>(program->statements[0]->expressionValue)->body->statements[0]->expressionValue);
+    IndexExpression* index = dynamic_cast<IndexExpression*>(
+        dynamic_cast<FunctionLiteral*>(program->statements[1]->expressionValue)->body->statements[0]->expressionValue);
+    ASSERT_NE(add, nullptr);
+    ASSERT_NE(index, nullptr);
+
+    // run a snippet against the functions above, the program it comes from is never deleted as Eval
+    // keeps pointers into it
+    auto run = [&env](std::string code){
+        Lexer lexer = Lexer(code);
+        Parser parser = Parser(&lexer);
+        return Eval(parser.parseProgram(), &env).toObject();
+    };
+    EXPECT_EQ(add->quickened.load(), Quickened::UNSEEN);
+    testIntegerObject(run("f(2, 3)"), 5);
+    EXPECT_EQ(add->quickened.load(), Quickened::INTEGER_ADD);
+    testIntegerObject(run("f(4, 5)"), 9);
+    EXPECT_EQ(run("f(\"a\", \"b\")")->inspect(), "ab"); // guard fails so it deoptimizes
+    EXPECT_EQ(add->quickened.load(), Quickened::GENERIC);
+    testIntegerObject(run("f(1, 1)"), 2);
+
+    testIntegerObject(run("g([7, 8], 1)"), 8);
+    EXPECT_EQ(index->quickened.load(), Quickened::ARRAY_INDEX_BY_INTEGER);
+    testNullObject(run("g([7, 8], 2)"));
+    testIntegerObject(run("g(h, \"k\")"), 4);
+    EXPECT_EQ(index->quickened.load(), Quickened::GENERIC);
+
+    // with quickening off nodes stay unspecialized
+    std::string multiply = "let m = fn(x) { x * 2 }; m(21)";
+    Lexer ml = Lexer(multiply);
+    Parser mp = Parser(&ml);
+    Program* mprogram = mp.parseProgram();
+    InfixExpression* times = dynamic_cast<InfixExpression*>(
+        dynamic_cast<FunctionLiteral*>(mprogram->statements[0]->expressionValue)->body->statements[0]->expressionValue);
+    quickeningEnabled = false;
+    testIntegerObject(Eval(mprogram, &env).toObject(), 42);
+    EXPECT_EQ(times->quickened.load(), Quickened::UNSEEN);
+    quickeningEnabled = true;
+    testIntegerObject(Eval(mprogram, &env).toObject(), 42);
+    EXPECT_EQ(times->quickened.load(), Quickened::INTEGER_MULTIPLY);
+    delete mprogram;
+    delete program;
+}
+
 TEST(EvaluatorTests, TestLetStatements){
     struct {
         std::string input;
@@ -1582,13 +1917,42 @@ TEST(EvaluatorTests, TestStringConcatentation) {
     Object* evaluated = testEval(input);
     try{
         String* str = dynamic_cast<String*>(evaluated);
-        ASSERT_EQ(str->value, "Hello world!") << "String has wrong value. got=" << str->value;
+        ASSERT_EQ(str->flatten(), "Hello world!") << "String has wrong value. got=" << str->flatten();
     }
     catch(const std::bad_cast& e){
         ADD_FAILURE() << "Object is not String*. Dynamic cast failed";
     }
 }
 
+TEST(EvaluatorTests, TestStringRopeConcatenation) {
+    std::string input = "let a = \"abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz\";\
+    let b = a + a;\
+    let c = b + \"!\" + b;\
+    c";
+    Object* evaluated = testEval(input);
+    String* str = dynamic_cast<String*>(evaluated);
+    ASSERT_NE(str, nullptr) << "Object is not String*. Dynamic cast failed";
+    std::string alphabet = "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz";
+    std::string expected = alphabet + alphabet + "!" + alphabet + alphabet;
+    EXPECT_NE(str->left.load(), nullptr) << "long concatenation should build a rope";
+    EXPECT_EQ(str->length, expected.size()) << "rope has wrong length";
+    EXPECT_EQ(str->inspect(), expected) << "rope flattened to wrong value";
+    EXPECT_EQ(str->left.load(), nullptr) << "rope should be flat after inspect";
+
+    struct {
+        std::string input;
+        int expected;
+    } tests[] = {
+        {"let a = \"0123456789012345678901234567890123456789\"; len(a + a + a)", 120},
+        {"let a = \"0123456789012345678901234567890123456789\"; if((a + a) + a == a + (a + a)) { 1 } else { 0 }", 1},
+        {"let a = \"0123456789012345678901234567890123456789\"; if(a + a != a + a + a) { 1 } else { 0 }", 1},
+        {"let a = \"0123456789012345678901234567890123456789\"; let h = {a + a: 5}; h[a + a]", 5},
+    };
+    for(auto test: tests){
+        testIntegerObject(testEval(test.input), test.expected);
+    }
+}
+
 TEST(EvaluatorTests, TestBuiltinFunctions){
     struct {
         std::string input;
@@ -1637,15 +2001,155 @@ TEST(EvaluatorTests, TestBuiltinFunctions){
     }
 }
 
+TEST(EvaluatorTests, TestLoops){
+    struct {
+        std::string input;
+        std::string expected;
+    } tests[] = {
+        {"let i = 0; let total = 0; while (i < 5) { total = total + i; i = i + 1; } total", "10"},
+        {"let total = 0; for (x in [1, 2, 3]) { total = total + x } total", "6"},
+        {"let out = []; for (x in [1, 2, 3]) { out = push(out, x * x) } out", "[1, 4, 9]"},
+        {"let f = fn() { let i = 0; while (true) { if (i == 3) { return i; } i = i + 1; } }; f()", "3"},
+        {"let f = fn(ar) { for (x in ar) { if (x > 1) { return x; } } 0 }; [f([1, 5, 7]), f([])]", "[5, 0]"},
+        {"let count = 0; let bump = fn() { count = count + 1 }; bump(); bump(); count", "2"},
+        {"let s = 0; for (x in [1, 2]) { let doubled = x * 2; s = s + doubled } s", "6"},
+        {"for (x in [1, 2]) { let inner = x } inner", "ERROR: identifier not found: inner"},
+        {"y = 5", "ERROR: identifier not found: y"},
+        {"for (x in 5) { x }", "ERROR: for loop can only iterate over ARRAY, got INTEGER"},
+        {"while (1 + true) { 1 }", "ERROR: type mismatch: INTEGER + BOOLEAN"},
+        {"let i = 0; while (i < 3) { i = i + 1; -true; } i", "ERROR: unknown operator: -BOOLEAN"},
+    };
+    for(auto test: tests){
+        Object* evaluated = testEval(test.input);
+        ASSERT_NE(evaluated, nullptr) << test.input;
+        EXPECT_EQ(evaluated->inspect(), test.expected) << test.input;
+    }
+}
+
+TEST(EvaluatorTests, TestHigherOrderBuiltins){
+    struct {
+        std::string input;
+        std::string expected;
+    } tests[] = {
+        {"map([1, 2, 3], fn(x) { x * 2 })", "[2, 4, 6]"},
+        {"map([], fn(x) { x * 2 })", "[]"},
+        {"map([\"a\", \"bc\"], len)", "[1, 2]"},
+        {"filter([1, 2, 3, 4, 5], fn(x) { x > 2 })", "[3, 4, 5]"},
+        {"filter([1, 2, 3], fn(x) { false })", "[]"},
+        {"reduce([1, 2, 3, 4], 0, fn(acc, x) { acc + x })", "10"},
+        {"reduce([], 7, fn(acc, x) { acc + x })", "7"},
+        {"let y = 10; pmap([1, 2, 3], fn(x) { x + y })", "[11, 12, 13]"},
+        {"pfilter([1, 2, 3, 4], fn(x) { x == 2 })", "[2]"},
+        {"map(1, fn(x) { x })", "ERROR: argument to 'map' must be ARRAY, got INTEGER"},
+        {"map([1], 1)", "ERROR: callback to 'map' must be FUNCTION, got INTEGER"},
+        {"map([1], fn(x, y) { x })", "ERROR: wrong number of parameters for 'map' callback. expected=1, got=2"},
+        {"reduce([1], fn(acc, x) { acc })", "ERROR: wrong number of arguments. expected=3, got=2"},
+        {"map([1, true, 3], fn(x) { -x })", "ERROR: unknown operator: -BOOLEAN"},
+    };
+    for(auto test: tests){
+        Object* evaluated = testEval(test.input);
+        ASSERT_NE(evaluated, nullptr) << test.input;
+        EXPECT_EQ(evaluated->inspect(), test.expected) << test.input;
+    }
+}
+
+TEST(EvaluatorTests, TestSortBuiltin){
+    struct {
+        std::string input;
+        std::string expected;
+    } tests[] = {
+        {"sort([3, -1, 2, 10, 0])", "[-1, 0, 2, 3, 10]"},
+        {"sort([])", "[]"},
+        {"sort([\"pear\", \"apple\", \"fig\"])", "[apple, fig, pear]"},
+        {"let a = [3, 1, 2]; let b = sort(a); [a, b]", "[[3, 1, 2], [1, 2, 3]]"},
+        {"sort([3, 1, 2], fn(a, b) { a > b })", "[3, 2, 1]"},
+        {"sort([[2, 0], [1, 1], [2, 2], [1, 3]], fn(a, b) { a[0] < b[0] })", "[[1, 1], [1, 3], [2, 0], [2, 2]]"},
+        {"sort([1, \"a\"])", "ERROR: argument to 'sort' must be all INTEGER or all STRING without a comparator, got STRING"},
+        {"sort([true, false])", "ERROR: argument to 'sort' must be all INTEGER or all STRING without a comparator, got BOOLEAN"},
+        {"sort(1)", "ERROR: argument to 'sort' must be ARRAY, got INTEGER"},
+        {"sort([1, 2], fn(a) { a })", "ERROR: wrong number of parameters for 'sort' callback. expected=2, got=1"},
+        {"sort([1, true], fn(a, b) { a < b })", "ERROR: type mismatch: BOOLEAN < INTEGER"},
+    };
+    for(auto test: tests){
+        Object* evaluated = testEval(test.input);
+        ASSERT_NE(evaluated, nullptr) << test.input;
+        EXPECT_EQ(evaluated->inspect(), test.expected) << test.input;
+    }
+}
+
+TEST(EvaluatorTests, TestParallelBuiltins){
+    // large enough to be split across the thread pool, results must come back in element order
+    std::string input = "let double = fn(x) { x * 2 };\
+    let build = fn(ar, n) { if(n == 0) { ar } else { build(push(ar, n), n - 1) } };\
+    let ar = build([], 2000);\
+    let mapped = pmap(ar, fn(x) { double(x) + 1 });\
+    let kept = pfilter(mapped, fn(x) { x > 2000 });\
+    [first(mapped), last(mapped), len(mapped), len(kept), first(kept), last(kept)]";
+    Object* evaluated = testEval(input);
+    ASSERT_NE(evaluated, nullptr);
+    EXPECT_EQ(evaluated->inspect(), "[4001, 3, 2000, 1001, 4001, 2001]");
+
+    std::string errorInput = "let build = fn(ar, n) { if(n == 0) { ar } else { build(push(ar, n), n - 1) } };\
+    pmap(push(build([], 1000), true), fn(x) { if(x == 500) { -true } else { x } })";
+    Object* err = testEval(errorInput);
+    ASSERT_NE(err, nullptr);
+    EXPECT_EQ(err->inspect(), "ERROR: unknown operator: -BOOLEAN") << "first error in element order should be reported";
+}
+
+TEST(EvaluatorTests, TestPureFunctionDetection){
+    struct {
+        std::string input;
+        bool expected;
+    } tests[] = {
+        {"fn(x) { x + 1 }", true},
+        {"fn(x) { let y = x * 2; len([y]) }", true},
+        {"fn(x) { let f = fn(y) { y }; f(x) }", true},
+        {"let g = fn(y) { y }; fn(x) { g(x) }", true},
+        {"let fact = fn(n) { if(n < 2) { 1 } else { n * fact(n - 1) } }; fn(x) { fact(x) }", true},
+        {"fn(x) { puts(x) }", false},
+        {"let p = puts; fn(x) { p(x) }", false},
+        {"let g = fn(y) { puts(y) }; fn(x) { g(x) }", false},
+        {"fn(x) { x(1) }", false},
+        {"fn(x) { let f = first([x]); f(1) }", false},
+        {"fn(x) { [puts][0](x) }", false},
+        {"fn(x) { let t = 0; for (y in x) { t = t + y } t }", true},
+        {"fn(x) { let i = 0; while (i < x) { i = i + 1 } i }", true},
+        {"let total = 0; fn(x) { total = total + x }", false},
+        {"fn(x) { while (x) { let t = 1 } t = 2 }", false},
+        {"let total = 0; let add = fn(y) { total = total + y }; fn(x) { add(x) }", false},
+        {"fn(x) { let f = fn(y) { y }; f = puts; f(x) }", false},
+    };
+    for(auto test: tests){
+        Lexer l = Lexer(test.input);
+        Parser p = Parser(&l);
+        Program* program = p.parseProgram();
+        Environment env = Environment();
+        Object* evaluated = Eval(program, &env).toObject();
+        Function* func = dynamic_cast<Function*>(evaluated);
+        ASSERT_NE(func, nullptr) << test.input;
+        std::unordered_set<Function*> visited;
+        EXPECT_EQ(isPureFunction(func, visited), test.expected) << test.input;
+
+        // functions evalFlat creates, like those of a cached parse, are checked the same way
+        FlatAst flat(program);
+        Environment flatEnv = Environment();
+        Function* flatFunc = dynamic_cast<Function*>(evalFlat(flat, &flatEnv).toObject());
+        ASSERT_NE(flatFunc, nullptr) << test.input;
+        ASSERT_NE(flatFunc->flat, nullptr) << test.input;
+        std::unordered_set<Function*> flatVisited;
+        EXPECT_EQ(isPureFunction(flatFunc, flatVisited), test.expected) << "flat " << test.input;
+    }
+}
+
 TEST(EvaluatorTests, TestArrayLiterals){
   std::string input = "[1, 2*2, 3+3]";
     Object* evaluated = testEval(input);
     try{
         Array* ar = dynamic_cast<Array*>(evaluated);
         ASSERT_EQ(ar->elements.size(), 3) << "Array has wrong number of elements. expected 3, got=" << ar->elements.size();
-        testIntegerObject(ar->elements[0], 1);
-        testIntegerObject(ar->elements[1], 4);
-        testIntegerObject(ar->elements[2], 6);
+        testIntegerObject(ar->elements[0].toObject(), 1);
+        testIntegerObject(ar->elements[1].toObject(), 4);
+        testIntegerObject(ar->elements[2].toObject(), 6);
 
     }
     catch(const std::bad_cast& e){
@@ -1735,7 +2239,7 @@ TEST(EvaluatorTests, TestHashLiterals){
         for(auto expectIt: expected){
             std::unordered_map<HashKey, HashPair>::iterator evalIt = hash->pairs.find(expectIt.first);
             ASSERT_NE(evalIt, hash->pairs.end()) << "no pair for given key, expected val=" << expectIt.second;
-            testIntegerObject(evalIt->second.value, expectIt.second);
+            testIntegerObject(evalIt->second.value.toObject(), expectIt.second);
         }
 
     }
@@ -1853,4 +2357,829 @@ TEST(ObjectTests, TestIntegerHashKey){
     delete true2;
     delete false1;
     delete false2;
-}
\ No newline at end of file
+}
+
+TEST(ObjectTests, TestInspectStreaming){
+    std::string input = "[1, -20, \"three\", [4, [true, false]], {\"five\": 5}, fn(x) { x }(6)]";
+    Object* evaluated = testEval(input);
+    ASSERT_NE(evaluated, nullptr);
+
+    std::string streamed;
+    OutputSink out(streamed);
+    evaluated->inspect(out);
+    EXPECT_EQ(streamed, "[1, -20, three, [4, [true, false]], {five: 5}, 6]") << "streamed inspect has wrong output";
+    EXPECT_EQ(evaluated->inspect(), streamed) << "inspect() and inspect(OutputSink&) disagree";
+
+    // flushing a stream sink in blocks should not change the output
+    std::vector<Value> elements;
+    for(int i = 0; i < 20000; i++)
+        elements.push_back(Value::integer(i));
+    Array* big = new Array(elements);
+    std::ostringstream stream;
+    {
+        OutputSink streamOut(stream);
+        big->inspect(streamOut);
+    }
+    EXPECT_EQ(stream.str(), big->inspect()) << "buffered stream output differs from inspect()";
+
+    // a line buffered sink writes each line out as soon as it ends
+    std::ostringstream lines;
+    OutputSink lineOut(lines, true);
+    lineOut.write("first");
+    EXPECT_EQ(lines.str(), "");
+    lineOut.put('\n');
+    EXPECT_EQ(lines.str(), "first\n");
+    lineOut.write("second\nthird");
+    EXPECT_EQ(lines.str(), "first\nsecond\nthird");
+}
+
+// Thread pool tests
+TEST(ThreadPoolTests, TestParallelForCoversRange){
+    ThreadPool pool(4);
+    std::vector<int> hits(10000, 0);
+    pool.parallelFor(hits.size(), 37, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++)
+            hits[i]++;
+    });
+    for(size_t i = 0; i < hits.size(); i++)
+        ASSERT_EQ(hits[i], 1) << "index " << i << " was not visited exactly once";
+
+    // tasks which call back into the pool must not deadlock it
+    std::atomic<size_t> total(0);
+    pool.parallelFor(8, 1, [&](size_t, size_t){
+        pool.parallelFor(100, 10, [&](size_t begin, size_t end){
+            total += end - begin;
+        });
+    });
+    EXPECT_EQ(total.load(), 800) << "nested parallelFor missed chunks";
+}
+
+// Flat AST tests
+TEST(FlatAstTests, TestMatchesPointerAst){
+    std::string inputs[] = {
+        "let x = 5; x = x * (2 + -3); return !true;",
+        "let f = fn(a, b) { if (a < b) { a } else { b } }; f(1, 2)[0]",
+        "fn() {}; if (x) { y }",
+        "let h = {\"one\": {true: [1, \"two\", 3]}}; h[\"one\"]", // one pair as pairs are kept in pointer order
+        "let i = 0; while (i < 3) { i = i + 1; } for (e in [1, 2]) { puts(e) }",
+        "",
+    };
+    for(std::string& input: inputs){
+        Lexer l = Lexer(input);
+        Parser p = Parser(&l);
+        Program* program = p.parseProgram();
+        checkParserErrors(p);
+
+        FlatAst flat(program);
+        EXPECT_EQ(flat.toString(), program->toString()) << input;
+        Program* rebuilt = flat.toProgram();
+        EXPECT_EQ(rebuilt->toString(), program->toString()) << input;
+        EXPECT_EQ(FlatAst(rebuilt).toString(), program->toString()) << input;
+        delete rebuilt;
+        delete program;
+    }
+}
+
+TEST(FlatAstTests, TestLayout){
+    std::string input = "let x = 1 + 2;\nif (x) { x }";
+    Lexer l = Lexer(input);
+    Parser p = Parser(&l);
+    Program* program = p.parseProgram();
+    checkParserErrors(p);
+    FlatAst flat(program);
+
+    // children are stored before their parents so the program is last
+    ASSERT_EQ(flat.size(), 12u);
+    uint32_t root = flat.root();
+    EXPECT_EQ(flat.kind(root), NodeKind::PROGRAM);
+    ASSERT_EQ(flat.children(root).size(), 2u);
+
+    uint32_t let = flat.children(root)[0];
+    EXPECT_EQ(flat.kind(let), NodeKind::LET);
+    EXPECT_EQ(flat.offset(let), 0u);
+    uint32_t sum = flat.children(let)[1];
+    EXPECT_EQ(flat.kind(sum), NodeKind::INFIX);
+    EXPECT_EQ(flat.literal(sum), "+");
+    EXPECT_EQ(flat.offset(sum), 10u);
+    EXPECT_EQ(flat.value(flat.children(sum)[1]), 2);
+    for(uint32_t child: flat.children(sum))
+        EXPECT_LT(child, sum);
+
+    uint32_t ifExp = flat.children(flat.children(root)[1])[0];
+    EXPECT_EQ(flat.kind(ifExp), NodeKind::IF);
+    EXPECT_EQ(flat.children(ifExp)[2], NO_NODE);
+    delete program;
+}
+
+TEST(FlatAstTests, TestEvalThroughAdapter){
+    std::string input = "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };"
+                        "let total = 0; for (x in [1, 2, 3]) { total = total + fib(x * 3) } total";
+    Lexer l = Lexer(input);
+    Parser p = Parser(&l);
+    Program* program = p.parseProgram();
+    checkParserErrors(p);
+    Program* rebuilt = FlatAst(program).toProgram();
+    Environment env = Environment();
+    testIntegerObject(Eval(rebuilt, &env).toObject(), 2 + 8 + 34);
+}
+
+TEST(FlatAstTests, TestEvalFlat){
+    // each program gives the same result from the flat tree as from the pointer tree it was built from
+    vector<std::string> inputs = {
+        "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; fib(12)",
+        "let add = fn(x) { fn(y) { x + y } }; let i = 0; let s = 0; while (i < 10) { s = add(i)(s); i = i + 1 } s",
+        "let total = 0; for (x in [1, 2, 3]) { if (x == 2) { return total * 10 } total = total + x } total",
+        "let h = {\"a\": [1, \"two\"], 3: true}; [h[\"a\"][1], h[3], h[4], -h[\"a\"][0], !h[3]]",
+        "reduce(map(filter([5, 1, 4, 2], fn(x) { x > 1 }), fn(x) { x * x }), 0, fn(a, x) { a + x })",
+        "sort([\"b\", \"c\", \"a\"], fn(x, y) { x < y })",
+        "len(pmap([1, 2, 3], fn(x) { x + 1 })) + len(\"ab\" + \"c\")",
+        "fn(a, b) { a + b }",
+        "let f = fn() { y }; f()",
+        "5 + true",
+        "map([1], fn(x, y) { x })",
+        "",
+    };
+    for(const std::string& input: inputs){
+        Lexer l = Lexer(input);
+        Parser p = Parser(&l);
+        Program* program = p.parseProgram();
+        checkParserErrors(p);
+        FlatAst flat(program);
+        Environment treeEnv = Environment();
+        Environment flatEnv = Environment();
+        Value expected = Eval(program, &treeEnv);
+        Value evaluated = evalFlat(flat, &flatEnv);
+        EXPECT_EQ(evaluated.inspect(), expected.inspect()) << input;
+        if(isError(expected) && isError(evaluated)){
+            EXPECT_EQ(static_cast<Error*>(evaluated.asObject())->offset, static_cast<Error*>(expected.asObject())->offset) << input;
+        }
+        delete program;
+    }
+    // infix expressions quicken in the flat tree, and deoptimize when the operands stop fitting
+    Lexer l = Lexer("let f = fn(a, b) { a + b }; f(1, 2)");
+    Parser p = Parser(&l);
+    Program* program = p.parseProgram();
+    FlatAst flat(program);
+    uint32_t infix = 0;
+    while(flat.kind(infix) != NodeKind::INFIX)
+        infix++;
+    Environment env = Environment();
+    quickeningEnabled = false;
+    evalFlat(flat, &env);
+    EXPECT_EQ(flat.quickened(infix).load(), Quickened::UNSEEN) << "nothing specializes while quickening is off";
+    quickeningEnabled = true;
+    evalFlat(flat, &env);
+    EXPECT_EQ(flat.quickened(infix).load(), Quickened::INTEGER_ADD);
+    Lexer callLexer = Lexer("f(\"a\", \"b\")");
+    Parser callParser = Parser(&callLexer);
+    Program* call = callParser.parseProgram();
+    EXPECT_EQ(Eval(call, &env).inspect(), "ab");
+    EXPECT_EQ(flat.quickened(infix).load(), Quickened::GENERIC);
+    delete call;
+    delete program;
+}
+
+TEST(FlatAstTests, TestSerialization){
+    std::string input = "let f = fn(a, b) { if (a < b) { [a, \"s\"] } else { {b: -a}[b] } }; f(1, 2)";
+    Lexer l = Lexer(input);
+    Parser p = Parser(&l);
+    Program* program = p.parseProgram();
+    checkParserErrors(p);
+    FlatAst flat(program);
+    std::string bytes;
+    flat.serialize(bytes);
+
+    FlatAst loaded;
+    ASSERT_TRUE(loaded.deserialize(bytes.data(), bytes.size()));
+    EXPECT_EQ(loaded.toString(), program->toString());
+    EXPECT_EQ(loaded.size(), flat.size());
+    for(uint32_t node = 0; node < flat.size(); node++)
+        EXPECT_EQ(loaded.offset(node), flat.offset(node));
+
+    // truncated or damaged trees are rejected instead of being rebuilt
+    EXPECT_FALSE(loaded.deserialize(bytes.data(), bytes.size() - 1));
+    EXPECT_EQ(loaded.size(), 0u);
+    for(size_t i = 0; i < bytes.size(); i += 7){
+        std::string damaged = bytes;
+        damaged[i] = (char)(damaged[i] ^ 0x5a);
+        FlatAst check;
+        if(check.deserialize(damaged.data(), damaged.size()))
+            delete check.toProgram(); // some bytes like offsets or literals can change harmlessly
+    }
+    delete program;
+}
+
+TEST(FlatAstTests, TestProgramCache){
+    std::string directory = ::testing::TempDir() + "monkey_cache_test";
+    ProgramCache cache(directory);
+    std::string source = "let add = fn(x, y) { x + y }; add(2, 3)";
+    std::remove(cache.pathFor(source.data(), source.size()).c_str());
+    FlatAst loaded;
+    EXPECT_FALSE(cache.load(source.data(), source.size(), loaded));
+    EXPECT_EQ(loaded.size(), 0u);
+
+    Lexer l = Lexer(source);
+    Parser p = Parser(&l);
+    Program* program = p.parseProgram();
+    checkParserErrors(p);
+    ASSERT_TRUE(cache.store(source.data(), source.size(), program));
+
+    ASSERT_TRUE(cache.load(source.data(), source.size(), loaded));
+    EXPECT_EQ(loaded.toString(), program->toString());
+    Environment env = Environment();
+    testIntegerObject(evalFlat(loaded, &env).toObject(), 5);
+
+    // a different source misses, and so does a file whose contents no longer match its header
+    std::string changed = source + " ";
+    EXPECT_FALSE(cache.load(changed.data(), changed.size(), loaded));
+    std::string path = cache.pathFor(source.data(), source.size());
+
+    // the copy of the source in the file is compared in full, as a colliding hash would match the header
+    std::string contents;
+    {
+        std::ifstream file(path, std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    size_t copy = contents.find(source);
+    ASSERT_NE(copy, std::string::npos);
+    contents[copy + 4] = 'X';
+    std::ofstream(path, std::ios::binary) << contents;
+    EXPECT_FALSE(cache.load(source.data(), source.size(), loaded));
+    ASSERT_TRUE(cache.store(source.data(), source.size(), program));
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(-3, std::ios::end);
+        file << "xyz";
+    }
+    EXPECT_FALSE(cache.load(source.data(), source.size(), loaded));
+    std::remove(path.c_str());
+    delete program;
+}
+
+// Incremental parser tests
+// helper which collects the token offsets of node and everything under it in a fixed order
+static void collectOffsets(Node* node, vector<uint32_t>& out){
+    out.push_back(node->token.offset);
+    vector<Node*> children;
+    node->children(children);
+    for(Node* child : children)
+        collectOffsets(child, out);
+}
+
+TEST(IncrementalParserTests, TestEditsMatchFullParse){
+    IncrementalParser incremental("let x = 5;\n"
+                                  "let add = fn(a, b) { a + b };\n"
+                                  "while (x < 10) { x = x + 1; }\n"
+                                  "add(x, 2)\n"
+                                  "puts(\"done\");");
+    struct {
+        size_t start;
+        size_t length;
+        std::string replacement;
+    } edits[] = {
+        {8, 1, "50"}, // inside the first statement
+        {0, 0, "let y = 1;\n"}, // before everything
+        {47, 1, "-"}, // operator inside the function body
+        {73, 0, "\n\n"}, // blank lines move every later statement down
+        {12, 0, "("}, // a broken statement, the rest still parses
+        {12, 1, ""}, // and fixed again
+        {100, 0, " + 3"}, // a broken call at the end
+        {0, 0, "\""}, // an unterminated string swallows everything
+        {0, 1, ""},
+    };
+    for(auto& edit : edits){
+        incremental.edit(edit.start, edit.length, edit.replacement);
+        std::string source = incremental.getSource();
+        Lexer l = Lexer(source);
+        Parser p = Parser(&l);
+        Program* full = p.parseProgram();
+        EXPECT_EQ(incremental.getProgram()->toString(), full->toString()) << source;
+        EXPECT_EQ(incremental.getErrors(), p.getErrors()) << source;
+        vector<uint32_t> expected, actual;
+        collectOffsets(full, expected);
+        collectOffsets(incremental.getProgram(), actual);
+        EXPECT_EQ(actual, expected) << source;
+        delete full;
+    }
+}
+
+TEST(IncrementalParserTests, TestReusesStatements){
+    std::string source;
+    for(int i = 0; i < 100; i++)
+        source += "let v = fn(a) { a * " + std::to_string(i) + " };\n";
+    IncrementalParser incremental(source);
+    EXPECT_EQ(incremental.parsedStatements(), 100u);
+    Statement* before = incremental.getProgram()->statements[10];
+    Statement* after = incremental.getProgram()->statements[90];
+
+    // changing one number in the middle only reparses it and its neighbour
+    size_t position = source.find("a * 50 ");
+    incremental.edit(position + 4, 2, "5000");
+    EXPECT_LE(incremental.parsedStatements(), 2u);
+    ASSERT_EQ(incremental.getProgram()->statements.size(), 100u);
+    EXPECT_EQ(incremental.getProgram()->statements[10], before);
+    EXPECT_EQ(incremental.getProgram()->statements[90], after);
+    EXPECT_EQ(incremental.getProgram()->statements[50]->toString(), "let v = fn(a)(a * 5000);");
+    EXPECT_EQ(after->token.offset, source.find("let v = fn(a) { a * 90 ") + 2);
+
+    // appending parses what was added and the two statements before it, the rest still evaluate
+    incremental.edit(incremental.getSource().size(), 0, "v(2)");
+    EXPECT_EQ(incremental.parsedStatements(), 3u);
+    Environment env = Environment();
+    testIntegerObject(Eval(incremental.getProgram(), &env).toObject(), 198);
+}
+
+// Parallel parser tests
+TEST(ParallelParserTests, TestStatementBoundaries){
+    std::string input = "let a = 1; let s = \";\"; let f = fn(x) { x; };\n  puts(f(a));\nlet b = [1;2];";
+    vector<size_t> expected = {11, 24, 48, 60};
+    EXPECT_EQ(findStatementBoundaries(input.data(), input.size(), 1), expected);
+    expected = {24, 48};
+    EXPECT_EQ(findStatementBoundaries(input.data(), input.size(), 20), expected);
+}
+
+TEST(ParallelParserTests, TestMatchesSerialParse){
+    ThreadPool pool(3);
+    std::string valid, broken;
+    for(int i = 0; i < 200; i++){
+        std::string n = std::to_string(i);
+        valid += "let f = fn(x) { if (x < " + n + ") { x * 2; } else { [x, \"a;b\"] } };\nputs(f(" + n + "));\n";
+        broken += i % 37 == 5 ? "let = " + n + ";\n" : "let v = {\"k\": " + n + "};\n";
+        if(i % 53 == 7)
+            broken += "puts(f(1) + );\n";
+    }
+    broken += "let s = \"unterminated;";
+    for(const std::string& input : {valid, broken}){
+        Lexer l = Lexer(input);
+        Parser p = Parser(&l);
+        Program* serial = p.parseProgram();
+        for(size_t chunkSize : {(size_t)1, (size_t)100, PARALLEL_PARSE_CHUNK}){
+            vector<string> errors;
+            Program* parallel = parseProgramParallel(std::make_shared<StringSource>(input), errors, pool, chunkSize);
+            EXPECT_EQ(parallel->toString(), serial->toString());
+            EXPECT_EQ(errors, p.getErrors());
+            ASSERT_EQ(parallel->statements.size(), serial->statements.size());
+            for(size_t i = 0; i < serial->statements.size(); i++)
+                EXPECT_EQ(parallel->statements[i]->token.offset, serial->statements[i]->token.offset);
+            delete parallel;
+        }
+        delete serial;
+    }
+}
+
+TEST(ParallelParserTests, TestMisSplitFallsBackToSerialParse){
+    ThreadPool pool(3);
+    // the ';' in the string and the ones inside the nested braces are never boundaries, so chunks which
+    // agree with the serial parse are joined without parsing again
+    std::string nested = "let s = \";{\"; let f = fn(x) { if (x) { let t = \"}\"; x; }; x }; puts(s); f(1);";
+    // a statement of just ';' swallows the one after it, so the boundary there is inside a statement
+    std::string misSplit = nested + " let a = 1; ; ; let b = {\"k\": \";\"}; puts(b[\"k\"] + a);";
+    vector<size_t> boundaries = findStatementBoundaries(nested.data(), nested.size(), 1);
+    vector<size_t> expected = {14, 63, 72};
+    EXPECT_EQ(boundaries, expected);
+
+    for(const std::string& input : {nested, misSplit}){
+        Lexer l = Lexer(input);
+        Parser p = Parser(&l);
+        Program* serial = p.parseProgram();
+        vector<string> errors;
+        bool reparsed = false;
+        Program* parallel = parseProgramParallel(std::make_shared<StringSource>(input), errors, pool, 1, &reparsed);
+        EXPECT_EQ(reparsed, input == misSplit) << input;
+        EXPECT_EQ(parallel->toString(), serial->toString());
+        EXPECT_EQ(errors, p.getErrors());
+        EXPECT_EQ(errors.empty(), input == nested);
+        ASSERT_EQ(parallel->statements.size(), serial->statements.size());
+        for(size_t i = 0; i < serial->statements.size(); i++)
+            EXPECT_EQ(parallel->statements[i]->token.offset, serial->statements[i]->token.offset);
+        delete parallel;
+        delete serial;
+    }
+}
+
+// Heap tests
+TEST(HeapTests, TestMinorCollectionsKeepReachableValues){
+    // allocates several nurseries worth of arrays and strings, keeping every thousandth array
+    std::string input = "let i = 0; let s = \"\"; let keep = [];"
+                        "while (i < 40000) {"
+                        "  let a = [i, \"x\" + \"y\", {\"k\": [i]}];"
+                        "  s = s + \"ab\";"
+                        "  if (i / 1000 * 1000 == i) { keep = push(keep, a) }"
+                        "  i = i + 1;"
+                        "}"
+                        "[len(s), len(keep), keep[5][2][\"k\"][0], keep[39][1]]";
+    size_t before = heapStats().minorCollections;
+    Object* evaluated = testEval(input);
+    EXPECT_GT(heapStats().minorCollections, before) << "the loop never collected";
+    ASSERT_NE(evaluated, nullptr);
+    EXPECT_EQ(evaluated->inspect(), "[80000, 40, 5000, xy]");
+}
+
+TEST(HeapTests, TestMajorCollectionFreesGarbage){
+    std::string input = "let add = fn(x) { fn(y) { x + y } };"
+                        "let addTwo = add(2);"
+                        "let id = fn(x) { x };"
+                        "id(1); id(2);"
+                        "let s = \"a rope long enough to not be copied when it is \" + \"concatenated with another\";"
+                        "let h = {\"k\": [4, \"four\"]};";
+    Lexer l = Lexer(input);
+    Parser p = Parser(&l);
+    Program* program = p.parseProgram();
+    checkParserErrors(p);
+    Environment env = Environment();
+    Eval(program, &env);
+
+    size_t freed = heapStats().freedEnvironments;
+    collectGarbage(true);
+    collectGarbage(true); // everything left is reachable, so a second collection is a no-op
+    EXPECT_GT(heapStats().freedEnvironments, freed) << "the environments of the calls to id were not freed";
+
+    // what env can reach survives being moved out of the nursery and the sweep
+    std::string check = "[addTwo(3), s, h[\"k\"][1], len(s)]";
+    Lexer checkLexer = Lexer(check);
+    Parser checkParser = Parser(&checkLexer);
+    EXPECT_EQ(Eval(checkParser.parseProgram(), &env).inspect(),
+              "[5, a rope long enough to not be copied when it is concatenated with another, four, 72]");
+}
+
+TEST(HeapTests, TestIncrementalCollectionKeepsMovedValues){
+    // the only reference to the old data moves between two variables of an old environment while the
+    // marker works through the heap, and a tree big enough to take several slices, in slices
+    std::string input = "let tree = fn(d) { if (d == 0) { [] } else { [tree(d - 1), tree(d - 1)] } };"
+                        "let big = tree(14);"
+                        "let holder = fn() {"
+                        "  let a = [[1, 2], \"three\", {\"k\": [4]}];"
+                        "  let b = 0;"
+                        "  fn(n) { let i = 0; while (i < n) { let t = a; a = b; b = t; i = i + 1; } [a, b] }"
+                        "};"
+                        "let swap = holder();";
+    Lexer l = Lexer(input);
+    Parser p = Parser(&l);
+    Program* program = p.parseProgram();
+    checkParserErrors(p);
+    Environment env = Environment();
+    Eval(program, &env);
+    collectGarbage(true); // everything is old and unmarked when the incremental collection starts
+
+    std::chrono::microseconds budget = collectionPauseBudget;
+    collectionPauseBudget = std::chrono::microseconds(20);
+    HeapStats before = heapStats();
+    beginMajorCollection();
+    Lexer callLexer = Lexer("let j = 0; while (j < 2000) { swap(2); j = j + 1; }; swap(0)");
+    Parser callParser = Parser(&callLexer);
+    Program* call = callParser.parseProgram();
+    for(int round = 0; round < 1000 && majorCollectionInProgress(); round++)
+        ASSERT_EQ(Eval(call, &env).inspect(), "[[[1, 2], three, {k: [4]}], 0]");
+    collectionPauseBudget = budget;
+    EXPECT_FALSE(majorCollectionInProgress()) << "the collection never finished";
+
+    HeapStats after = heapStats();
+    EXPECT_GT(after.majorCollections, before.majorCollections);
+    EXPECT_GT(after.majorSlices, before.majorSlices + 1) << "the collection ran in a single slice";
+    size_t pauses = 0;
+    for(size_t i = 0; i < PAUSE_BUCKETS; i++)
+        pauses += after.pauses[i] - before.pauses[i];
+    EXPECT_GE(pauses, after.majorSlices - before.majorSlices);
+    EXPECT_GE(after.maxPauseMicros * pauses, after.totalPauseMicros - before.totalPauseMicros);
+    EXPECT_EQ(Eval(call, &env).inspect(), "[[[1, 2], three, {k: [4]}], 0]");
+}
+
+TEST(HeapTests, TestFunctionBodiesCollect){
+    // one call allocating several nurseries worth of garbage, so only safe points inside it can reclaim it
+    std::string input = "let pair = fn(x) { [x, \"x\" + \"y\"] };"
+                        "let churn = fn(n) {"
+                        "  let i = 0; let keep = [];"
+                        "  while (i < n) {"
+                        "    let a = [pair(i), {\"k\": pair(i)[0]}];"
+                        "    if (i / 1000 * 1000 == i) { keep = push(keep, a) }"
+                        "    i = i + 1;"
+                        "  }"
+                        "  [len(keep), keep[7][0][0] + keep[7][1][\"k\"]]"
+                        "};";
+    Lexer l = Lexer(input);
+    Parser p = Parser(&l);
+    Program* program = p.parseProgram();
+    checkParserErrors(p);
+    Environment env = Environment();
+    Eval(program, &env);
+    collectGarbage(true);
+
+    Lexer callLexer = Lexer("churn(40000)");
+    Parser callParser = Parser(&callLexer);
+    Program* call = callParser.parseProgram();
+    HeapStats before = heapStats();
+    EXPECT_EQ(Eval(call->statements[0], &env).inspect(), "[40, 14000]") << "evaluated without the top level safe point";
+    HeapStats after = heapStats();
+    EXPECT_GT(after.minorCollections, before.minorCollections) << "the call never collected";
+    // about a million objects are allocated, the nursery collections only keep what the loop kept
+    EXPECT_LT(after.promotedObjects - before.promotedObjects, 20000u);
+}
+
+TEST(HeapTests, TestBuiltinCallbacksCollect){
+    // callbacks allocating several nurseries worth of garbage between them, the arrays, the results built
+    // so far and the accumulator move under the builtins while they run
+    std::string input = "let churn = fn(x) { let i = 0; while (i < 400) { let t = [i, \"x\" + \"y\"]; i = i + 1; } x };"
+                        "let xs = []; let i = 0; while (i < 100) { xs = push(xs, i); i = i + 1; }"
+                        "let check = fn() {"
+                        "  let mapped = map(xs, fn(x) { churn([x, \"v\" + \"w\"]) });"
+                        "  let kept = filter(mapped, fn(p) { churn(p[0] / 10 * 10 == p[0]) });"
+                        "  let total = reduce(kept, \"\", fn(acc, p) { churn(acc + p[1]) });"
+                        "  let sorted = sort(kept, fn(a, b) { churn(a[0] > b[0]) });"
+                        "  [len(mapped), mapped[42][0], len(kept), total, sorted[0][0], sorted[9][1]]"
+                        "};";
+    Lexer l = Lexer(input);
+    Parser p = Parser(&l);
+    Program* program = p.parseProgram();
+    checkParserErrors(p);
+    Environment env = Environment();
+    Eval(program, &env);
+    collectGarbage(true);
+
+    Lexer callLexer = Lexer("check()");
+    Parser callParser = Parser(&callLexer);
+    Program* call = callParser.parseProgram();
+    HeapStats before = heapStats();
+    EXPECT_EQ(Eval(call->statements[0], &env).inspect(), "[100, 42, 10, vwvwvwvwvwvwvwvwvwvw, 90, vw]")
+        << "evaluated without the top level safe point";
+    EXPECT_GT(heapStats().minorCollections, before.minorCollections) << "the callbacks never collected";
+}
+
+TEST(HeapTests, TestIncrementalCollectionAdvancesInsideFunctions){
+    // a major collection started before a single long call runs in slices at the loop iterations inside it
+    std::string input = "let tree = fn(d) { if (d == 0) { [] } else { [tree(d - 1), tree(d - 1)] } };"
+                        "let big = tree(14);"
+                        "let spin = fn(n) { let i = 0; while (i < n) { let t = [i, big]; i = i + 1; } len(big[1][0]) };";
+    Lexer l = Lexer(input);
+    Parser p = Parser(&l);
+    Program* program = p.parseProgram();
+    checkParserErrors(p);
+    Environment env = Environment();
+    Eval(program, &env);
+    collectGarbage(true);
+
+    std::chrono::microseconds budget = collectionPauseBudget;
+    collectionPauseBudget = std::chrono::microseconds(20);
+    HeapStats before = heapStats();
+    beginMajorCollection();
+    Lexer callLexer = Lexer("spin(60000)");
+    Parser callParser = Parser(&callLexer);
+    Program* call = callParser.parseProgram();
+    Value result = Eval(call->statements[0], &env); // without the top level safe point
+    collectionPauseBudget = budget;
+    EXPECT_EQ(result.inspect(), "2");
+    EXPECT_FALSE(majorCollectionInProgress()) << "the collection never finished inside the call";
+
+    HeapStats after = heapStats();
+    EXPECT_GT(after.majorCollections, before.majorCollections);
+    EXPECT_GT(after.majorSlices, before.majorSlices + 1) << "the collection ran in a single slice";
+    EXPECT_EQ(Eval(call->statements[0], &env).inspect(), "2");
+}
+
+// Allocation profile tests
+TEST(AllocationProfileTests, TestCountsByKindAndSite){
+    std::string input = "let a = [1, 2];"
+                        "let i = 0;"
+                        "while (i < 100) { let s = \"x\" + \"y\"; i = i + 1; }"
+                        "a";
+    Lexer l = Lexer(input);
+    Parser p = Parser(&l);
+    Program* program = p.parseProgram();
+    checkParserErrors(p);
+    Environment env = Environment();
+
+    allocationProfiling = true;
+    resetAllocationProfile();
+    Eval(program, &env);
+    AllocationProfile profile = allocationProfile();
+    allocationProfiling = false;
+
+    EXPECT_EQ(profile.allocated[(size_t)ObjectType::ARRAY_OBJ].objects, 1u);
+    EXPECT_EQ(profile.allocated[(size_t)ObjectType::STRING_OBJ].objects, 300u) << "two literals and a concatenation";
+    EXPECT_EQ(profile.allocated[ENVIRONMENT_KIND].objects, 1u) << "the loop's environment";
+    EXPECT_GE(profile.live[(size_t)ObjectType::ARRAY_OBJ].objects, 1u);
+
+    // the concatenation is counted against the infix expression, not the literals it evaluated first
+    auto concatenation = std::find_if(profile.sites.begin(), profile.sites.end(), [](const AllocationSiteProfile& site){
+        return site.source == "(x + y)";
+    });
+    ASSERT_NE(concatenation, profile.sites.end());
+    EXPECT_EQ(concatenation->kinds[(size_t)ObjectType::STRING_OBJ].objects, 100u);
+    EXPECT_EQ(concatenation->total().objects, 100u);
+    EXPECT_EQ(l.locate(concatenation->offset).line, 1u);
+
+    std::string report = formatAllocationReport(profile, 3, &l);
+    EXPECT_NE(report.find("STRING"), std::string::npos) << report;
+    EXPECT_NE(report.find("top 3 allocation sites by bytes"), std::string::npos) << report;
+}
+
+// Sample profiler tests
+TEST(SampleProfilerTests, TestCollapsedStacksNameFunctions){
+    std::string input = "let inner = fn(n) { let i = 0; while (i < n) { i = i + 1; } i };"
+                        "let outer = fn(n) { inner(n) + (fn(x) { x })(1) };";
+    Lexer l = Lexer(input);
+    Parser p = Parser(&l);
+    Program* program = p.parseProgram();
+    checkParserErrors(p);
+    // functions are named after their let binding, in trees rebuilt from the flat encoding too
+    Program* rebuilt = FlatAst(program).toProgram();
+    for(Program* tree: {program, rebuilt}){
+        LetStatement* let = dynamic_cast<LetStatement*>(tree->statements[0]);
+        ASSERT_NE(let, nullptr);
+        EXPECT_EQ(dynamic_cast<FunctionLiteral*>(let->expressionValue)->name, "inner");
+    }
+    delete rebuilt;
+
+    Environment env = Environment();
+    Eval(program, &env);
+    Lexer callLexer = Lexer("outer(20000)");
+    Parser callParser = Parser(&callLexer);
+    Program* call = callParser.parseProgram();
+    ASSERT_TRUE(startSampling(std::chrono::microseconds(200)));
+    EXPECT_FALSE(startSampling()) << "sampling was started twice";
+    for(int round = 0; round < 1000 && sampleCount() < 20; round++)
+        Eval(call, &env);
+    stopSampling();
+    ASSERT_GE(sampleCount(), 20u);
+    // a SIGPROF the timer sent just before it stopped can still arrive, it must not end the process or count
+    size_t taken = sampleCount();
+    std::raise(SIGPROF);
+    EXPECT_EQ(sampleCount(), taken);
+
+    // every sample is on one line and nearly all of the time is spent in inner's loop
+    std::istringstream lines(collapsedStacks(&l));
+    std::string line;
+    size_t total = 0, inInner = 0;
+    while(std::getline(lines, line)){
+        size_t space = line.rfind(' ');
+        ASSERT_NE(space, std::string::npos) << line;
+        size_t count = std::stoul(line.substr(space + 1));
+        total += count;
+        if(line.substr(0, space) == "monkey;outer;inner")
+            inInner += count;
+        else
+            EXPECT_EQ(line.rfind("monkey", 0), 0u) << line;
+    }
+    EXPECT_EQ(total, sampleCount());
+    EXPECT_GT(inInner, 0u);
+}
+
+// Node profiler tests
+TEST(NodeProfileTests, TestCountsEvaluationsByNodeAndKind){
+    std::string input = "let add = fn(a, b) { a + b };\n"
+                        "let fact = fn(n) { if (n < 2) { 1 } else { n * fact(n - 1) } };"
+                        "let i = 0; while (i < 10) { i = add(i, 1); } fact(5); len(\"abc\")";
+    Lexer l = Lexer(input);
+    Parser p = Parser(&l);
+    Program* program = p.parseProgram();
+    checkParserErrors(p);
+    Environment env = Environment();
+
+    nodeProfiling = true;
+    resetNodeProfile();
+    Eval(program, &env);
+    nodeProfiling = false;
+    NodeProfile profile = nodeProfile();
+
+    std::map<std::string, NodeProfileEntry> byKindAndSource;
+    for(NodeProfileEntry& entry: profile.nodes)
+        byKindAndSource.emplace(profiledKindName(entry.kind) + " " + entry.node->toString(), entry);
+    EXPECT_EQ(byKindAndSource.at("INFIX (i < 10)").evaluated.evaluations, 11u);
+    EXPECT_EQ(byKindAndSource.at("INFIX (a + b)").evaluated.evaluations, 10u);
+    EXPECT_EQ(byKindAndSource.at("INFIX (n * fact((n - 1)))").evaluated.evaluations, 4u);
+    NodeProfileEntry add = byKindAndSource.at("FUNCTION fn(a, b)(a + b)");
+    EXPECT_EQ(add.evaluated.evaluations, 1u) << "the literal is evaluated once";
+    EXPECT_EQ(add.applied.evaluations, 10u) << "and the function it created applied ten times";
+    EXPECT_EQ(profile.kinds[FUNCTION_CALL_KIND].evaluations, 15u);
+    EXPECT_EQ(profile.kinds[BUILTIN_CALL_KIND].evaluations, 1u);
+    EXPECT_EQ(profile.kinds[(size_t)NodeKind::PROGRAM].evaluations, 1u);
+
+    // nested evaluations of a node or kind are only timed once, so nothing takes longer than the program
+    uint64_t programTime = profile.kinds[(size_t)NodeKind::PROGRAM].nanoseconds;
+    for(size_t kind = 0; kind < PROFILED_KINDS; kind++)
+        EXPECT_LE(profile.kinds[kind].nanoseconds, programTime) << profiledKindName(kind);
+    for(NodeProfileEntry& entry: profile.nodes)
+        EXPECT_LE(entry.evaluated.nanoseconds, programTime) << entry.node->toString();
+
+    std::string json = nodeProfileJson(profile, &l);
+    EXPECT_NE(json.find("{\"kind\": \"INFIX\", \"offset\": 23, \"line\": 1, \"column\": 24, \"source\": "
+                        "\"let add = fn(a, b) { a + b };\", \"node\": \"(a + b)\", "
+                        "\"evaluations\": 10, \"nanoseconds\": "), std::string::npos) << json;
+    EXPECT_NE(json.find("{\"kind\": \"STRING\", \"offset\": "), std::string::npos) << json;
+    EXPECT_NE(json.find("\"calls\": {\"evaluations\": 10, "), std::string::npos) << json;
+
+    // nothing is counted while profiling is off
+    resetNodeProfile();
+    Eval(program, &env);
+    profile = nodeProfile();
+    EXPECT_TRUE(profile.nodes.empty());
+    EXPECT_EQ(profile.kinds[(size_t)NodeKind::PROGRAM].evaluations, 0u);
+}
+
+// Tracing tests
+TEST(TracingTests, TestRecordsPhasesAndCalls){
+    Lexer l = Lexer("let f = fn(n) { len([n]) }; f(1); (fn() { f(2) })()");
+    Parser p = Parser(&l);
+    Program* program = p.parseProgram();
+    checkParserErrors(p);
+    Environment env = Environment();
+
+    startTracing();
+    {
+        TraceSpan span(TRACE_PHASE, "evaluate");
+        Eval(program, &env);
+    }
+    stopTracing();
+    Eval(program, &env); // not recorded
+    EXPECT_EQ(traceEventCount(), 6u) << "the phase, three calls and two builtin calls";
+    std::string json = traceJson(&l);
+    EXPECT_EQ(json.rfind("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n{\"name\": \"thread_name\", \"ph\": \"M\"", 0), 0u) << json;
+    EXPECT_NE(json.find("{\"name\": \"evaluate\", \"cat\": \"phase\", \"ph\": \"X\", \"ts\": "), std::string::npos) << json;
+    EXPECT_NE(json.find("{\"name\": \"f\", \"cat\": \"call\", \"ph\": \"X\", \"ts\": "), std::string::npos) << json;
+    EXPECT_NE(json.find("{\"name\": \"fn@1:36\", \"cat\": \"call\""), std::string::npos) << json;
+    EXPECT_NE(json.find("{\"name\": \"len\", \"cat\": \"builtin\""), std::string::npos) << json;
+    EXPECT_EQ(json.substr(json.size() - 4), "\n]}\n");
+
+    // calls shorter than the threshold are left out, everything else is kept
+    traceCallThreshold = std::chrono::hours(1);
+    startTracing();
+    Eval(program, &env);
+    stopTracing();
+    traceCallThreshold = std::chrono::microseconds(0);
+    EXPECT_EQ(traceEventCount(), 2u);
+    EXPECT_EQ(traceJson(&l).find("\"cat\": \"call\""), std::string::npos);
+}
+
+// REPL tests
+TEST(REPLTests, TestParseTimeArgument){
+    size_t runs;
+    std::string code;
+    ASSERT_TRUE(parseTimeArgument(" 1 + 2", runs, code));
+    EXPECT_EQ(runs, TIME_RUNS);
+    EXPECT_EQ(code, "1 + 2");
+    ASSERT_TRUE(parseTimeArgument(" x3 fib(10)", runs, code));
+    EXPECT_EQ(runs, 3u);
+    EXPECT_EQ(code, "fib(10)");
+    ASSERT_TRUE(parseTimeArgument(" x" + std::to_string(MAX_TIME_RUNS) + " 1", runs, code));
+    EXPECT_EQ(runs, MAX_TIME_RUNS);
+
+    std::string rejected[] = {"", " ", "1", " x0 1", " x 1", " x3", " x3 ", " x-3 1", " x+3 1", " x3a 1",
+        " x" + std::to_string(MAX_TIME_RUNS + 1) + " 1", " x18446744073709551616 1", " x99999999999999999999999999 1"};
+    for(const std::string& argument: rejected)
+        EXPECT_FALSE(parseTimeArgument(argument, runs, code)) << "'" << argument << "'";
+}
+
+TEST(REPLTests, TestFastestAndMedian){
+    EXPECT_EQ(fastestAndMedian({0.002}), "min 2.000 ms, median 2.000 ms");
+    EXPECT_EQ(fastestAndMedian({0.005, 0.001, 0.003}), "min 1.000 ms, median 3.000 ms");
+    EXPECT_EQ(fastestAndMedian({0.004, 0.001, 0.002, 0.0035}), "min 1.000 ms, median 2.750 ms");
+}
+
+// Regression gate tests
+TEST(RegressionGateTests, TestSummarize){
+    EXPECT_EQ(median({3}), 3);
+    EXPECT_EQ(median({5, 1, 3}), 3);
+    EXPECT_EQ(median({4, 1, 2, 3}), 2.5);
+    Statistics statistics = summarize({10, 12, 11, 30, 9});
+    EXPECT_EQ(statistics.median, 11);
+    EXPECT_EQ(statistics.deviation, 1) << "deviations 1, 1, 0, 19, 2, the outlier doesn't move it";
+}
+
+TEST(RegressionGateTests, TestRegressionNeedsThresholdAndNoise){
+    Statistics before{100, 1};
+    EXPECT_TRUE(isRegression({115, 1}, before, 0.10));
+    EXPECT_FALSE(isRegression({105, 1}, before, 0.10)) << "within the threshold";
+    EXPECT_FALSE(isRegression({115, 6}, before, 0.10)) << "15 ms slower but 3 deviations of 6 ms is 18";
+    EXPECT_TRUE(isRegression({115, 4}, before, 0.10));
+    EXPECT_FALSE(isRegression({115, 1}, {100, 6}, 0.10)) << "the noisier of the two measurements counts";
+    EXPECT_FALSE(isRegression({80, 1}, before, 0.10)) << "faster is never a regression";
+}
+
+TEST(RegressionGateTests, TestBaselineFailsClosed){
+    std::vector<Result> recorded = {{"loops", {12.5, 0.25}}, {"sort", {40, 2}}};
+    std::vector<Result> read;
+    ASSERT_TRUE(parseBaseline(baselineJson(recorded), read));
+    ASSERT_EQ(read.size(), 2u);
+    EXPECT_EQ(read[1].name, "sort");
+    EXPECT_EQ(read[0].statistics.median, 12.5);
+    EXPECT_EQ(read[0].statistics.deviation, 0.25);
+
+    for(std::string json: {"", "{}", "{\"workloads\": []}", "not json", "{\"name\": \"loops\", \"mad_ms\": 1}"}){
+        std::vector<Result> none;
+        EXPECT_FALSE(parseBaseline(json, none)) << json;
+        EXPECT_TRUE(none.empty()) << json;
+    }
+    std::vector<Result> missing;
+    EXPECT_FALSE(readBaseline(::testing::TempDir() + "monkey_no_such_baseline.json", missing));
+}
+
+// Differential tests
+TEST(DifferentialTests, TestEnginesAgreeOnRandomPrograms){
+    for(uint64_t seed = 0; seed < 200; seed++){
+        std::string source = generateProgram(seed);
+        EXPECT_EQ(source, generateProgram(seed)) << "programs must be reproducible from their seed";
+        DifferentialResult result = runDifferential(source);
+        ASSERT_EQ(result.runs.size(), differentialEngines().size());
+        EXPECT_EQ(result.runs[0].output.find("ERROR"), std::string::npos) << "generated programs shouldn't fail\n" << source;
+        ASSERT_TRUE(result.agree) << "seed " << seed << "\n" << formatDisagreement(source, result);
+    }
+}
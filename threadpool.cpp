@@ -0,0 +1,109 @@
+// definitions for threadpool.h
+
+#include "threadpool.h"
+#include <algorithm>
+#include <cstdint>
+
+// index of the queue owned by the current thread, outside threads share the last queue
+static thread_local size_t homeQueue = SIZE_MAX;
+
+// constructor
+ThreadPool::ThreadPool(size_t workers){
+    for(size_t i = 0; i <= workers; i++)
+        queues.push_back(std::make_unique<WorkQueue>());
+    for(size_t i = 0; i < workers; i++)
+        threads.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+// destructor, finishes queued tasks then joins the workers
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> guard(idleLock);
+        stopping = true;
+    }
+    idle.notify_all();
+    for(std::thread& thread: threads)
+        thread.join();
+}
+
+// splits [0, count) into chunks of at most grain indexes and runs fn(begin, end) on each
+void ThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn){
+    if(count == 0)
+        return;
+    if(grain == 0)
+        grain = 1;
+    size_t chunks = (count + grain - 1) / grain;
+    std::atomic<size_t> remaining(chunks);
+    {
+        std::lock_guard<std::mutex> guard(idleLock);
+        queued.fetch_add(chunks);
+    }
+
+    // deal the chunks out round robin, idle workers steal whatever their neighbours haven't reached
+    for(size_t chunk = 0; chunk < chunks; chunk++){
+        size_t begin = chunk * grain;
+        size_t end = std::min(count, begin + grain);
+        WorkQueue& queue = *queues[chunk % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back([&fn, &remaining, begin, end](){
+            fn(begin, end);
+            remaining.fetch_sub(1, std::memory_order_acq_rel);
+        });
+    }
+    idle.notify_all();
+
+    size_t home = homeQueue == SIZE_MAX ? queues.size() - 1 : homeQueue;
+    while(remaining.load(std::memory_order_acquire) > 0){
+        if(!runOne(home))
+            std::this_thread::yield(); // the last chunks are running on other threads
+    }
+}
+
+// returns the number of threads which run tasks, including the caller of parallelFor
+size_t ThreadPool::concurrency(){
+    return threads.size() + 1;
+}
+
+// runs one task, from the back of the home queue if it has any otherwise stolen from another queue
+bool ThreadPool::runOne(size_t home){
+    for(size_t i = 0; i < queues.size(); i++){
+        WorkQueue& queue = *queues[(home + i) % queues.size()];
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if(queue.tasks.empty())
+                continue;
+            if(i == 0){
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            else{
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+        }
+        queued.fetch_sub(1);
+        task();
+        return true;
+    }
+    return false;
+}
+
+// loop each worker thread runs until the pool is destroyed
+void ThreadPool::workerLoop(size_t index){
+    homeQueue = index;
+    while(true){
+        if(runOne(index))
+            continue;
+        std::unique_lock<std::mutex> guard(idleLock);
+        idle.wait(guard, [this](){ return stopping || queued.load() > 0; });
+        if(stopping && queued.load() == 0)
+            return;
+    }
+}
+
+// returns the pool shared by the parallel builtins, sized to the hardware on first use
+ThreadPool& sharedThreadPool(){
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
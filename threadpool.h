@@ -0,0 +1,61 @@
+// work stealing thread pool used by the parallel builtins
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+    public:
+        // constructor
+        // EFFECTS:  starts workers threads, each with its own queue of tasks
+        ThreadPool(size_t workers);
+
+        // destructor, finishes queued tasks then joins the workers
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // splits [0, count) into chunks of at most grain indexes and runs fn(begin, end) on each
+        // REQUIRES: fn is safe to call from several threads at once
+        // EFFECTS:  returns once every chunk has run, the calling thread runs chunks as well so
+        //           nested calls from inside a task can't deadlock the pool
+        void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+        // returns the number of threads which run tasks, including the caller of parallelFor
+        size_t concurrency();
+
+    private:
+        struct WorkQueue {
+            std::mutex lock;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        // runs one task, from the back of the home queue if it has any otherwise stolen from the
+        // front of another queue
+        // EFFECTS:  returns false if every queue was empty
+        bool runOne(size_t home);
+
+        // loop each worker thread runs until the pool is destroyed
+        void workerLoop(size_t index);
+
+        std::vector<std::thread> threads;
+        std::vector<std::unique_ptr<WorkQueue>> queues; // one per worker plus one for outside callers
+        std::mutex idleLock;
+        std::condition_variable idle;
+        std::atomic<size_t> queued{0};
+        bool stopping = false;
+};
+
+// returns the pool shared by the parallel builtins, sized to the hardware on first use
+ThreadPool& sharedThreadPool();
+
+#endif // THREADPOOL_H
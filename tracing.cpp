@@ -0,0 +1,204 @@
+// definitions for tracing.h
+
+#include "tracing.h"
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "evaluator.h"
+
+bool tracing = false;
+std::chrono::microseconds traceCallThreshold(0);
+
+const char* const TRACE_PHASE = "phase";
+const char* const TRACE_COLLECTION = "gc";
+const char* const TRACE_CALL = "call";
+const char* const TRACE_BUILTIN = "builtin";
+
+typedef std::chrono::steady_clock Clock;
+
+// a span, named by name or for calls by the function or builtin subject
+struct TraceEvent {
+    const char* category;
+    const char* name;
+    const void* subject;
+    Clock::time_point started;
+    Clock::duration duration;
+};
+
+// what the tracer keeps for each thread which records spans, only touched by that thread outside of
+// startTracing and traceJson, which run while no thread is evaluating
+struct ThreadTrace {
+    size_t id; // the track the thread's spans are shown on
+    std::vector<TraceEvent> events;
+    std::vector<TraceEvent> open; // spans which haven't ended, innermost last
+    size_t dropped = 0;
+};
+
+// the traces of every thread
+struct TraceRecorder {
+    std::mutex lock; // guards threads and nextId
+    std::vector<ThreadTrace*> threads;
+    std::vector<ThreadTrace*> exited; // kept as their spans are still part of the trace
+    size_t nextId = 1;
+    Clock::time_point epoch;
+};
+
+// the tracer, never destroyed so threads may exit during static destruction
+static TraceRecorder& recorder(){
+    static TraceRecorder* instance = new TraceRecorder();
+    return *instance;
+}
+
+// moves the thread's trace to the exited ones when the thread exits
+struct ThreadTraceOwner {
+    ThreadTrace* thread = nullptr;
+
+    ~ThreadTraceOwner(){
+        if(thread == nullptr)
+            return;
+        TraceRecorder& instance = recorder();
+        std::lock_guard<std::mutex> guard(instance.lock);
+        instance.threads.erase(std::find(instance.threads.begin(), instance.threads.end(), thread));
+        instance.exited.push_back(thread);
+        thread = nullptr;
+    }
+};
+
+static thread_local ThreadTraceOwner owner;
+
+// returns the calling thread's trace, registering the thread on first use
+static ThreadTrace* thisThreadTrace(){
+    if(owner.thread == nullptr){
+        ThreadTrace* thread = new ThreadTrace();
+        TraceRecorder& instance = recorder();
+        std::lock_guard<std::mutex> guard(instance.lock);
+        thread->id = instance.nextId++;
+        instance.threads.push_back(thread);
+        owner.thread = thread;
+    }
+    return owner.thread;
+}
+
+// starts a span
+bool TraceSpan::start(const char* category, const char* name, const void* subject){
+    ThreadTrace* thread = thisThreadTrace();
+    thread->open.push_back({category, name, subject, Clock::now(), Clock::duration()});
+    return true;
+}
+
+// ends the innermost span and records it, unless it is a call shorter than traceCallThreshold
+void TraceSpan::stop(){
+    ThreadTrace* thread = thisThreadTrace();
+    if(thread->open.empty())
+        return; // started before the trace was restarted
+    TraceEvent event = thread->open.back();
+    thread->open.pop_back();
+    event.duration = Clock::now() - event.started;
+    if(event.category == TRACE_CALL && event.duration < traceCallThreshold)
+        return;
+    if(thread->events.size() >= MAX_TRACE_EVENTS){
+        thread->dropped++;
+        return;
+    }
+    thread->events.push_back(event);
+}
+
+// forgets the spans recorded so far and starts recording
+void startTracing(){
+    TraceRecorder& instance = recorder();
+    std::lock_guard<std::mutex> guard(instance.lock);
+    for(ThreadTrace* thread: instance.exited)
+        delete thread;
+    instance.exited.clear();
+    for(ThreadTrace* thread: instance.threads){
+        thread->events.clear();
+        thread->open.clear();
+        thread->dropped = 0;
+    }
+    instance.epoch = Clock::now();
+    tracing = true;
+}
+
+// stops recording
+void stopTracing(){
+    tracing = false;
+}
+
+// helper which returns the trace of every thread which recorded spans, exited ones included
+// REQUIRES: recorder().lock is held
+static std::vector<ThreadTrace*> allThreads(){
+    TraceRecorder& instance = recorder();
+    std::vector<ThreadTrace*> all(instance.threads);
+    all.insert(all.end(), instance.exited.begin(), instance.exited.end());
+    return all;
+}
+
+// returns the number of spans recorded
+size_t traceEventCount(){
+    std::lock_guard<std::mutex> guard(recorder().lock);
+    size_t count = 0;
+    for(ThreadTrace* thread: allThreads())
+        count += thread->events.size();
+    return count;
+}
+
+// returns the number of spans dropped as a thread's buffer was full
+size_t droppedTraceEvents(){
+    std::lock_guard<std::mutex> guard(recorder().lock);
+    size_t count = 0;
+    for(ThreadTrace* thread: allThreads())
+        count += thread->dropped;
+    return count;
+}
+
+// helper which returns the name of the builtin, builtins are only known by the names they are bound to
+static std::string builtinName(const void* builtin){
+    for(auto& entry: builtins){
+        if(entry.second == builtin)
+            return entry.first;
+    }
+    return "builtin";
+}
+
+// helper which formats a duration as microseconds with three decimals, the unit trace viewers expect
+static std::string micros(Clock::duration duration){
+    long long nanoseconds = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    if(nanoseconds < 0)
+        return "0.000"; // started before the trace was restarted
+    std::string fraction = std::to_string(nanoseconds % 1000);
+    return std::to_string(nanoseconds / 1000) + "." + std::string(3 - fraction.size(), '0') + fraction;
+}
+
+// returns the spans as Chrome trace-event JSON, names are identifiers and constants so none need escaping
+std::string traceJson(Lexer* lexer){
+    TraceRecorder& instance = recorder();
+    std::lock_guard<std::mutex> guard(instance.lock);
+    std::vector<ThreadTrace*> threads = allThreads();
+    std::sort(threads.begin(), threads.end(), [](ThreadTrace* a, ThreadTrace* b){ return a->id < b->id; });
+
+    std::string json = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    std::unordered_map<const void*, std::string> names; // functions are named once however often they are called
+    for(ThreadTrace* thread: threads){
+        std::string tid = std::to_string(thread->id);
+        json += std::string(first ? "" : ",") + "\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " +
+            tid + ", \"args\": {\"name\": \"thread " + tid + "\"}}";
+        first = false;
+        for(TraceEvent& event: thread->events){
+            std::string name = event.name != nullptr ? event.name : "";
+            if(event.name == nullptr){
+                auto found = names.find(event.subject);
+                if(found == names.end()){
+                    found = names.emplace(event.subject, event.category == TRACE_CALL ?
+                        functionName((FunctionLiteral*)event.subject, lexer) : builtinName(event.subject)).first;
+                }
+                name = found->second;
+            }
+            json += ",\n{\"name\": \"" + name + "\", \"cat\": \"" + event.category + "\", \"ph\": \"X\", \"ts\": " +
+                micros(event.started - instance.epoch) + ", \"dur\": " + micros(event.duration) + ", \"pid\": 1, \"tid\": " +
+                tid + "}";
+        }
+    }
+    return json + "\n]}\n";
+}
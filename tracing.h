@@ -0,0 +1,83 @@
+// tracer which records when the interpreter's phases and Monkey function calls ran, for timeline viewers
+
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <chrono>
+#include <string>
+#include "ast.h"
+#include "lexer.h"
+#include "object.h"
+
+// Spans are recorded as Chrome trace-event complete events, one per span with its start and duration,
+// into a buffer of the thread they ran on so recording takes no lock. traceJson writes them in the
+// JSON object format chrome://tracing and Perfetto load, with a track for each thread.
+
+// events a thread keeps, later ones are dropped
+static const size_t MAX_TRACE_EVENTS = 1 << 20;
+
+// whether spans are recorded, only set between startTracing and stopTracing
+extern bool tracing;
+
+// shortest function call recorded, shorter ones are dropped so deep recursion doesn't flood the trace
+extern std::chrono::microseconds traceCallThreshold;
+
+// categories of spans
+extern const char* const TRACE_PHASE; // lexing, parsing, evaluating, writing output
+extern const char* const TRACE_COLLECTION; // garbage collection pauses
+extern const char* const TRACE_CALL; // Monkey function calls
+extern const char* const TRACE_BUILTIN; // builtin calls
+
+// records a span from its construction to its destruction if tracing is on. What is being recorded is
+// kept on a stack of the calling thread rather than in the span so the evaluator's frames stay small
+class TraceSpan {
+    public:
+        // a phase or collection span, name must outlive the trace
+        TraceSpan(const char* category, const char* name){
+            if(tracing)
+                active = start(category, name, nullptr);
+        }
+
+        // a call of the function created from literal
+        TraceSpan(FunctionLiteral* literal){
+            if(tracing)
+                active = start(TRACE_CALL, nullptr, literal);
+        }
+
+        // a call of builtin
+        TraceSpan(Builtin* builtin){
+            if(tracing)
+                active = start(TRACE_BUILTIN, nullptr, builtin);
+        }
+
+        ~TraceSpan(){
+            if(active)
+                stop();
+        }
+
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+
+    private:
+        static bool start(const char* category, const char* name, const void* subject);
+        static void stop();
+
+        bool active = false;
+};
+
+// forgets the spans recorded so far and starts recording, timestamps count from now
+// REQUIRES: no thread is evaluating
+void startTracing();
+
+// stops recording, the spans recorded are kept until the next start
+void stopTracing();
+
+// returns the number of spans recorded, and dropped as a thread's buffer was full
+size_t traceEventCount();
+size_t droppedTraceEvents();
+
+// returns the spans as Chrome trace-event JSON, anonymous functions located with lexer if it is given
+// REQUIRES: no thread is evaluating and the programs the calls were made in are still alive
+std::string traceJson(Lexer* lexer = nullptr);
+
+#endif // TRACING_H